@@ -0,0 +1,84 @@
+/**
+ * @file dht_bench.c
+ *
+ * Decode cost of one DHT frame per capture format, on the host.
+ *
+ *     dht_bench [--iterations N]
+ *
+ * Host numbers only rank the paths against each other; the ESP32 at 240 MHz
+ * is roughly an order of magnitude slower per frame.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dht_decode.h"
+#include "dht_wave.h"
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_report(const char *name, double start_ns, uint32_t iterations, unsigned ok)
+{
+    double per_frame = (bench_now_ns() - start_ns) / iterations;
+    printf("%-10s %10.1f ns/frame  (%u/%u ok)\n", name, per_frame, ok, iterations);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = 1000000;
+    if (argc == 3 && !strcmp(argv[1], "--iterations"))
+        iterations = strtoul(argv[2], NULL, 0);
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+        return 2;
+    }
+
+    uint32_t rng = 0x9E3779B9;
+    uint8_t data[DHT_DECODE_DATA_BYTES], out[DHT_DECODE_DATA_BYTES];
+    dht_pulse_t pulses[DHT_WAVE_MAX_PULSES];
+    uint32_t edges[DHT_WAVE_MAX_PULSES + 1], symbols[DHT_WAVE_MAX_PULSES];
+    dht_wave_config_t cfg = { .sensor_type = DHT_TYPE_AM2301 };
+    dht_decoder_t dec;
+    unsigned ok;
+    double start;
+
+    dht_wave_random_data(&rng, data);
+    size_t n = dht_wave_frame(&cfg, data, &rng, pulses, DHT_WAVE_MAX_PULSES);
+    size_t num_edges = dht_wave_to_edges(pulses, n, 0, edges, DHT_WAVE_MAX_PULSES + 1);
+    size_t num_symbols = dht_wave_to_rmt(pulses, n, symbols, DHT_WAVE_MAX_PULSES);
+    printf("frame: %zu pulses, %zu edges, %zu RMT words\n", n, num_edges, num_symbols);
+
+    ok = 0;
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+        ok += dht_decode_edges(&dec, cfg.sensor_type, edges, num_edges, 1, out) == DHT_DECODE_OK;
+    bench_report("edges", start, iterations, ok);
+
+    ok = 0;
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+        ok += dht_decode_rmt_symbols(&dec, cfg.sensor_type, symbols, num_symbols, out) == DHT_DECODE_OK;
+    bench_report("rmt", start, iterations, ok);
+
+    // the polling path feeds the recorded bit durations one by one, after phase 'D'
+    ok = 0;
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        dht_decoder_reset(&dec, NULL);
+        for (size_t p = 3; p < n; p++)
+            dht_decoder_feed(&dec, pulses[p].level, pulses[p].duration_us);
+        dht_decoder_feed(&dec, 1, 1);
+        ok += dht_decoder_finish(&dec, out) == DHT_DECODE_OK;
+    }
+    bench_report("streaming", start, iterations, ok);
+
+    return 0;
+}
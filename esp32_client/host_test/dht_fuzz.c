@@ -0,0 +1,160 @@
+/**
+ * @file dht_fuzz.c
+ *
+ * Feeds randomly distorted DHT frames through the decoder and tallies how
+ * each distortion is classified, for both the edge and the RMT capture
+ * formats.
+ *
+ *     dht_fuzz [--frames N] [--seed S] [--check]
+ *
+ * With --check the run fails when a case does not decode the way it must
+ * (see fuzz_case_t), which is how ctest runs it.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dht_decode.h"
+#include "dht_wave.h"
+
+#define EXPECT_ANY -1
+
+typedef struct
+{
+    const char *name;
+    dht_wave_config_t cfg;
+    int expect;         //!< Status every frame must decode to, EXPECT_ANY to only report
+} fuzz_case_t;
+
+typedef enum
+{
+    BACKEND_EDGES = 0,
+    BACKEND_RMT,
+    BACKEND_MAX
+} fuzz_backend_t;
+
+typedef struct
+{
+    uint32_t frames;
+    uint32_t status[DHT_DECODE_ERR_CHECKSUM + 1];
+    uint32_t wrong;     //!< Decoded OK with bytes that differ from the sent ones
+} fuzz_result_t;
+
+static const char *const backend_names[BACKEND_MAX] = { "edges", "rmt" };
+
+// RMT captures start while the host still holds the line low
+#define HOST_TAIL_US 40
+
+static const fuzz_case_t cases[] = {
+    { "dht11 nominal", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US }, DHT_DECODE_OK },
+    { "am2301 nominal", { .sensor_type = DHT_TYPE_AM2301, .host_tail_us = HOST_TAIL_US }, DHT_DECODE_OK },
+    { "dht11 jitter 3us", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .jitter_us = 3 }, DHT_DECODE_OK },
+    { "dht11 jitter 6us", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .jitter_us = 6 }, DHT_DECODE_OK },
+    { "dht11 jitter 10us", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .jitter_us = 10 }, EXPECT_ANY },
+    { "dht11 jitter 15us", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .jitter_us = 15 }, EXPECT_ANY },
+    { "am2301 jitter 10us", { .sensor_type = DHT_TYPE_AM2301, .host_tail_us = HOST_TAIL_US, .jitter_us = 10 }, EXPECT_ANY },
+    { "dht11 glitch 1%", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .glitch_permille = 10 }, EXPECT_ANY },
+    { "dht11 glitch 5%", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .glitch_permille = 50 }, EXPECT_ANY },
+    { "dht11 long cable", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .bit_low_us = 78, .jitter_us = 3 }, EXPECT_ANY },
+    { "dht11 -1 bit", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .drop_bits = 1 }, DHT_DECODE_ERR_TRUNCATED },
+    { "dht11 -2 bits", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .drop_bits = 2 }, DHT_DECODE_ERR_TRUNCATED },
+    { "am2301 -1 bit", { .sensor_type = DHT_TYPE_AM2301, .host_tail_us = HOST_TAIL_US, .drop_bits = 1 }, DHT_DECODE_ERR_TRUNCATED },
+    { "dht11 -8 bits", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .drop_bits = 8 }, DHT_DECODE_ERR_TRUNCATED },
+    { "dht11 -1 bit jitter", { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = HOST_TAIL_US, .drop_bits = 1, .jitter_us = 10 }, DHT_DECODE_ERR_TRUNCATED },
+};
+
+static dht_decode_status_t fuzz_decode(fuzz_backend_t backend, const fuzz_case_t *c,
+        const dht_pulse_t *pulses, size_t n, uint32_t *rng, uint8_t out[DHT_DECODE_DATA_BYTES])
+{
+    static uint32_t buf[DHT_WAVE_MAX_PULSES + 1];
+    dht_decoder_t dec;
+
+    if (backend == BACKEND_RMT)
+    {
+        size_t symbols = dht_wave_to_rmt(pulses, n, buf, DHT_WAVE_MAX_PULSES);
+        return dht_decode_rmt_symbols(&dec, c->cfg.sensor_type, buf, symbols, out);
+    }
+
+    // the edge backend starts recording at the release of the line
+    if (c->cfg.host_tail_us)
+    {
+        pulses++;
+        n--;
+    }
+    size_t edges = dht_wave_to_edges(pulses, n, dht_wave_rand(rng), buf, DHT_WAVE_MAX_PULSES + 1);
+    return dht_decode_edges(&dec, c->cfg.sensor_type, buf, edges, pulses[0].level, out);
+}
+
+static void fuzz_run(const fuzz_case_t *c, fuzz_backend_t backend, uint32_t frames, uint32_t seed,
+        fuzz_result_t *res)
+{
+    dht_pulse_t pulses[DHT_WAVE_MAX_PULSES];
+    uint32_t rng = seed;
+    uint8_t data[DHT_DECODE_DATA_BYTES], out[DHT_DECODE_DATA_BYTES];
+
+    memset(res, 0, sizeof(*res));
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        dht_wave_random_data(&rng, data);
+        size_t n = dht_wave_frame(&c->cfg, data, &rng, pulses, DHT_WAVE_MAX_PULSES);
+        dht_decode_status_t st = fuzz_decode(backend, c, pulses, n, &rng, out);
+        res->frames++;
+        res->status[st]++;
+        if (st == DHT_DECODE_OK && memcmp(data, out, sizeof(data)) != 0)
+            res->wrong++;
+    }
+}
+
+static bool fuzz_passed(const fuzz_case_t *c, const fuzz_result_t *res)
+{
+    if (c->expect == EXPECT_ANY)
+        return true;
+    // a frame that decodes OK must also carry the bytes that were sent
+    return res->status[c->expect] == res->frames && !res->wrong;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frames = 20000;
+    uint32_t seed = 0x2545F491;
+    bool check = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frames = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--check"))
+            check = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--frames N] [--seed S] [--check]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!seed)
+        seed = 1;
+
+    int failed = 0;
+    printf("%-20s %-6s %8s %8s %8s %8s %8s %8s %6s\n", "case", "format", "frames", "ok", "noresp", "trunc", "timing",
+            "csum", "wrong");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        for (int b = 0; b < BACKEND_MAX; b++)
+        {
+            fuzz_result_t res;
+            fuzz_run(&cases[i], b, frames, seed + (uint32_t)i, &res);
+            bool passed = fuzz_passed(&cases[i], &res);
+            printf("%-20s %-6s %8u %8u %8u %8u %8u %8u %6u%s\n", cases[i].name, backend_names[b], res.frames,
+                    res.status[DHT_DECODE_OK], res.status[DHT_DECODE_ERR_NO_RESPONSE], res.status[DHT_DECODE_ERR_TRUNCATED],
+                    res.status[DHT_DECODE_ERR_TIMING], res.status[DHT_DECODE_ERR_CHECKSUM], res.wrong,
+                    check && !passed ? "  FAIL" : "");
+            if (!passed)
+                failed++;
+        }
+    }
+
+    return check && failed ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file dht_wave.c
+ *
+ * Synthetic DHT waveforms for the host tests and benchmarks.
+ */
+#include "dht_wave.h"
+
+#define RMT_DURATION_MAX 0x7FFF
+#define RMT_LEVEL_SHIFT 15
+
+/*
+ * Datasheet values: DHT11 holds the line low 54 us before a bit and high
+ * 23-27 us for '0', 68-74 us for '1'. The AM2301 family uses 50, 26-28 and
+ * 70 us; the Si7021 module answers with the same frame.
+ */
+static const dht_wave_nominal_t nominals[] = {
+    [DHT_TYPE_DHT11] = {
+        .phase_b_us = 30,
+        .phase_c_us = 80,
+        .phase_d_us = 80,
+        .bit_low_us = 54,
+        .bit_zero_us = 24,
+        .bit_one_us = 71,
+    },
+    [DHT_TYPE_AM2301] = {
+        .phase_b_us = 30,
+        .phase_c_us = 80,
+        .phase_d_us = 80,
+        .bit_low_us = 50,
+        .bit_zero_us = 26,
+        .bit_one_us = 70,
+    },
+    [DHT_TYPE_SI7021] = {
+        .phase_b_us = 30,
+        .phase_c_us = 80,
+        .phase_d_us = 80,
+        .bit_low_us = 50,
+        .bit_zero_us = 26,
+        .bit_one_us = 70,
+    },
+};
+
+const dht_wave_nominal_t *dht_wave_get_nominal(dht_sensor_type_t sensor_type)
+{
+    if ((unsigned)sensor_type >= sizeof(nominals) / sizeof(nominals[0]))
+        return &nominals[DHT_TYPE_DHT11];
+    return &nominals[sensor_type];
+}
+
+uint32_t dht_wave_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+void dht_wave_random_data(uint32_t *rng, uint8_t data[DHT_DECODE_DATA_BYTES])
+{
+    uint32_t r = dht_wave_rand(rng);
+    data[0] = (uint8_t)r;
+    data[1] = (uint8_t)(r >> 8);
+    data[2] = (uint8_t)(r >> 16);
+    data[3] = (uint8_t)(r >> 24);
+    data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+}
+
+typedef struct
+{
+    const dht_wave_config_t *cfg;
+    uint32_t *rng;
+    dht_pulse_t *pulses;
+    size_t max;
+    size_t n;
+} dht_wave_builder_t;
+
+static void dht_wave_put(dht_wave_builder_t *b, int level, uint32_t duration)
+{
+    if (b->n < b->max)
+    {
+        b->pulses[b->n].level = level;
+        b->pulses[b->n].duration_us = duration;
+        b->n++;
+    }
+}
+
+/**
+ * Append one sensor driven pulse with jitter and maybe a glitch.
+ */
+static void dht_wave_pulse(dht_wave_builder_t *b, int level, uint32_t duration)
+{
+    uint32_t jitter = b->cfg->jitter_us;
+    if (jitter)
+    {
+        int32_t d = (int32_t)duration + (int32_t)(dht_wave_rand(b->rng) % (2 * jitter + 1)) - (int32_t)jitter;
+        duration = d < 1 ? 1 : (uint32_t)d;
+    }
+
+    if (b->cfg->glitch_permille && duration >= 8
+            && dht_wave_rand(b->rng) % 1000 < b->cfg->glitch_permille)
+    {
+        uint32_t width = 1 + dht_wave_rand(b->rng) % 3;
+        uint32_t at = 2 + dht_wave_rand(b->rng) % (duration - width - 3);
+        dht_wave_put(b, level, at);
+        dht_wave_put(b, !level, width);
+        dht_wave_put(b, level, duration - at - width);
+        return;
+    }
+
+    dht_wave_put(b, level, duration);
+}
+
+size_t dht_wave_frame(const dht_wave_config_t *cfg, const uint8_t data[DHT_DECODE_DATA_BYTES],
+        uint32_t *rng, dht_pulse_t *pulses, size_t max_pulses)
+{
+    const dht_wave_nominal_t *nom = dht_wave_get_nominal(cfg->sensor_type);
+    dht_wave_builder_t b = { .cfg = cfg, .rng = rng, .pulses = pulses, .max = max_pulses };
+    uint32_t bit_low = cfg->bit_low_us ? cfg->bit_low_us : nom->bit_low_us;
+    int bits = DHT_DECODE_DATA_BITS - (cfg->drop_bits < DHT_DECODE_DATA_BITS ? cfg->drop_bits : DHT_DECODE_DATA_BITS);
+
+    if (cfg->host_tail_us)
+        dht_wave_put(&b, 0, cfg->host_tail_us);
+    dht_wave_pulse(&b, 1, nom->phase_b_us);
+    dht_wave_pulse(&b, 0, nom->phase_c_us);
+    dht_wave_pulse(&b, 1, nom->phase_d_us);
+
+    for (int i = 0; i < bits; i++)
+    {
+        int bit = (data[i / 8] >> (7 - i % 8)) & 1;
+        dht_wave_pulse(&b, 0, bit_low);
+        dht_wave_pulse(&b, 1, bit ? nom->bit_one_us : nom->bit_zero_us);
+    }
+    // the sensor pulls the line low once more before releasing it
+    dht_wave_pulse(&b, 0, bit_low);
+
+    return b.n;
+}
+
+size_t dht_wave_to_edges(const dht_pulse_t *pulses, size_t n, uint32_t start_us,
+        uint32_t *edges_us, size_t max_edges)
+{
+    size_t count = 0;
+    uint32_t t = start_us;
+
+    if (!n || !max_edges)
+        return 0;
+    edges_us[count++] = t;
+    for (size_t i = 0; i < n && count < max_edges; i++)
+    {
+        // unsigned overflow wraps like the hardware counter
+        t += pulses[i].duration_us;
+        edges_us[count++] = t;
+    }
+    return count;
+}
+
+size_t dht_wave_to_rmt(const dht_pulse_t *pulses, size_t n, uint32_t *symbols, size_t max_symbols)
+{
+    size_t halves = 0;
+
+    for (size_t i = 0; i <= n; i++)
+    {
+        // past the last pulse the line idles high, recorded with a zero duration
+        int level = i < n ? pulses[i].level : 1;
+        uint32_t remaining = i < n ? pulses[i].duration_us : 0;
+
+        do
+        {
+            uint32_t d = remaining > RMT_DURATION_MAX ? RMT_DURATION_MAX : remaining;
+            uint32_t half = d | ((uint32_t)level << RMT_LEVEL_SHIFT);
+            size_t s = halves / 2;
+            if (s >= max_symbols)
+                return max_symbols;
+            if (halves % 2 == 0)
+                symbols[s] = half;
+            else
+                symbols[s] |= half << 16;
+            halves++;
+            remaining -= d;
+        } while (remaining);
+    }
+
+    // an odd number of halves leaves duration1 at 0, which also ends the frame
+    return (halves + 1) / 2;
+}
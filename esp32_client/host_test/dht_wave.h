@@ -0,0 +1,108 @@
+/**
+ * @file dht_wave.h
+ *
+ * Synthetic DHT waveforms for the host tests and benchmarks.
+ *
+ * A frame is generated as a list of (level, duration) pulses the way the line
+ * looks from the release of the start pulse on: phase 'B', the 80/80 us
+ * response (phases 'C' and 'D'), 40 data bits and the final low pulse. It can
+ * be perturbed with jitter, glitches and missing bits, then turned into the
+ * edge timestamps or RMT symbol words the capture backends record.
+ */
+#ifndef __DHT_WAVE_H__
+#define __DHT_WAVE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dht_decode.h"
+
+// Enough for a frame with a glitch in every pulse
+#define DHT_WAVE_MAX_PULSES 512
+
+typedef struct
+{
+    uint8_t level;
+    uint32_t duration_us;
+} dht_pulse_t;
+
+/**
+ * Nominal pulse lengths of a sensor, see dht_wave_get_nominal()
+ */
+typedef struct
+{
+    uint32_t phase_b_us;
+    uint32_t phase_c_us;
+    uint32_t phase_d_us;
+    uint32_t bit_low_us;
+    uint32_t bit_zero_us;
+    uint32_t bit_one_us;
+} dht_wave_nominal_t;
+
+/**
+ * How to distort a frame
+ */
+typedef struct
+{
+    dht_sensor_type_t sensor_type;
+    uint32_t host_tail_us;      //!< Low pulse before the release, as an RMT capture sees it, 0 for none
+    uint32_t jitter_us;         //!< Every pulse is moved by up to +-jitter_us, uniformly
+    uint32_t bit_low_us;        //!< Overrides the nominal low pulse before each bit, 0 to keep it
+    uint16_t glitch_permille;   //!< Chance per pulse of a 1-3 us spike of the other level inside it
+    uint8_t drop_bits;          //!< Data bits missing at the end of the frame
+} dht_wave_config_t;
+
+/**
+ * @brief Get the nominal datasheet timings of a sensor type
+ */
+const dht_wave_nominal_t *dht_wave_get_nominal(dht_sensor_type_t sensor_type);
+
+/**
+ * @brief xorshift32, deterministic for a given seed
+ *
+ * @param state Generator state, must not be 0
+ */
+uint32_t dht_wave_rand(uint32_t *state);
+
+/**
+ * @brief Fill a frame with random humidity and temperature and a valid checksum
+ */
+void dht_wave_random_data(uint32_t *rng, uint8_t data[DHT_DECODE_DATA_BYTES]);
+
+/**
+ * @brief Generate the pulse train of a frame
+ *
+ * @param cfg Distortions to apply
+ * @param data Frame bytes to encode
+ * @param rng Generator state for jitter and glitches
+ * @param[out] pulses Pulse train, first pulse is the host tail or phase 'B'
+ * @param max_pulses Size of `pulses`
+ * @return Number of pulses written
+ */
+size_t dht_wave_frame(const dht_wave_config_t *cfg, const uint8_t data[DHT_DECODE_DATA_BYTES],
+        uint32_t *rng, dht_pulse_t *pulses, size_t max_pulses);
+
+/**
+ * @brief Turn a pulse train into edge timestamps
+ *
+ * The first timestamp is the start of the first pulse, the last one the end
+ * of the last pulse, so `n` pulses give `n + 1` edges.
+ *
+ * @param start_us Timestamp of the first edge, may be close to the wrap of the counter
+ * @return Number of edges written
+ */
+size_t dht_wave_to_edges(const dht_pulse_t *pulses, size_t n, uint32_t start_us,
+        uint32_t *edges_us, size_t max_edges);
+
+/**
+ * @brief Turn a pulse train into raw RMT receive words
+ *
+ * Pulses longer than the 15 bit duration field are split over several
+ * halves of the same level. The line idling after the last pulse ends the
+ * buffer with a zero duration, like the RMT idle threshold does.
+ *
+ * @return Number of words written
+ */
+size_t dht_wave_to_rmt(const dht_pulse_t *pulses, size_t n, uint32_t *symbols, size_t max_symbols);
+
+#endif  // __DHT_WAVE_H__
@@ -0,0 +1,110 @@
+/**
+ * @file esp_host.c
+ *
+ * Host implementations of the ESP-IDF functions declared in stubs/.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    static int msg_id;
+    (void)client;
+    (void)topic;
+    (void)qos;
+    return ++msg_id;
+}
+
+#define HOST_PARTITION_MAX 4
+#define HOST_SECTOR_SIZE 4096
+
+static struct {
+    esp_partition_t partition;
+    uint8_t *data;
+} partitions[HOST_PARTITION_MAX];
+
+const esp_partition_t *esp_host_partition_create(const char *label, uint32_t size)
+{
+    if (size == 0 || size % HOST_SECTOR_SIZE != 0)
+        return NULL;
+    for (int i = 0; i < HOST_PARTITION_MAX; i++) {
+        if (partitions[i].data == NULL) {
+            partitions[i].data = malloc(size);
+            if (partitions[i].data == NULL)
+                return NULL;
+            memset(partitions[i].data, 0xFF, size);
+            partitions[i].partition = (esp_partition_t){
+                .type = ESP_PARTITION_TYPE_DATA, .subtype = ESP_PARTITION_SUBTYPE_ANY,
+                .size = size, .erase_size = HOST_SECTOR_SIZE,
+            };
+            strncpy(partitions[i].partition.label, label, sizeof(partitions[i].partition.label) - 1);
+            return &partitions[i].partition;
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    for (int i = 0; i < HOST_PARTITION_MAX; i++) {
+        const esp_partition_t *p = &partitions[i].partition;
+        if (partitions[i].data != NULL && p->type == type
+                && (subtype == ESP_PARTITION_SUBTYPE_ANY || p->subtype == subtype)
+                && (label == NULL || strcmp(p->label, label) == 0))
+            return p;
+    }
+    return NULL;
+}
+
+static uint8_t *partition_data(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    for (int i = 0; i < HOST_PARTITION_MAX; i++) {
+        if (&partitions[i].partition == partition)
+            return offset + size <= partition->size ? partitions[i].data + offset : NULL;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    uint8_t *data = partition_data(partition, src_offset, size);
+    if (data == NULL)
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, data, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    uint8_t *data = partition_data(partition, dst_offset, size);
+    if (data == NULL)
+        return ESP_ERR_INVALID_SIZE;
+    // NOR flash: programming only clears bits
+    for (size_t i = 0; i < size; i++)
+        data[i] &= ((const uint8_t *)src)[i];
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (offset % HOST_SECTOR_SIZE != 0 || size % HOST_SECTOR_SIZE != 0)
+        return ESP_ERR_INVALID_ARG;
+    uint8_t *data = partition_data(partition, offset, size);
+    if (data == NULL)
+        return ESP_ERR_INVALID_SIZE;
+    memset(data, 0xFF, size);
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+/**
+ * @file esp_log.h
+ *
+ * Host stand-in for the ESP-IDF header. Logging is compiled out, the
+ * arguments are still type checked against the format.
+ */
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+__attribute__((format(printf, 2, 3)))
+static inline void esp_log_host(const char *tag, const char *format, ...)
+{
+    (void)tag;
+    (void)format;
+}
+
+#define ESP_LOGE(tag, format, ...) esp_log_host(tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) esp_log_host(tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) esp_log_host(tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) esp_log_host(tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) esp_log_host(tag, format, ##__VA_ARGS__)
+
+#endif // ESP_LOG_H
@@ -0,0 +1,46 @@
+/**
+ * @file esp_partition.h
+ *
+ * Host stand-in for the ESP-IDF header, see esp_host.c. Partitions are RAM
+ * buffers that behave like NOR flash: writes only clear bits and erases
+ * work on whole 4 KB sectors.
+ */
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+/**
+ * @brief Host only: adds an erased data partition esp_partition_find_first()
+ * returns by label. size is a multiple of the 4 KB sector.
+ */
+const esp_partition_t *esp_host_partition_create(const char *label, uint32_t size);
+
+#endif // ESP_PARTITION_H
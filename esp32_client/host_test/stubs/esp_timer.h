@@ -0,0 +1,16 @@
+/**
+ * @file esp_timer.h
+ *
+ * Host stand-in for the ESP-IDF header, see esp_host.c.
+ */
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Microseconds of CLOCK_MONOTONIC.
+ */
+int64_t esp_timer_get_time(void);
+
+#endif // ESP_TIMER_H
@@ -0,0 +1,18 @@
+/**
+ * @file FreeRTOS.h
+ *
+ * Host stand-in for the FreeRTOS header. The host tests run on one thread,
+ * so critical sections compile to nothing.
+ */
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif // FREERTOS_H
@@ -0,0 +1,16 @@
+/**
+ * @file mqtt_client.h
+ *
+ * Host stand-in for the esp-mqtt header, see esp_host.c.
+ */
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+/**
+ * @brief Counts the call and returns its number as the message id.
+ */
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+
+#endif // MQTT_CLIENT_H
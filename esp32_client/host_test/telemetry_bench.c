@@ -0,0 +1,100 @@
+/**
+ * @file telemetry_bench.c
+ *
+ * Size and cost of one telemetry record per encoding, on the host.
+ *
+ *     telemetry_bench [--iterations N]
+ *
+ * Host numbers only rank the encodings against each other; the ESP32 at
+ * 240 MHz is roughly an order of magnitude slower per record. The MQTT
+ * packet adds the fixed header and the topic, devices/<id>/telemetry[/bin].
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+
+// A 12-digit device id, the station MAC
+#define BENCH_TOPIC_TEXT "devices/a0b1c2d3e4f5/telemetry"
+#define BENCH_TOPIC_BIN "devices/a0b1c2d3e4f5/telemetry/bin"
+
+static volatile unsigned sink;
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_report(const char *name, double start_ns, uint32_t iterations)
+{
+    double per_record = (bench_now_ns() - start_ns) / iterations;
+    printf("  %-14s %8.1f ns/record\n", name, per_record);
+}
+
+// QoS 0 PUBLISH: fixed header, topic length, topic, payload
+static int bench_packet_len(const char *topic, int payload_len)
+{
+    int remaining = 2 + (int)strlen(topic) + payload_len;
+    return 1 + (remaining < 128 ? 1 : 2) + remaining;
+}
+
+static void bench_record(const telemetry_record_t *rec, uint32_t iterations)
+{
+    char text[512];
+    uint8_t bin[TELEMETRY_BIN_MAX_LEN];
+    telemetry_record_t out;
+    double start;
+
+    int text_len = telemetry_format_record(text, sizeof(text), rec);
+    int bin_len = telemetry_encode_record(bin, sizeof(bin), rec);
+    printf("%u sensor(s): payload text %d bytes, binary %d bytes; packet %d vs %d bytes\n",
+           rec->sensor_count, text_len, bin_len,
+           bench_packet_len(BENCH_TOPIC_TEXT, text_len), bench_packet_len(BENCH_TOPIC_BIN, bin_len));
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += telemetry_format_record(text, sizeof(text), rec);
+    bench_report("text encode", start, iterations);
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+        sink += telemetry_encode_record(bin, sizeof(bin), rec);
+    bench_report("binary encode", start, iterations);
+
+    start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        bin[1] = (uint8_t)i;
+        sink += telemetry_decode_record(bin, (size_t)bin_len, &out) + out.seq;
+    }
+    bench_report("binary decode", start, iterations);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = 1000000;
+    if (argc == 3 && !strcmp(argv[1], "--iterations"))
+        iterations = strtoul(argv[2], NULL, 0);
+    else if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+        return 2;
+    }
+
+    telemetry_record_t rec = {
+        .seq = 1234, .timestamp_ms = 3600000, .fan_on = true, .fan_duty = 80, .sensor_count = 1,
+    };
+    for (int i = 0; i < TELEMETRY_MAX_SENSORS; i++)
+        rec.sensors[i] = (telemetry_sensor_t){
+            .valid = true, .temperature = (int16_t)(244 - 130 * i), .humidity = 451,
+            .temperature_raw = (int16_t)(245 - 130 * i), .humidity_raw = 440,
+        };
+
+    bench_record(&rec, iterations);
+    rec.sensor_count = TELEMETRY_MAX_SENSORS;
+    bench_record(&rec, iterations);
+    return 0;
+}
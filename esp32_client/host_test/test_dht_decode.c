@@ -0,0 +1,181 @@
+/**
+ * @file test_dht_decode.c
+ *
+ * Decoder tests on RMT symbol buffers and edge lists as the capture
+ * backends hand them over.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "dht_decode.h"
+#include "dht_wave.h"
+
+static int failures;
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static const uint8_t dht11_frame[DHT_DECODE_DATA_BYTES] = { 45, 0, 23, 0, 68 };
+// 65.2 %, -10.1 C
+static const uint8_t am2301_frame[DHT_DECODE_DATA_BYTES] = { 0x02, 0x8C, 0x80, 0x65, 0x73 };
+
+static size_t make_rmt(const dht_wave_config_t *cfg, const uint8_t data[DHT_DECODE_DATA_BYTES],
+        uint32_t *symbols, size_t max_symbols)
+{
+    dht_pulse_t pulses[DHT_WAVE_MAX_PULSES];
+    uint32_t rng = 1;
+    size_t n = dht_wave_frame(cfg, data, &rng, pulses, DHT_WAVE_MAX_PULSES);
+    return dht_wave_to_rmt(pulses, n, symbols, max_symbols);
+}
+
+static void test_rmt_nominal(void)
+{
+    uint32_t symbols[64];
+    uint8_t out[DHT_DECODE_DATA_BYTES];
+    dht_decoder_t dec;
+
+    dht_wave_config_t cfg = { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = 40 };
+    size_t n = make_rmt(&cfg, dht11_frame, symbols, 64);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_DHT11, symbols, n, out) == DHT_DECODE_OK);
+    EXPECT(memcmp(out, dht11_frame, sizeof(out)) == 0);
+    EXPECT(dht_decode_convert(DHT_TYPE_DHT11, out[0], out[1]) == 450);
+    EXPECT(dht_decode_convert(DHT_TYPE_DHT11, out[2], out[3]) == 230);
+
+    cfg.sensor_type = DHT_TYPE_AM2301;
+    n = make_rmt(&cfg, am2301_frame, symbols, 64);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, n, out) == DHT_DECODE_OK);
+    EXPECT(memcmp(out, am2301_frame, sizeof(out)) == 0);
+    EXPECT(dht_decode_convert(DHT_TYPE_AM2301, out[0], out[1]) == 652);
+    EXPECT(dht_decode_convert(DHT_TYPE_AM2301, out[2], out[3]) == -101);
+
+    // the decoder keeps the data pulses for the histograms
+    uint16_t low_us[DHT_DECODE_DATA_BITS], high_us[DHT_DECODE_DATA_BITS];
+    EXPECT(dht_decoder_get_pulses(&dec, low_us, high_us) == DHT_DECODE_DATA_BITS);
+    EXPECT(low_us[0] == 50 && high_us[0] == 26);    // first bit of 0x02 is 0
+    EXPECT(high_us[6] == 70);                       // 7th bit of 0x02 is 1
+}
+
+static void test_rmt_sensor_timings(void)
+{
+    uint32_t symbols[64];
+    uint8_t out[DHT_DECODE_DATA_BYTES];
+    const uint8_t zeros[DHT_DECODE_DATA_BYTES] = { 0 };
+    dht_decoder_t dec;
+
+    // a 77 us bit low is inside the DHT11 limits but not the AM2301 ones
+    dht_wave_config_t cfg = { .sensor_type = DHT_TYPE_DHT11, .bit_low_us = 77 };
+    size_t n = make_rmt(&cfg, zeros, symbols, 64);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_DHT11, symbols, n, out) == DHT_DECODE_OK);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, n, out) == DHT_DECODE_ERR_TIMING);
+
+    // DHT11 datasheet pulses also fit the AM2301 limits
+    cfg.bit_low_us = 0;
+    n = make_rmt(&cfg, dht11_frame, symbols, 64);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, n, out) == DHT_DECODE_OK);
+}
+
+static void test_rmt_idle_and_wrap(void)
+{
+    uint32_t symbols[80];
+    uint8_t out[DHT_DECODE_DATA_BYTES];
+    dht_decoder_t dec;
+
+    // without the host tail the idle marker lands in duration0 of the last word
+    dht_wave_config_t cfg = { .sensor_type = DHT_TYPE_AM2301 };
+    size_t n = make_rmt(&cfg, am2301_frame, symbols, 80);
+    EXPECT((symbols[n - 1] & 0x7FFF) == 0);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, n, out) == DHT_DECODE_OK);
+
+    // with it the marker is in duration1
+    cfg.host_tail_us = 40;
+    n = make_rmt(&cfg, am2301_frame, symbols, 80);
+    EXPECT((symbols[n - 1] & 0x7FFF) != 0 && ((symbols[n - 1] >> 16) & 0x7FFF) == 0);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, n, out) == DHT_DECODE_OK);
+
+    // words after the idle marker are stale buffer contents
+    for (size_t i = n; i < 80; i++)
+        symbols[i] = 0x80328032;
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, 80, out) == DHT_DECODE_OK);
+    EXPECT(memcmp(out, am2301_frame, sizeof(out)) == 0);
+
+    // a pulse above the 15 bit duration field spans several halves
+    cfg.host_tail_us = 40000;
+    n = make_rmt(&cfg, am2301_frame, symbols, 80);
+    EXPECT((symbols[0] & 0x7FFF) == 0x7FFF);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, n, out) == DHT_DECODE_OK);
+
+    // the buffer filled up before the idle marker
+    cfg.host_tail_us = 0;
+    n = make_rmt(&cfg, am2301_frame, symbols, 30);
+    EXPECT(n == 30);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, n, out) == DHT_DECODE_ERR_TRUNCATED);
+
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_AM2301, symbols, 0, out) == DHT_DECODE_ERR_NO_RESPONSE);
+}
+
+static void test_rmt_response_anchor(void)
+{
+    dht_pulse_t pulses[DHT_WAVE_MAX_PULSES];
+    uint32_t symbols[64];
+    uint8_t out[DHT_DECODE_DATA_BYTES];
+    uint32_t rng = 1;
+    dht_decoder_t dec;
+
+    // one bit short: the start sequence must not make up for it
+    dht_wave_config_t cfg = { .sensor_type = DHT_TYPE_DHT11, .host_tail_us = 40, .drop_bits = 1 };
+    size_t n = make_rmt(&cfg, dht11_frame, symbols, 64);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_DHT11, symbols, n, out) == DHT_DECODE_ERR_TRUNCATED);
+    EXPECT(dec.count == DHT_DECODE_DATA_BITS - 1);
+
+    // a capture that starts after the response
+    cfg.drop_bits = 0;
+    n = dht_wave_frame(&cfg, dht11_frame, &rng, pulses, DHT_WAVE_MAX_PULSES);
+    n = dht_wave_to_rmt(pulses + 4, n - 4, symbols, 64);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_DHT11, symbols, n, out) == DHT_DECODE_ERR_NO_RESPONSE);
+
+    // a glitch splitting the first data low adds a bit instead of shifting the frame
+    n = dht_wave_frame(&cfg, dht11_frame, &rng, pulses, DHT_WAVE_MAX_PULSES);
+    dht_pulse_t glitched[DHT_WAVE_MAX_PULSES];
+    memcpy(glitched, pulses, 5 * sizeof(pulses[0]));
+    glitched[4].duration_us = 30;
+    glitched[5] = (dht_pulse_t){ 1, 2 };
+    glitched[6] = (dht_pulse_t){ 0, pulses[4].duration_us - 32 };
+    memcpy(glitched + 7, pulses + 5, (n - 5) * sizeof(pulses[0]));
+    n = dht_wave_to_rmt(glitched, n + 2, symbols, 64);
+    EXPECT(dht_decode_rmt_symbols(&dec, DHT_TYPE_DHT11, symbols, n, out) == DHT_DECODE_ERR_TIMING);
+    EXPECT(dec.count == DHT_DECODE_DATA_BITS + 1);
+}
+
+static void test_edges_counter_wrap(void)
+{
+    dht_pulse_t pulses[DHT_WAVE_MAX_PULSES];
+    uint32_t edges[DHT_WAVE_MAX_PULSES + 1];
+    uint8_t out[DHT_DECODE_DATA_BYTES];
+    uint32_t rng = 1;
+    dht_decoder_t dec;
+
+    dht_wave_config_t cfg = { .sensor_type = DHT_TYPE_DHT11 };
+    size_t n = dht_wave_frame(&cfg, dht11_frame, &rng, pulses, DHT_WAVE_MAX_PULSES);
+    // the microsecond counter wraps in the middle of the frame
+    size_t num_edges = dht_wave_to_edges(pulses, n, UINT32_MAX - 1000, edges, DHT_WAVE_MAX_PULSES + 1);
+    EXPECT(edges[num_edges - 1] < edges[0]);
+    EXPECT(dht_decode_edges(&dec, DHT_TYPE_DHT11, edges, num_edges, 1, out) == DHT_DECODE_OK);
+    EXPECT(memcmp(out, dht11_frame, sizeof(out)) == 0);
+}
+
+int main(void)
+{
+    test_rmt_nominal();
+    test_rmt_sensor_timings();
+    test_rmt_idle_and_wrap();
+    test_rmt_response_anchor();
+    test_edges_counter_wrap();
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file test_mqtt_router.c
+ *
+ * Topic matching, payload parsing and fragment reassembly of mqtt_router.
+ * The route table is global, so every test registers its own topics.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "mqtt_router.h"
+
+static int failures;
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static int calls;
+static mqtt_route_msg_t last;
+static char last_data[MQTT_ROUTER_ARENA_SIZE];
+static char last_cid[MQTT_ROUTER_MAX_CID_LEN + 1];
+
+static void record_handler(const mqtt_route_msg_t *msg, void *arg)
+{
+    (void)arg;
+    calls++;
+    last = *msg;
+    memcpy(last_data, msg->data, msg->data_len);
+    last_cid[0] = '\0';
+    if (msg->cid)
+    {
+        memcpy(last_cid, msg->cid, msg->cid_len);
+        last_cid[msg->cid_len] = '\0';
+    }
+}
+
+static int dispatch(const char *topic, const char *data)
+{
+    calls = 0;
+    return mqtt_router_dispatch(topic, (int)strlen(topic), data, (int)strlen(data));
+}
+
+static bool matches(const char *filter, const char *topic)
+{
+    return mqtt_topic_matches(filter, topic, (int)strlen(topic));
+}
+
+static void test_topic_matches(void)
+{
+    EXPECT(matches("a/+/c", "a/b/c"));
+    EXPECT(matches("a/#", "a"));
+    EXPECT(matches("a/#", "a/b/c"));
+    EXPECT(matches("#", "x/y"));
+    EXPECT(matches("a/+", "a/"));
+    EXPECT(!matches("a/b", "a/bc"));
+    EXPECT(!matches("a/+/c", "a/b/d"));
+    EXPECT(!matches("+/x", "$SYS/x"));
+    EXPECT(!matches("#", "$SYS/x"));
+}
+
+static void test_payloads(void)
+{
+    mqtt_router_register("test/int", 0, MQTT_PAYLOAD_INT, record_handler, NULL);
+    mqtt_router_register("test/onoff", 0, MQTT_PAYLOAD_ON_OFF, record_handler, NULL);
+    mqtt_router_register("test/raw/+", 0, MQTT_PAYLOAD_RAW, record_handler, NULL);
+
+    EXPECT(dispatch("test/int", "-42") == 1 && last.value == -42);
+    EXPECT(dispatch("test/int", "4x") == 0 && calls == 0);
+    EXPECT(dispatch("test/int", "2147483648") == 0);
+    EXPECT(dispatch("test/onoff", "OFF") == 1 && last.value == 0);
+    EXPECT(dispatch("test/onoff", "1") == 1 && last.value == 1);
+    EXPECT(dispatch("test/raw/x", "anything") == 1 && last.data_len == 8);
+    EXPECT(dispatch("test/other", "1") == 0);
+
+    // parsed payloads carry a correlation id, raw ones are left alone
+    EXPECT(dispatch("test/int", "40;cid=a1-b2") == 1 && last.value == 40);
+    EXPECT(strcmp(last_cid, "a1-b2") == 0);
+    EXPECT(dispatch("test/raw/x", "40;cid=a1") == 1 && last.cid == NULL && last.data_len == 9);
+    // ids are echoed unescaped, so quotes and the like are refused
+    EXPECT(dispatch("test/int", "40;cid=a\"}") == 0);
+    EXPECT(dispatch("test/int", "40;cid=a/b") == 0);
+    EXPECT(dispatch("test/int", "40;cid=") == 0);
+    EXPECT(dispatch("test/int", "40;cid=0123456789abcdef0123456789abcdef") == 1);
+    EXPECT(dispatch("test/int", "40;cid=0123456789abcdef0123456789abcdef0") == 0);
+}
+
+static void test_fragments(void)
+{
+    char msg[MQTT_ROUTER_DEFAULT_MAX_LEN];
+    mqtt_router_stats_t before, after;
+    const mqtt_route_config_t big = {
+        .filter = "test/big",
+        .payload = MQTT_PAYLOAD_RAW,
+        .max_len = sizeof(msg),
+        .handler = record_handler,
+    };
+    EXPECT(mqtt_router_add(&big) == ESP_OK);
+    for (size_t i = 0; i < sizeof(msg); i++)
+        msg[i] = (char)('a' + i % 26);
+
+    mqtt_router_get_stats(&before);
+    calls = 0;
+    EXPECT(mqtt_router_dispatch_fragment("test/big", 8, msg, 100, 0, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 100, 100, 100, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 200, sizeof(msg) - 200, 200, sizeof(msg)) == 1);
+    EXPECT(calls == 1 && last.data_len == (int)sizeof(msg) && memcmp(last_data, msg, sizeof(msg)) == 0);
+    mqtt_router_get_stats(&after);
+    EXPECT(after.reassembled == before.reassembled + 1);
+
+    // a missing fragment drops the message
+    calls = 0;
+    EXPECT(mqtt_router_dispatch_fragment("test/big", 8, msg, 100, 0, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 200, sizeof(msg) - 200, 200, sizeof(msg)) == 0);
+    EXPECT(calls == 0);
+
+    // a missing fragment drops the message once, however many follow
+    mqtt_router_get_stats(&before);
+    EXPECT(mqtt_router_dispatch_fragment("test/big", 8, msg, 50, 0, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 100, 50, 100, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 150, 50, 150, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 200, sizeof(msg) - 200, 200, sizeof(msg)) == 0);
+    mqtt_router_get_stats(&after);
+    EXPECT(after.dropped_sequence == before.dropped_sequence + 1);
+
+    // above max_len: dropped at the start, the later fragments aren't sequence errors
+    mqtt_router_get_stats(&before);
+    EXPECT(mqtt_router_dispatch_fragment("test/big", 8, msg, 100, 0, sizeof(msg) + 1) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 100, 100, 100, sizeof(msg) + 1) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg, 57, 200, sizeof(msg) + 1) == 0);
+    mqtt_router_get_stats(&after);
+    EXPECT(after.dropped_oversize == before.dropped_oversize + 1);
+    EXPECT(after.dropped_sequence == before.dropped_sequence);
+
+    // unhandled topics aren't sequence errors either
+    EXPECT(mqtt_router_dispatch_fragment("test/none", 9, msg, 100, 0, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 100, 100, 100, sizeof(msg)) == 0);
+    mqtt_router_get_stats(&after);
+    EXPECT(after.dropped_sequence == before.dropped_sequence);
+
+    // nor is the end of a message whose start was never seen, past the first fragment
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 100, 100, 100, sizeof(msg)) == 0);
+    EXPECT(mqtt_router_dispatch_fragment(NULL, 0, msg + 200, 56, 200, sizeof(msg)) == 0);
+    mqtt_router_get_stats(&after);
+    EXPECT(after.dropped_sequence == before.dropped_sequence + 1);
+}
+
+int main(void)
+{
+    test_topic_matches();
+    test_payloads();
+    test_fragments();
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
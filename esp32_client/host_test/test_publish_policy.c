@@ -0,0 +1,192 @@
+/**
+ * @file test_publish_policy.c
+ *
+ * Publish decisions and command parsing of publish_policy. The policy is
+ * global, every test starts with publish_policy_init().
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "publish_policy.h"
+
+static int failures;
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static const publish_policy_config_t base = {
+    .deadband = {
+        [PUBLISH_METRIC_TEMPERATURE] = { .abs = 5, .jump = 40 },
+        [PUBLISH_METRIC_HUMIDITY] = { .abs = 20 },
+    },
+    .min_interval_ms = 30000,
+    .heartbeat_ms = 300000,
+};
+
+static telemetry_record_t record(int16_t temperature, int16_t humidity)
+{
+    telemetry_record_t rec = { .sensor_count = 1 };
+    rec.sensors[0] = (telemetry_sensor_t){ .valid = true, .temperature = temperature, .humidity = humidity };
+    return rec;
+}
+
+static publish_reason_t check(int16_t temperature, int16_t humidity, uint32_t now_ms)
+{
+    telemetry_record_t rec = record(temperature, humidity);
+    return publish_policy_check(&rec, now_ms);
+}
+
+static void test_deadband(void)
+{
+    publish_policy_config_t cfg = base;
+
+    cfg.deadband[PUBLISH_METRIC_TEMPERATURE].rel_permille = 100;
+    cfg.deadband[PUBLISH_METRIC_TEMPERATURE].jump = 0;
+    publish_policy_init(&cfg);
+
+    // small reference: temp_abs (0.5) is the larger threshold
+    EXPECT(check(20, 500, 0) == PUBLISH_REASON_FIRST);
+    EXPECT(check(24, 500, 60000) == PUBLISH_REASON_NONE);
+    EXPECT(check(15, 500, 60000) == PUBLISH_REASON_DEADBAND);
+
+    // large reference: 10% of 30.0 is 3.0, larger than temp_abs
+    EXPECT(check(300, 500, 120000) == PUBLISH_REASON_DEADBAND);
+    EXPECT(check(329, 500, 180000) == PUBLISH_REASON_NONE);
+    EXPECT(check(271, 500, 180000) == PUBLISH_REASON_NONE);
+    EXPECT(check(330, 500, 180000) == PUBLISH_REASON_DEADBAND);
+
+    // the reference is the last published record, not the last sample
+    EXPECT(check(349, 500, 240000) == PUBLISH_REASON_NONE);
+    EXPECT(check(359, 500, 240000) == PUBLISH_REASON_NONE);
+    EXPECT(check(363, 500, 240000) == PUBLISH_REASON_DEADBAND);
+
+    // humidity has no relative threshold
+    EXPECT(check(363, 519, 300000) == PUBLISH_REASON_NONE);
+    EXPECT(check(363, 520, 300000) == PUBLISH_REASON_DEADBAND);
+}
+
+static void test_rate_limit(void)
+{
+    publish_policy_init(&base);
+
+    EXPECT(check(200, 500, 0) == PUBLISH_REASON_FIRST);
+    EXPECT(check(210, 500, 40000) == PUBLISH_REASON_DEADBAND);
+    // inside min_interval_ms a deadband change waits, a jump doesn't
+    EXPECT(check(220, 500, 50000) == PUBLISH_REASON_NONE);
+    EXPECT(check(250, 500, 55000) == PUBLISH_REASON_JUMP);
+    EXPECT(check(240, 500, 60000) == PUBLISH_REASON_NONE);
+    // a jump doesn't restart min_interval_ms, the last deadband publish does
+    EXPECT(check(240, 500, 70000) == PUBLISH_REASON_DEADBAND);
+    // and a change in the other direction is a jump as well
+    EXPECT(check(199, 500, 71000) == PUBLISH_REASON_JUMP);
+}
+
+static void test_heartbeat(void)
+{
+    publish_policy_init(&base);
+
+    EXPECT(check(200, 500, 1000) == PUBLISH_REASON_FIRST);
+    EXPECT(check(201, 500, 1000 + base.heartbeat_ms - 1) == PUBLISH_REASON_NONE);
+    EXPECT(check(201, 500, 1000 + base.heartbeat_ms) == PUBLISH_REASON_HEARTBEAT);
+    EXPECT(check(201, 500, 1000 + 2 * base.heartbeat_ms - 1) == PUBLISH_REASON_NONE);
+    EXPECT(check(201, 500, 1000 + 2 * base.heartbeat_ms) == PUBLISH_REASON_HEARTBEAT);
+
+    // monotonic time wraps after ~49 days
+    publish_policy_init(&base);
+    EXPECT(check(200, 500, UINT32_MAX - 1000) == PUBLISH_REASON_FIRST);
+    EXPECT(check(200, 500, base.heartbeat_ms - 1002) == PUBLISH_REASON_NONE);
+    EXPECT(check(200, 500, base.heartbeat_ms - 1001) == PUBLISH_REASON_HEARTBEAT);
+}
+
+static void test_state(void)
+{
+    telemetry_record_t rec = record(200, 500);
+
+    publish_policy_init(&base);
+    EXPECT(publish_policy_check(&rec, 0) == PUBLISH_REASON_FIRST);
+
+    // state changes go out at once, even inside min_interval_ms
+    rec.fan_on = true;
+    rec.fan_duty = 80;
+    EXPECT(publish_policy_check(&rec, 1000) == PUBLISH_REASON_STATE);
+    EXPECT(publish_policy_check(&rec, 2000) == PUBLISH_REASON_NONE);
+    rec.fan_duty = 60;
+    EXPECT(publish_policy_check(&rec, 3000) == PUBLISH_REASON_STATE);
+    rec.sensors[0].valid = false;
+    EXPECT(publish_policy_check(&rec, 4000) == PUBLISH_REASON_STATE);
+    // a failed sensor's values aren't compared
+    rec.sensors[0].temperature = 900;
+    EXPECT(publish_policy_check(&rec, 5000) == PUBLISH_REASON_NONE);
+    rec.sensors[0].valid = true;
+    EXPECT(publish_policy_check(&rec, 6000) == PUBLISH_REASON_STATE);
+    rec.sensor_count = 2;
+    EXPECT(publish_policy_check(&rec, 7000) == PUBLISH_REASON_STATE);
+}
+
+static esp_err_t configure(const char *payload)
+{
+    return publish_policy_configure(payload, (int)strlen(payload));
+}
+
+static void test_configure(void)
+{
+    publish_policy_config_t cfg;
+
+    publish_policy_init(&base);
+    EXPECT(configure("heartbeat_ms=600000,temp_abs=3,humidity_jump=150") == ESP_OK);
+    publish_policy_get_config(&cfg);
+    EXPECT(cfg.heartbeat_ms == 600000 && cfg.min_interval_ms == base.min_interval_ms);
+    EXPECT(cfg.deadband[PUBLISH_METRIC_TEMPERATURE].abs == 3);
+    EXPECT(cfg.deadband[PUBLISH_METRIC_TEMPERATURE].jump == 40);
+    EXPECT(cfg.deadband[PUBLISH_METRIC_HUMIDITY].jump == 150);
+    EXPECT(configure("min_interval_ms=0,temp_rel=0,humidity_abs=65535") == ESP_OK);
+    publish_policy_get_config(&cfg);
+    EXPECT(cfg.min_interval_ms == 0 && cfg.deadband[PUBLISH_METRIC_HUMIDITY].abs == 65535);
+
+    // payloads aren't terminated: only len bytes count
+    EXPECT(publish_policy_configure("temp_abs=12", 9) == ESP_ERR_INVALID_ARG);
+    EXPECT(publish_policy_configure("temp_abs=12", 10) == ESP_OK);
+    publish_policy_get_config(&cfg);
+    EXPECT(cfg.deadband[PUBLISH_METRIC_TEMPERATURE].abs == 1);
+    EXPECT(publish_policy_configure("temp_abs", 8) == ESP_ERR_INVALID_ARG);
+
+    // nothing changes when any setting is invalid
+    const char *invalid[] = {
+        "temp_abs=",
+        "x=1",
+        "=1",
+        "temp_=1",
+        "temp_abs=5x",
+        "temp_abs=-1",
+        "temp_abs=65536",
+        "heartbeat_ms=4294967296",
+        "heartbeat_ms=99999999999999999999",
+        "temp_abs=5,,heartbeat_ms=1",
+        "temp_abs=7,x=1",
+    };
+    publish_policy_get_config(&cfg);
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        publish_policy_config_t after;
+        EXPECT(configure(invalid[i]) == ESP_ERR_INVALID_ARG);
+        publish_policy_get_config(&after);
+        EXPECT(memcmp(&cfg, &after, sizeof(cfg)) == 0);
+    }
+    EXPECT(configure("heartbeat_ms=4294967295") == ESP_OK);
+}
+
+int main(void)
+{
+    test_deadband();
+    test_rate_limit();
+    test_heartbeat();
+    test_state();
+    test_configure();
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
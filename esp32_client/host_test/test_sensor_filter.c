@@ -0,0 +1,147 @@
+/**
+ * @file test_sensor_filter.c
+ *
+ * Median window, EMA rounding and rate-of-change outlier rejection of
+ * sensor_filter.
+ */
+#include <stdio.h>
+
+#include "sensor_filter.h"
+
+static int failures;
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Feeds one sample a second, returns the filter output
+static int16_t feed(sensor_filter_t *f, int16_t raw)
+{
+    uint32_t now_ms = f->primed ? f->last_ms + 1000 : 0;
+    sensor_filter_update(f, raw, now_ms);
+    return f->filtered;
+}
+
+static void test_median(void)
+{
+    const sensor_filter_config_t cfg = { .ema_alpha_q8 = 256 };
+    sensor_filter_t f;
+
+    sensor_filter_init(&f, &cfg);
+    EXPECT(feed(&f, 10) == 10);
+    // an even count takes the upper of the two middle samples
+    EXPECT(feed(&f, 50) == 50);
+    EXPECT(feed(&f, 20) == 20);
+
+    // up to two spikes in the window never reach the output
+    sensor_filter_init(&f, &cfg);
+    for (int i = 0; i < 5; i++)
+        EXPECT(feed(&f, 20) == 20);
+    EXPECT(feed(&f, 200) == 20);
+    EXPECT(feed(&f, 20) == 20);
+    EXPECT(feed(&f, -200) == 20);
+    EXPECT(feed(&f, -200) == 20);
+    // a third sample on the same side is the signal
+    EXPECT(feed(&f, 200) == 20);
+    EXPECT(feed(&f, 200) == 20);
+    EXPECT(feed(&f, 200) == 200);
+    EXPECT(f.rejected == 0);
+}
+
+static void test_ema(void)
+{
+    sensor_filter_config_t cfg = { .ema_alpha_q8 = 128 };
+    sensor_filter_t f;
+
+    // the first sample primes the EMA, later ones move it by half
+    sensor_filter_init(&f, &cfg);
+    EXPECT(feed(&f, 0) == 0);
+    EXPECT(feed(&f, 3) == 2);       // 1.5 rounds up
+    EXPECT(f.ema_q8 == 384);
+
+    // half away from zero below zero too, not towards it
+    sensor_filter_init(&f, &cfg);
+    EXPECT(feed(&f, 0) == 0);
+    EXPECT(feed(&f, -3) == 0);      // median of {0, -3} is 0
+    EXPECT(feed(&f, -3) == -2);     // -1.5
+    EXPECT(f.ema_q8 == -384);
+    EXPECT(feed(&f, -3) == -2);     // -2.25
+    EXPECT(feed(&f, -3) == -3);     // -2.625
+
+    // a quarter weight converges on a step without overshooting
+    cfg.ema_alpha_q8 = 64;
+    sensor_filter_init(&f, &cfg);
+    for (int i = 0; i < 5; i++)
+        feed(&f, 250);
+    int16_t prev = 250;
+    for (int i = 0; i < 40; i++) {
+        int16_t out = feed(&f, 200);
+        EXPECT(out <= prev && out >= 200);
+        prev = out;
+    }
+    EXPECT(prev == 200);
+
+    // 0 and out of range mean no smoothing
+    cfg.ema_alpha_q8 = 0;
+    sensor_filter_init(&f, &cfg);
+    EXPECT(f.cfg.ema_alpha_q8 == 256);
+    cfg.ema_alpha_q8 = 1000;
+    sensor_filter_init(&f, &cfg);
+    EXPECT(f.cfg.ema_alpha_q8 == 256);
+}
+
+static void test_outliers(void)
+{
+    // 2.0 per second, a jump has to persist for 3 samples
+    const sensor_filter_config_t cfg = { .ema_alpha_q8 = 256, .max_rate_per_s = 20, .reject_limit = 2 };
+    sensor_filter_t f;
+
+    sensor_filter_init(&f, &cfg);
+    EXPECT(sensor_filter_update(&f, 200, 0));
+    EXPECT(sensor_filter_update(&f, 220, 1000));
+    EXPECT(!sensor_filter_update(&f, 241, 2000));
+    EXPECT(f.raw == 241 && f.filtered == 220);
+
+    // the allowance grows with the time since the last accepted sample
+    EXPECT(sensor_filter_update(&f, 260, 3000));
+    // ... and is at least max_rate_per_s / 10 + 1 per sample
+    EXPECT(sensor_filter_update(&f, 263, 3000));
+    EXPECT(!sensor_filter_update(&f, 267, 3000));
+
+    // an accepted sample ends the run of rejections
+    sensor_filter_init(&f, &cfg);
+    EXPECT(sensor_filter_update(&f, 200, 0));
+    EXPECT(!sensor_filter_update(&f, 400, 1000));
+    EXPECT(!sensor_filter_update(&f, 400, 2000));
+    EXPECT(sensor_filter_update(&f, 210, 3000));
+    EXPECT(!sensor_filter_update(&f, 400, 4000));
+    EXPECT(!sensor_filter_update(&f, 400, 5000));
+    EXPECT(f.rejected == 4 && f.filtered == 210);
+
+    // reject_limit + 1 in a row: accepted, and the filter restarts from it
+    EXPECT(sensor_filter_update(&f, 400, 6000));
+    EXPECT(f.filtered == 400 && f.count == 1 && f.rejected_run == 0 && f.rejected == 5);
+    EXPECT(sensor_filter_update(&f, 410, 7000));
+    EXPECT(!sensor_filter_update(&f, 200, 8000));
+
+    // max_rate_per_s 0 accepts anything
+    const sensor_filter_config_t open = { .ema_alpha_q8 = 256 };
+    sensor_filter_init(&f, &open);
+    EXPECT(sensor_filter_update(&f, -400, 0));
+    EXPECT(sensor_filter_update(&f, 800, 0));
+    EXPECT(f.rejected == 0);
+}
+
+int main(void)
+{
+    test_median();
+    test_ema();
+    test_outliers();
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
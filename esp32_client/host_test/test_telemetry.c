@@ -0,0 +1,188 @@
+/**
+ * @file test_telemetry.c
+ *
+ * Record encodings of telemetry.c: binary round trips, malformed input,
+ * fixed-point formatting and the JSON text.
+ *
+ *     test_telemetry [FIXTURE] [--write]
+ *
+ * With FIXTURE, also checks that the encoder still writes the records in
+ * that file, one hex line each; source/test_telemetry_bin.py decodes the
+ * same file with the bridge's decoder. --write regenerates it instead.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+static int failures;
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Keep in sync with FIXTURE_RECORDS in source/test_telemetry_bin.py
+static const telemetry_record_t fixture_records[] = {
+    {
+        .seq = 7, .timestamp_ms = 35012, .fan_on = true, .fan_duty = 80, .sensor_count = 1,
+        .sensors = { { .valid = true, .temperature = -55, .humidity = 453, .temperature_raw = -57, .humidity_raw = 450 } },
+    },
+    {
+        .seq = 4294967295u, .timestamp_ms = 123, .fan_on = false, .fan_duty = 0, .sensor_count = 3,
+        .sensors = {
+            { .valid = true, .temperature = 244, .humidity = 450, .temperature_raw = 245, .humidity_raw = 440 },
+            { .valid = false },
+            { .valid = true, .temperature = -400, .humidity = 1000, .temperature_raw = -32768, .humidity_raw = 0 },
+        },
+    },
+};
+#define FIXTURE_COUNT (sizeof(fixture_records) / sizeof(fixture_records[0]))
+
+static void expect_same_record(const telemetry_record_t *a, const telemetry_record_t *b)
+{
+    EXPECT(a->seq == b->seq && a->timestamp_ms == b->timestamp_ms);
+    EXPECT(a->fan_on == b->fan_on && a->fan_duty == b->fan_duty && a->sensor_count == b->sensor_count);
+    for (uint8_t i = 0; i < a->sensor_count && i < TELEMETRY_MAX_SENSORS; i++) {
+        EXPECT(a->sensors[i].valid == b->sensors[i].valid);
+        if (a->sensors[i].valid)
+            EXPECT(memcmp(&a->sensors[i], &b->sensors[i], sizeof(a->sensors[i])) == 0);
+    }
+}
+
+static void test_roundtrip(void)
+{
+    uint8_t buf[TELEMETRY_BIN_MAX_LEN];
+    telemetry_record_t out;
+
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        int len = telemetry_encode_record(buf, sizeof(buf), &fixture_records[i]);
+        EXPECT(len > 0);
+        EXPECT(telemetry_decode_record(buf, (size_t)len, &out) == 0);
+        expect_same_record(&fixture_records[i], &out);
+    }
+
+    // one sensor is 21 bytes, a missing sensor costs nothing past the bitmap
+    EXPECT(telemetry_encode_record(buf, sizeof(buf), &fixture_records[0]) == 21);
+    EXPECT(telemetry_encode_record(buf, sizeof(buf), &fixture_records[1]) == 13 + 2 * 8);
+    EXPECT(buf[12] == 0x05);
+
+    // four sensors fill the largest record exactly
+    telemetry_record_t full = { .sensor_count = TELEMETRY_MAX_SENSORS };
+    for (int i = 0; i < TELEMETRY_MAX_SENSORS; i++)
+        full.sensors[i] = (telemetry_sensor_t){ .valid = true, .temperature = (int16_t)(-i) };
+    EXPECT(telemetry_encode_record(buf, sizeof(buf), &full) == TELEMETRY_BIN_MAX_LEN);
+    EXPECT(telemetry_decode_record(buf, sizeof(buf), &out) == 0);
+    expect_same_record(&full, &out);
+}
+
+static void test_malformed(void)
+{
+    uint8_t buf[TELEMETRY_BIN_MAX_LEN];
+    telemetry_record_t out;
+    int len = telemetry_encode_record(buf, sizeof(buf), &fixture_records[1]);
+
+    EXPECT(telemetry_encode_record(buf, (size_t)len - 1, &fixture_records[1]) == -1);
+    EXPECT(telemetry_encode_record(NULL, sizeof(buf), &fixture_records[1]) == -1);
+    len = telemetry_encode_record(buf, sizeof(buf), &fixture_records[1]);
+
+    EXPECT(telemetry_decode_record(buf, (size_t)len - 1, &out) == -1);
+    EXPECT(telemetry_decode_record(buf, TELEMETRY_BIN_HEADER_LEN - 1, &out) == -1);
+    EXPECT(telemetry_decode_record(NULL, (size_t)len, &out) == -1);
+    buf[0] = TELEMETRY_BIN_VERSION + 1;
+    EXPECT(telemetry_decode_record(buf, (size_t)len, &out) == -1);
+    buf[0] = TELEMETRY_BIN_VERSION;
+    buf[11] = TELEMETRY_MAX_SENSORS + 1;
+    EXPECT(telemetry_decode_record(buf, (size_t)len, &out) == -1);
+}
+
+static int tenths_equal(int32_t tenths, const char *expected)
+{
+    char buf[16];
+    int n = telemetry_format_tenths(buf, sizeof(buf), tenths);
+    return n == (int)strlen(expected) && strcmp(buf, expected) == 0;
+}
+
+static void test_tenths(void)
+{
+    char buf[8];
+
+    EXPECT(tenths_equal(0, "0.0"));
+    EXPECT(tenths_equal(5, "0.5"));
+    EXPECT(tenths_equal(-5, "-0.5"));
+    EXPECT(tenths_equal(-10, "-1.0"));
+    EXPECT(tenths_equal(244, "24.4"));
+    EXPECT(tenths_equal(-244, "-24.4"));
+    EXPECT(tenths_equal(INT16_MAX, "3276.7"));
+    EXPECT(tenths_equal(INT16_MIN, "-3276.8"));
+    EXPECT(tenths_equal(INT32_MIN, "-214748364.8"));
+
+    // the NUL needs a byte too
+    EXPECT(telemetry_format_tenths(buf, 5, -244) == -1);
+    EXPECT(telemetry_format_tenths(buf, 6, -244) == 5 && strcmp(buf, "-24.4") == 0);
+    EXPECT(telemetry_format_tenths(NULL, 0, 1) == -1);
+}
+
+static void test_text(void)
+{
+    char buf[256];
+    const char *expected =
+        "{\"v\":1,\"seq\":4294967295,\"ts_ms\":123,\"fan\":{\"on\":0,\"duty\":0},\"sensors\":["
+        "{\"temp\":24.4,\"humidity\":45.0,\"temp_raw\":24.5,\"humidity_raw\":44.0},null,"
+        "{\"temp\":-40.0,\"humidity\":100.0,\"temp_raw\":-3276.8,\"humidity_raw\":0.0}]}";
+
+    EXPECT(telemetry_format_record(buf, sizeof(buf), &fixture_records[1]) == (int)strlen(expected));
+    EXPECT(strcmp(buf, expected) == 0);
+    EXPECT(telemetry_format_record(buf, strlen(expected), &fixture_records[1]) == -1);
+    EXPECT(telemetry_format_record(buf, sizeof(buf), &fixture_records[0]) > 0);
+    EXPECT(strstr(buf, "\"temp\":-5.5,") != NULL && strstr(buf, "\"temp_raw\":-5.7,") != NULL);
+}
+
+static int test_fixture(const char *path, int write)
+{
+    FILE *f = fopen(path, write ? "w" : "r");
+    if (f == NULL) {
+        printf("can't open %s\n", path);
+        return 1;
+    }
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        uint8_t buf[TELEMETRY_BIN_MAX_LEN];
+        char hex[2 * TELEMETRY_BIN_MAX_LEN + 2], line[2 * TELEMETRY_BIN_MAX_LEN + 4];
+        int len = telemetry_encode_record(buf, sizeof(buf), &fixture_records[i]);
+        for (int b = 0; b < len; b++)
+            sprintf(hex + 2 * b, "%02x", buf[b]);
+        strcat(hex, "\n");
+        if (write) {
+            fputs(hex, f);
+        } else {
+            EXPECT(fgets(line, sizeof(line), f) != NULL && strcmp(line, hex) == 0);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int write = argc == 3 && strcmp(argv[2], "--write") == 0;
+
+    if (argc > 3 || (argc == 3 && !write)) {
+        fprintf(stderr, "usage: %s [FIXTURE] [--write]\n", argv[0]);
+        return 2;
+    }
+    if (write)
+        return test_fixture(argv[1], 1);
+
+    test_roundtrip();
+    test_malformed();
+    test_tenths();
+    test_text();
+    if (argc == 2 && test_fixture(argv[1], 0))
+        failures++;
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/**
+ * @file test_telemetry_loop.c
+ *
+ * The publish task's sample loop on the host: simulated sensors through
+ * sensor_read_all(), the median/EMA filters, the publish policy and both
+ * record encodings, with the settings of app_config.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "publish_policy.h"
+#include "sensor.h"
+#include "sensor_filter.h"
+#include "sensor_sim.h"
+#include "telemetry.h"
+
+#define LOOP_SENSORS 2
+#define LOOP_SAMPLE_INTERVAL_MS 5000    // TELEMETRY_SAMPLE_INTERVAL_MS
+#define LOOP_SAMPLES 720                // an hour
+#define LOOP_FAN_ON_AT 400
+
+static int failures;
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static const sensor_sim_config_t sim_quiet = {
+    .temperature = 215, .humidity = 450, .noise = 2, .seed = 1,
+};
+static const sensor_sim_config_t sim_spiky = {
+    .temperature = -150, .humidity = 800, .noise = 3, .spike_every = 7, .seed = 99,
+};
+
+// Batched backend that gives up on every batch without setting a status
+static esp_err_t refusing_init(sensor_t *sensor)
+{
+    (void)sensor;
+    return ESP_OK;
+}
+
+static esp_err_t refusing_read(sensor_t *sensor, sensor_reading_t *reading)
+{
+    (void)sensor;
+    (void)reading;
+    return ESP_FAIL;
+}
+
+static void refusing_caps(const sensor_t *sensor, sensor_caps_t *caps)
+{
+    (void)sensor;
+    (void)caps;
+}
+
+static esp_err_t refusing_read_batch(sensor_t *const *sensors, size_t count,
+                                     sensor_reading_t *readings, esp_err_t *status)
+{
+    (void)sensors;
+    (void)count;
+    (void)readings;
+    (void)status;
+    return ESP_ERR_INVALID_ARG;
+}
+
+static const sensor_driver_t refusing_driver = {
+    .name = "refusing",
+    .init = refusing_init,
+    .read = refusing_read,
+    .caps = refusing_caps,
+    .read_batch = refusing_read_batch,
+};
+
+static void test_batch_left_unset(void)
+{
+    sensor_t sensors[] = {
+        { .driver = &sensor_sim_driver, .config = &sim_quiet },
+        { .driver = &refusing_driver },
+        { .driver = &refusing_driver },
+    };
+    sensor_reading_t readings[3];
+    esp_err_t status[3];
+
+    for (size_t i = 0; i < 3; i++)
+        EXPECT(sensor_init(&sensors[i]) == ESP_OK);
+    memset(readings, 0x5a, sizeof(readings));
+    EXPECT(sensor_read_all(sensors, 3, readings, status) == ESP_FAIL);
+    EXPECT(status[0] == ESP_OK);
+    EXPECT(status[1] == ESP_FAIL && status[2] == ESP_FAIL);
+    EXPECT(readings[1].temperature == 0x5a5a && readings[2].humidity == 0x5a5a);
+    free(sensors[0].ctx);
+}
+
+static void expect_same_record(const telemetry_record_t *a, const telemetry_record_t *b)
+{
+    EXPECT(a->seq == b->seq && a->timestamp_ms == b->timestamp_ms);
+    EXPECT(a->fan_on == b->fan_on && a->fan_duty == b->fan_duty && a->sensor_count == b->sensor_count);
+    for (uint8_t i = 0; i < a->sensor_count; i++) {
+        EXPECT(a->sensors[i].valid == b->sensors[i].valid);
+        if (a->sensors[i].valid)
+            EXPECT(memcmp(&a->sensors[i], &b->sensors[i], sizeof(a->sensors[i])) == 0);
+    }
+}
+
+static void test_loop(void)
+{
+    sensor_t sensors[LOOP_SENSORS] = {
+        { .driver = &sensor_sim_driver, .config = &sim_quiet },
+        { .driver = &sensor_sim_driver, .config = &sim_spiky },
+    };
+    const sensor_filter_config_t temp_cfg = { .ema_alpha_q8 = 64, .max_rate_per_s = 20, .reject_limit = 2 };
+    const sensor_filter_config_t humidity_cfg = { .ema_alpha_q8 = 64, .max_rate_per_s = 50, .reject_limit = 2 };
+    const publish_policy_config_t policy = {
+        .deadband = {
+            [PUBLISH_METRIC_TEMPERATURE] = { .abs = 5, .jump = 20 },
+            [PUBLISH_METRIC_HUMIDITY] = { .abs = 20, .jump = 100 },
+        },
+        .min_interval_ms = 30000,
+        .heartbeat_ms = 300000,
+    };
+    sensor_filter_t temp_filters[LOOP_SENSORS], humidity_filters[LOOP_SENSORS];
+    sensor_reading_t readings[LOOP_SENSORS];
+    esp_err_t status[LOOP_SENSORS];
+    telemetry_record_t rec = { .sensor_count = LOOP_SENSORS };
+    unsigned reasons[PUBLISH_REASON_MAX] = { 0 };
+    uint32_t seq = 0, last_sent_ms = 0, longest_gap_ms = 0;
+    int16_t filtered_min = INT16_MAX, filtered_max = INT16_MIN;
+    char text[512];
+    uint8_t bin[TELEMETRY_BIN_MAX_LEN];
+
+    for (size_t i = 0; i < LOOP_SENSORS; i++) {
+        EXPECT(sensor_init(&sensors[i]) == ESP_OK);
+        sensor_filter_init(&temp_filters[i], &temp_cfg);
+        sensor_filter_init(&humidity_filters[i], &humidity_cfg);
+    }
+    publish_policy_init(&policy);
+
+    for (uint32_t n = 0; n < LOOP_SAMPLES; n++) {
+        uint32_t now_ms = n * LOOP_SAMPLE_INTERVAL_MS;
+
+        EXPECT(sensor_read_all(sensors, LOOP_SENSORS, readings, status) == ESP_OK);
+        for (size_t i = 0; i < LOOP_SENSORS; i++) {
+            sensor_filter_update(&temp_filters[i], readings[i].temperature, now_ms);
+            sensor_filter_update(&humidity_filters[i], readings[i].humidity, now_ms);
+            rec.sensors[i] = (telemetry_sensor_t){
+                .valid = status[i] == ESP_OK,
+                .temperature = temp_filters[i].filtered,
+                .humidity = humidity_filters[i].filtered,
+                .temperature_raw = readings[i].temperature,
+                .humidity_raw = readings[i].humidity,
+            };
+        }
+        if (n >= 10 && temp_filters[1].filtered < filtered_min)
+            filtered_min = temp_filters[1].filtered;
+        if (n >= 10 && temp_filters[1].filtered > filtered_max)
+            filtered_max = temp_filters[1].filtered;
+        rec.timestamp_ms = now_ms;
+        rec.fan_on = n >= LOOP_FAN_ON_AT;
+        rec.fan_duty = rec.fan_on ? 80 : 0;
+
+        publish_reason_t reason = publish_policy_check(&rec, now_ms);
+        if (n == 0)
+            EXPECT(reason == PUBLISH_REASON_FIRST);
+        if (n == LOOP_FAN_ON_AT)
+            EXPECT(reason == PUBLISH_REASON_STATE);
+        reasons[reason]++;
+        if (reason == PUBLISH_REASON_NONE)
+            continue;
+
+        rec.seq = seq++;
+        if (now_ms - last_sent_ms > longest_gap_ms)
+            longest_gap_ms = now_ms - last_sent_ms;
+        last_sent_ms = now_ms;
+
+        telemetry_record_t decoded;
+        int len = telemetry_encode_record(bin, sizeof(bin), &rec);
+        EXPECT(len == TELEMETRY_BIN_HEADER_LEN + LOOP_SENSORS * TELEMETRY_BIN_SENSOR_LEN);
+        EXPECT(telemetry_decode_record(bin, (size_t)len, &decoded) == 0);
+        expect_same_record(&rec, &decoded);
+        EXPECT(telemetry_format_record(text, sizeof(text), &rec) > 0);
+        // sensor 1 stays below zero
+        EXPECT(strstr(text, "},{\"temp\":-") != NULL);
+    }
+
+    // spikes of +10.0 C every 7th sample never get through the median
+    EXPECT(filtered_max - filtered_min <= 2 * 50 + 2 * 3);
+    EXPECT(longest_gap_ms <= policy.heartbeat_ms);
+    EXPECT(reasons[PUBLISH_REASON_NONE] > LOOP_SAMPLES / 2);
+    EXPECT(reasons[PUBLISH_REASON_FIRST] == 1 && reasons[PUBLISH_REASON_STATE] == 1);
+    printf("%u samples: %u suppressed, %u deadband, %u jump, %u heartbeat, %u state\n", LOOP_SAMPLES,
+           reasons[PUBLISH_REASON_NONE], reasons[PUBLISH_REASON_DEADBAND], reasons[PUBLISH_REASON_JUMP],
+           reasons[PUBLISH_REASON_HEARTBEAT], reasons[PUBLISH_REASON_STATE]);
+    for (size_t i = 0; i < LOOP_SENSORS; i++)
+        free(sensors[i].ctx);
+}
+
+int main(void)
+{
+    test_batch_left_unset();
+    test_loop();
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
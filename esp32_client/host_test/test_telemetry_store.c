@@ -0,0 +1,167 @@
+/**
+ * @file test_telemetry_store.c
+ *
+ * Ring overflow, flash wrap and resume after a reboot of telemetry_store,
+ * on the NOR flash partitions of stubs/esp_host.c. Built with
+ * TELEMETRY_STORE_RECORDS 8; a two sector partition holds 128 slots.
+ */
+#include <stdio.h>
+
+#include "esp_partition.h"
+#include "telemetry_store.h"
+
+#define SECTOR_SLOTS (4096 / TELEMETRY_STORE_SLOT_SIZE)
+#define FLASH_SLOTS (2 * SECTOR_SLOTS)
+
+static int failures;
+
+#define EXPECT(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static void push(uint32_t first_seq, uint32_t n)
+{
+    for (uint32_t seq = first_seq; seq < first_seq + n; seq++) {
+        telemetry_record_t rec = { .seq = seq, .timestamp_ms = seq * 1000, .sensor_count = 1 };
+        rec.sensors[0] = (telemetry_sensor_t){ .valid = true, .temperature = (int16_t)seq, .humidity = 500 };
+        telemetry_store_push(&rec);
+    }
+}
+
+// Peeks up to max records, true if they are first_seq, first_seq + 1, ...
+static bool peek_seqs(size_t max, uint32_t first_seq, size_t expected_count)
+{
+    telemetry_record_t recs[FLASH_SLOTS];
+    size_t n = telemetry_store_peek(recs, max);
+    if (n != expected_count)
+        return false;
+    for (size_t i = 0; i < n; i++) {
+        if (recs[i].seq != first_seq + i || recs[i].sensors[0].temperature != (int16_t)(first_seq + i))
+            return false;
+    }
+    return true;
+}
+
+static void expect_stats(uint32_t pending, uint32_t dropped, uint32_t replayed)
+{
+    telemetry_store_stats_t stats;
+    telemetry_store_get_stats(&stats);
+    EXPECT(stats.pending == pending && telemetry_store_pending() == pending);
+    EXPECT(stats.dropped == dropped && stats.replayed == replayed);
+    EXPECT(stats.flash_errors == 0);
+}
+
+static void test_ram(void)
+{
+    EXPECT(telemetry_store_init(NULL) == ESP_OK);
+    EXPECT(peek_seqs(4, 0, 0));
+
+    // full: the oldest records go
+    push(0, TELEMETRY_STORE_RECORDS + 2);
+    expect_stats(TELEMETRY_STORE_RECORDS, 2, 0);
+    EXPECT(peek_seqs(4, 2, 4));
+
+    // a push after the peek drops record 2 and voids the pop
+    push(TELEMETRY_STORE_RECORDS + 2, 1);
+    telemetry_store_pop();
+    expect_stats(TELEMETRY_STORE_RECORDS, 3, 0);
+
+    EXPECT(peek_seqs(4, 3, 4));
+    telemetry_store_pop();
+    telemetry_store_pop();      // once per peek
+    expect_stats(TELEMETRY_STORE_RECORDS - 4, 3, 4);
+    EXPECT(peek_seqs(TELEMETRY_STORE_RECORDS, 7, TELEMETRY_STORE_RECORDS - 4));
+    telemetry_store_pop();
+    expect_stats(0, 3, TELEMETRY_STORE_RECORDS);
+    EXPECT(peek_seqs(4, 0, 0));
+
+    // no usable partition: RAM
+    EXPECT(esp_host_partition_create("small", 4096) != NULL);
+    EXPECT(telemetry_store_init("small") == ESP_OK);
+    push(0, TELEMETRY_STORE_RECORDS + 1);
+    expect_stats(TELEMETRY_STORE_RECORDS, 1, 0);
+    EXPECT(telemetry_store_init("missing") == ESP_OK);
+    expect_stats(0, 0, 0);
+}
+
+static void test_flash_wrap(void)
+{
+    EXPECT(esp_host_partition_create("wrap", 2 * 4096) != NULL);
+
+    // wrapping into the sector holding the tail erases it, its records are dropped
+    EXPECT(telemetry_store_init("wrap") == ESP_OK);
+    push(0, FLASH_SLOTS);
+    expect_stats(FLASH_SLOTS, 0, 0);
+    EXPECT(peek_seqs(FLASH_SLOTS, 0, FLASH_SLOTS));
+    push(FLASH_SLOTS, 1);
+    expect_stats(SECTOR_SLOTS + 1, SECTOR_SLOTS, 0);
+    EXPECT(peek_seqs(FLASH_SLOTS, SECTOR_SLOTS, SECTOR_SLOTS + 1));
+
+    // the tail mid-sector: only what is left of that sector goes
+    EXPECT(peek_seqs(10, SECTOR_SLOTS, 10));
+    telemetry_store_pop();
+    expect_stats(SECTOR_SLOTS - 9, SECTOR_SLOTS, 10);
+    push(FLASH_SLOTS + 1, SECTOR_SLOTS - 1);   // fills sector 0 again
+    push(3 * SECTOR_SLOTS, 1);                  // erases sector 1, tail at slot 74
+    expect_stats(SECTOR_SLOTS + 1, 2 * SECTOR_SLOTS - 10, 10);
+    EXPECT(peek_seqs(FLASH_SLOTS, FLASH_SLOTS, SECTOR_SLOTS + 1));
+    telemetry_store_pop();
+    expect_stats(0, 2 * SECTOR_SLOTS - 10, SECTOR_SLOTS + 11);
+
+    // with the tail past the sector nothing is dropped
+    push(3 * SECTOR_SLOTS + 1, SECTOR_SLOTS);
+    EXPECT(peek_seqs(FLASH_SLOTS, 3 * SECTOR_SLOTS + 1, SECTOR_SLOTS));
+    expect_stats(SECTOR_SLOTS, 2 * SECTOR_SLOTS - 10, SECTOR_SLOTS + 11);
+}
+
+static void test_flash_reboot(void)
+{
+    EXPECT(esp_host_partition_create("reboot", 2 * 4096) != NULL);
+    EXPECT(telemetry_store_init("reboot") == ESP_OK);
+    EXPECT(peek_seqs(4, 0, 0));
+
+    // reboot in mid-sector, with the first records replayed
+    push(0, 100);
+    EXPECT(peek_seqs(20, 0, 20));
+    telemetry_store_pop();
+    EXPECT(telemetry_store_init("reboot") == ESP_OK);
+    expect_stats(80, 0, 0);
+    EXPECT(peek_seqs(FLASH_SLOTS, 20, 80));
+
+    // a record peeked but not popped before the reboot is replayed again
+    EXPECT(telemetry_store_init("reboot") == ESP_OK);
+    EXPECT(peek_seqs(FLASH_SLOTS, 20, 80));
+
+    // writing goes on after the newest slot, the log sequence continues
+    push(100, 1);
+    EXPECT(telemetry_store_init("reboot") == ESP_OK);
+    expect_stats(81, 0, 0);
+    EXPECT(peek_seqs(FLASH_SLOTS, 20, 81));
+
+    // wrapped before the reboot: the oldest slot isn't slot 0
+    push(101, FLASH_SLOTS - 101 + 5);
+    expect_stats(FLASH_SLOTS - 20 + 5 - SECTOR_SLOTS + 20, SECTOR_SLOTS - 20, 0);
+    EXPECT(telemetry_store_init("reboot") == ESP_OK);
+    expect_stats(SECTOR_SLOTS + 5, 0, 0);
+    EXPECT(peek_seqs(FLASH_SLOTS, SECTOR_SLOTS, SECTOR_SLOTS + 5));
+    telemetry_store_pop();
+    EXPECT(telemetry_store_init("reboot") == ESP_OK);
+    expect_stats(0, 0, 0);
+    EXPECT(peek_seqs(4, 0, 0));
+    push(FLASH_SLOTS + 5, 1);
+    EXPECT(peek_seqs(4, FLASH_SLOTS + 5, 1));
+}
+
+int main(void)
+{
+    test_ram();
+    test_flash_wrap();
+    test_flash_reboot();
+
+    if (failures)
+        printf("%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -2,24 +2,139 @@
 #define APP_CONFIG_H
 
 #include "driver/gpio.h"
+#include "sensor_dht.h"
+#include "sensor_i2c.h"
+#include "sensor_sim.h"
+#include "telemetry.h"
 
 // WiFi Configuration
 #define WIFI_MAX_RETRY 10
+// After WIFI_MAX_RETRY quick retries, try again this often until the AP is back
+#define WIFI_RECONNECT_INTERVAL_MS 30000
 
 // MQTT Configuration
 #define MQTT_BROKER_URI	"mqtt://<IP_ADDR>:<PORT>" // Replace this. With broker IP and Mosquitto port
-#define MQTT_CLIENT_ID	"esp32-test-client"
+#define MQTT_CLIENT_ID	""	// Empty: use the device id, client ids must be unique per broker
+// Outbox budget, bytes. Everything is published through the client's outbox
+// (mqtt_manager_enqueue()); each priority may only fill it up to its own
+// budget, so what is above it keeps the rest: live telemetry goes out ahead
+// of replayed backlog and statistics, state changes and command replies
+// still go out while the broker is slow.
+#define MQTT_OUTBOX_BUDGET	8192
+#define MQTT_OUTBOX_STATE_BUDGET	6144
+#define MQTT_OUTBOX_TELEMETRY_BUDGET	4096
+#define MQTT_OUTBOX_BULK_BUDGET	2560
+// Commands are subscribed with this QoS, so a v5 session can hold them while offline
+#define MQTT_COMMAND_QOS	1
+// 1: connect with MQTT 5, also set CONFIG_MQTT_PROTOCOL_5 in sdkconfig (off
+// by default). Fixed publish topics get topic aliases, and the session
+// outlives a disconnect by MQTT5_SESSION_EXPIRY_S so commands sent meanwhile
+// are delivered, unless their message expiry (set by the bridge) has passed.
+// Aliases above the broker's Topic Alias Maximum go unused (mosquitto:
+// max_topic_alias, default 10).
+#define MQTT_PROTOCOL_V5	0
+#define MQTT5_SESSION_EXPIRY_S	3600
+#define MQTT5_TOPIC_ALIAS_MAX	10
 
-// Subscribe topics
-#define status_t	"fan/status"
-#define output_t	"fan/output"
+// Topic namespace. Each device owns devices/<id>/..., where <id> is DEVICE_ID
+// or, when empty, the station MAC in hex. Commands arrive under cmd/ in three
+// scopes: devices/<id>/cmd/ (this device), groups/<DEVICE_GROUP>/cmd/ and
+// broadcast/cmd/ (the whole fleet). Each scope is one wildcard subscription,
+// so the broker only forwards what is meant for this device.
+#define DEVICE_ID	""
+#define DEVICE_GROUP	"default"
+#define device_root_t	"devices"
+#define group_root_t	"groups"
+#define broadcast_root_t	"broadcast"
+#define cmd_t	"cmd/#"
 
-// Publish topics
-#define read_t	"fan/read"
-#define temp_t	"sensors/dht11/temp"
-#define humidity_t	"sensors/dht11/humidity"
+// Subscribe topics, relative to a scope prefix
+#define status_t	"cmd/fan/status"
+#define output_t	"cmd/fan/output"
+#define encoding_t	"cmd/telemetry/encoding"	// "text" or "binary"
+#define policy_t	"cmd/telemetry/policy"	// "key=value,...", see publish_policy_configure()
 
-// GPIO
-#define dht_pin GPIO_NUM_4
+// Publish topics, relative to devices/<id>/
+#define telemetry_t	"telemetry"	// one record per sample, JSON, see telemetry_format_record()
+#define telemetry_bin_t	"telemetry/bin"	// the same record packed, see telemetry_encode_record()
+#define telemetry_batch_t	"telemetry/batch"	// replayed records, JSON array
+#define telemetry_bin_batch_t	"telemetry/bin/batch"	// replayed records, packed back to back
+#define read_t	"fan/read"	// duty the PWM outputs, once fades settle, see FAN_ACTUATOR_REPORT_DEBOUNCE_MS
+#define desired_t	"cmd/fan/desired"	// retained "ON,<duty>" or "OFF,<duty>", this device's scope only
+#define fan_ack_t	"fan/ack"	// trace of a command with a correlation id, JSON, see fan_actuator.h
+#define temp_t	"sensors/temp"
+#define humidity_t	"sensors/humidity"
+#define temp_raw_t	"sensors/temp_raw"
+#define humidity_raw_t	"sensors/humidity_raw"
+#define dht_link_t	"sensors/dht/link"	// DHT driver statistics, JSON
+#define telemetry_stats_t	"telemetry/stats"	// publish policy and store counters, JSON
+// Retained presence: PRESENCE_ONLINE on connect (birth), PRESENCE_OFFLINE as
+// the Last Will, published by the broker when the connection is lost
+#define presence_t	"presence"
+#define PRESENCE_ONLINE	"online"
+#define PRESENCE_OFFLINE	"offline"
+// Retained DEVICE_GROUP, sent with the birth message. The bridge only retains
+// desired state of a group command for devices that reported the group.
+#define group_t	"group"
+
+#define DHT_LINK_PUBLISH_INTERVAL_MS	60000
+// DHT readings up to this old are reused instead of reading the sensor again
+// (dht_read_cached); its minimum sampling interval is enforced either way
+#define DHT_CACHE_MAX_AGE_MS	1000
+// read_t is published this long after the last fade ended, a burst of commands gives one report
+#define FAN_ACTUATOR_REPORT_DEBOUNCE_MS	200
+
+// 1: also publish every metric on its own topic (temp_t, humidity_t, ...),
+// as before the telemetry record. Costs four publishes per sensor and sample.
+#define TELEMETRY_LEGACY_TOPICS	0
+#define TELEMETRY_SAMPLE_INTERVAL_MS	5000
+// Report by exception: a sample is only published when a value leaves its
+// deadband (tenths, or permille of the last published value), jumps, the fan
+// state changes, or after the heartbeat interval. Adjustable at runtime via policy_t.
+#define PUBLISH_POLICY_MIN_INTERVAL_MS	30000
+#define PUBLISH_POLICY_HEARTBEAT_MS	300000
+#define PUBLISH_POLICY_TEMP_ABS	5	// 0.5 C
+#define PUBLISH_POLICY_TEMP_REL	0
+#define PUBLISH_POLICY_TEMP_JUMP	20	// 2.0 C, published right away
+#define PUBLISH_POLICY_HUMIDITY_ABS	20	// 2.0 %
+#define PUBLISH_POLICY_HUMIDITY_REL	0
+#define PUBLISH_POLICY_HUMIDITY_JUMP	100	// 10.0 %
+
+// Store and forward: records that can't be published (no Wi-Fi or broker)
+// are kept and replayed after reconnecting, TELEMETRY_REPLAY_BATCH records per
+// message and at most one message per TELEMETRY_REPLAY_INTERVAL_MS, so live
+// records keep going out on time. The store is RAM only unless
+// TELEMETRY_STORE_PARTITION names a data partition, which needs a custom
+// partition table, e.g. in partitions.csv:
+//   telemetry, data, 0x40, , 64K
+#define TELEMETRY_STORE_PARTITION	NULL	// e.g. "telemetry"
+#define TELEMETRY_REPLAY_BATCH	8
+#define TELEMETRY_REPLAY_INTERVAL_MS	1000
+
+// Encoding used at boot, the bridge can switch it through encoding_t
+#define TELEMETRY_ENCODING	TELEMETRY_ENCODING_TEXT
+
+// Sample filter (tenths): "temp"/"humidity" (temp_t/humidity_t) carry filtered values, *_raw the raw ones
+#define SENSOR_FILTER_EMA_ALPHA_Q8	64	// 1/4 weight for a new sample
+#define SENSOR_FILTER_TEMP_MAX_RATE	20	// 2.0 C per second
+#define SENSOR_FILTER_HUMIDITY_MAX_RATE	50	// 5.0 % per second
+#define SENSOR_FILTER_REJECT_LIMIT	2
+
+// Sensors read by the publish task through the sensor interface (sensor.h).
+// Sensor n is entry n of the telemetry record's "sensors" array; with
+// TELEMETRY_LEGACY_TOPICS the first one publishes on temp_t/humidity_t, sensor
+// n > 0 on temp_t "/<n>" and humidity_t "/<n>". Backends and their config structs:
+//   sensor_dht_driver  sensor_dht_config_t  DHT11/AM2301 on a GPIO, see dht_capture_mode_t
+//   sensor_i2c_driver  sensor_i2c_config_t  SHT3x or Si7021 on I2C
+//   sensor_sim_driver  sensor_sim_config_t  simulated values, no hardware
+// e.g. an SHT31 on the default pins:
+//   { .driver = &sensor_i2c_driver, .config = &(const sensor_i2c_config_t){ .chip = SENSOR_I2C_SHT3X,
+//     .port = I2C_NUM_0, .sda = GPIO_NUM_21, .scl = GPIO_NUM_22, .address = SENSOR_I2C_ADDR_SHT3X,
+//     .scl_speed_hz = 100000 } },
+#define app_sensors { \
+    { .driver = &sensor_dht_driver, .config = &(const sensor_dht_config_t){ \
+        .sensor_type = DHT_TYPE_DHT11, .pin = GPIO_NUM_4, .mode = DHT_CAPTURE_RMT, \
+        .max_age_ms = DHT_CACHE_MAX_AGE_MS } }, \
+}
 
 #endif // APP_CONFIG_H
@@ -1,32 +1,60 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
 
 #include "nvs_flash.h"
 #include "esp_log.h"
 #include "esp_system.h"
-#include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
 
 #include "app_config.h"
 #include "wifi_manager.h"
 #include "mqtt_manager.h"
+#include "mqtt_router.h"
+#include "device_topics.h"
+#include "sensor.h"
 #include "dht.h"
 #include "fan_ctrl.h"
+#include "fan_actuator.h"
+#include "telemetry.h"
+#include "publish_policy.h"
+#include "telemetry_store.h"
+#include "sensor_filter.h"
 
-static float temp_reading_global = 0.0f;
-static float humidity_reading_global = 0.0f;
+// Largest JSON record, see telemetry_format_record()
+#define RECORD_TEXT_MAX (64 + TELEMETRY_MAX_SENSORS * 80)
+
+static sensor_t sensors[] = app_sensors;
+#define SENSOR_COUNT (sizeof(sensors) / sizeof(sensors[0]))
+_Static_assert(SENSOR_COUNT <= TELEMETRY_MAX_SENSORS, "raise TELEMETRY_MAX_SENSORS");
+
+// Tenths of a degree Celsius / percent
+static int16_t temp_reading_global = 0;
+static int16_t humidity_reading_global = 0;
+
+static sensor_filter_t temp_filters[SENSOR_COUNT];
+static sensor_filter_t humidity_filters[SENSOR_COUNT];
+// esp_timer time of each sensor's last good reading, 0 if none
+static int64_t last_good_us[SENSOR_COUNT];
 
 static const char *TAG = "APP_MAIN";
 
+// Written by the MQTT client task (encoding_t), read by the publish task
+static volatile telemetry_encoding_t telemetry_encoding = TELEMETRY_ENCODING;
+
 esp_err_t initialize_system_peripherals(void) {
     ESP_LOGI(TAG, "Initializing peripherals...");
-    esp_err_t ret = gpio_set_pull_mode(dht_pin, GPIO_PULLUP_ONLY);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set DHT pin %d pull-up: %s", (int)dht_pin, esp_err_to_name(ret));
-    } else {
-        ESP_LOGI(TAG, "DHT Pin %d pull-up set.", (int)dht_pin);
+    esp_err_t ret;
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        ret = sensor_init(&sensors[i]);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Sensor %u (%s) initialization failed: %s", (unsigned)i, sensors[i].driver->name, esp_err_to_name(ret));
+        }
     }
 
     ret = fan_pwm_init();
@@ -35,23 +63,401 @@ esp_err_t initialize_system_peripherals(void) {
         return ret;
     }
     ESP_LOGI(TAG, "Fan PWM initialized.");
+
+    ret = fan_actuator_start();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Fan actuator start failed: %s.", esp_err_to_name(ret));
+        return ret;
+    }
     return ESP_OK;
 }
 
-void dht_publish_task(void *pvParameters) {
-    ESP_LOGI(TAG, "DHT Publish Task started.");
-    char sens_buf[16];
+static void publish_sensor_value(const char *topic, size_t index, int16_t tenths) {
+    static char sens_buf[16];  // only used by the publish task
+    char suffix[32];
+    char topic_buf[80];
+
+    int len = telemetry_format_tenths(sens_buf, sizeof(sens_buf), tenths);
+    if (index > 0) {
+        snprintf(suffix, sizeof(suffix), "%s/%u", topic, (unsigned)index);
+        topic = suffix;
+    }
+    if (device_topic_format(topic_buf, sizeof(topic_buf), DEVICE_SCOPE_SELF, topic) < 0) {
+        return;
+    }
+    mqtt_manager_enqueue(topic_buf, sens_buf, len, 0, 0, MQTT_PRIORITY_TELEMETRY);
+}
+
+// snprintf at buf + *len; false once the buffer is full
+static bool appendf(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = *len < size ? vsnprintf(buf + *len, size - *len, fmt, ap) : -1;
+    va_end(ap);
+    if (n < 0 || *len + n >= size) {
+        *len = size;
+        return false;
+    }
+    *len += n;
+    return true;
+}
+
+/**
+ * @brief Publishes the DHT driver's link statistics as JSON: failures per
+ * reason, bit pulse width histograms, read latency and cache counters.
+ */
+static void publish_dht_link_stats(void) {
+    static char buf[1152];  // only used by the publish task
+    size_t len = 0;
+    dht_stats_t st;
+
+    if (dht_get_stats(&st) != ESP_OK || st.reads == 0) {
+        return;
+    }
+
+    appendf(buf, sizeof(buf), &len, "{\"reads\":%" PRIu32 ",\"good\":%" PRIu32 ",\"fail\":{", st.reads, st.good_reads);
+    for (int i = 0; i < DHT_FAIL_MAX; i++) {
+        appendf(buf, sizeof(buf), &len, "%s\"%s\":%" PRIu32, i ? "," : "", dht_fail_name(i), st.failures[i]);
+    }
+    appendf(buf, sizeof(buf), &len, "},\"bin_us\":%d,\"low_hist\":[", DHT_HIST_BIN_US);
+    for (int i = 0; i < DHT_HIST_BINS; i++) {
+        appendf(buf, sizeof(buf), &len, i ? ",%" PRIu32 : "%" PRIu32, st.low_hist[i]);
+    }
+    appendf(buf, sizeof(buf), &len, "],\"high_hist\":[");
+    for (int i = 0; i < DHT_HIST_BINS; i++) {
+        appendf(buf, sizeof(buf), &len, i ? ",%" PRIu32 : "%" PRIu32, st.high_hist[i]);
+    }
+    bool ok = appendf(buf, sizeof(buf), &len,
+                      "],\"latency_us\":{\"last\":%" PRIu32 ",\"min\":%" PRIu32 ",\"max\":%" PRIu32 ",\"avg\":%" PRIu32 "}"
+                      ",\"critical_us\":{\"last\":%" PRIu32 ",\"max\":%" PRIu32 "}"
+                      ",\"cache\":{\"hits\":%" PRIu32 ",\"misses\":%" PRIu32 ",\"stale\":%" PRIu32 "}}",
+                      st.last_latency_us, st.min_latency_us, st.max_latency_us,
+                      (uint32_t)(st.total_latency_us / st.reads), st.last_critical_us, st.max_critical_us,
+                      st.cache_hits, st.cache_misses, st.cache_stale);
+    if (!ok) {
+        ESP_LOGE(TAG, "DHT link stats do not fit in %u bytes.", (unsigned)sizeof(buf));
+        return;
+    }
+    char topic[80];
+    if (device_topic_format(topic, sizeof(topic), DEVICE_SCOPE_SELF, dht_link_t) < 0) {
+        return;
+    }
+    mqtt_manager_enqueue(topic, buf, (int)len, 0, 0, MQTT_PRIORITY_BULK);
+}
+
+/**
+ * @brief Publishes the publish policy, store, outbox, inbound router and fan
+ * actuator counters as JSON.
+ */
+static void publish_telemetry_stats(void) {
+    static char buf[1024];  // only used by the publish task
+    char topic[80];
+    size_t len = 0;
+    publish_policy_stats_t st;
+    telemetry_store_stats_t store;
+    mqtt_manager_stats_t mq;
+    mqtt_router_stats_t router;
+    fan_actuator_stats_t fan;
+    uint32_t enqueued = 0;
+
+    publish_policy_get_stats(&st);
+    telemetry_store_get_stats(&store);
+    mqtt_manager_get_stats(&mq);
+    mqtt_router_get_stats(&router);
+    fan_actuator_get_stats(&fan);
+    appendf(buf, sizeof(buf), &len, "{\"suppressed\":%" PRIu32 ",\"sent\":{", st.suppressed);
+    for (int i = PUBLISH_REASON_NONE + 1; i < PUBLISH_REASON_MAX; i++) {
+        appendf(buf, sizeof(buf), &len, "%s\"%s\":%" PRIu32, i > 1 ? "," : "", publish_reason_name(i), st.sent[i]);
+    }
+    bool ok = appendf(buf, sizeof(buf), &len,
+                      "},\"store\":{\"pending\":%" PRIu32 ",\"stored\":%" PRIu32 ",\"replayed\":%" PRIu32
+                      ",\"dropped\":%" PRIu32 ",\"flash_errors\":%" PRIu32 "},\"outbox\":{",
+                      store.pending, store.stored, store.replayed, store.dropped, store.flash_errors);
+    static const char *const priority_names[MQTT_PRIORITY_MAX] = { "bulk", "telemetry", "state", "ack" };
+    for (int i = 0; i < MQTT_PRIORITY_MAX; i++) {
+        enqueued += mq.enqueued[i];
+        appendf(buf, sizeof(buf), &len, "\"%s\":{\"enqueued\":%" PRIu32 ",\"dropped\":%" PRIu32 "},",
+                priority_names[i], mq.enqueued[i], mq.dropped[i]);
+    }
+    ok = appendf(buf, sizeof(buf), &len,
+                 "\"bytes\":%" PRIu32 ",\"max_bytes\":%" PRIu32 ",\"budget\":%d"
+                 ",\"enqueue_us\":{\"last\":%" PRIu32 ",\"max\":%" PRIu32 ",\"avg\":%" PRIu32 "}}"
+                 ",\"rx_handler_us\":{\"last\":%" PRIu32 ",\"max\":%" PRIu32 "}"
+                 ",\"router\":{\"delivered\":%" PRIu32 ",\"reassembled\":%" PRIu32 ",\"dropped_oversize\":%" PRIu32
+                 ",\"dropped_arena\":%" PRIu32 ",\"dropped_sequence\":%" PRIu32 ",\"dropped_topic\":%" PRIu32 "}"
+                 ",\"fan\":{\"posted\":%" PRIu32 ",\"applied\":%" PRIu32 ",\"coalesced\":%" PRIu32
+                 ",\"superseded\":%" PRIu32 ",\"reported\":%" PRIu32 ",\"fade_timeouts\":%" PRIu32 "}}",
+                 mq.outbox_bytes, mq.outbox_max_bytes, MQTT_OUTBOX_BUDGET, mq.enqueue_last_us, mq.enqueue_max_us,
+                 enqueued ? (uint32_t)(mq.enqueue_total_us / enqueued) : 0,
+                 mq.data_handler_last_us, mq.data_handler_max_us,
+                 router.delivered, router.reassembled, router.dropped_oversize,
+                 router.dropped_arena, router.dropped_sequence, router.dropped_topic,
+                 fan.posted, fan.applied, fan.coalesced, fan.superseded,
+                 fan.reported, fan.fade_timeouts);
+    if (!ok) {
+        return;
+    }
+    if (device_topic_format(topic, sizeof(topic), DEVICE_SCOPE_SELF, telemetry_stats_t) < 0) {
+        return;
+    }
+    mqtt_manager_enqueue(topic, buf, (int)len, 0, 0, MQTT_PRIORITY_BULK);
+}
+
+// Appends one record in the current encoding, -1 if it doesn't fit
+static int encode_record(char *buf, size_t size, const telemetry_record_t *rec, bool binary) {
+    if (binary) {
+        return telemetry_encode_record((uint8_t *)buf, size, rec);
+    }
+    return telemetry_format_record(buf, size, rec);
+}
+
+/**
+ * @brief Publishes one sample cycle as a single telemetry record, if the
+ * publish policy lets it through. Records that can't go out now are kept in
+ * the telemetry store for replay_backlog().
+ * @return true if the record was published now.
+ */
+static bool publish_telemetry(telemetry_record_t *rec) {
+    static char buf[RECORD_TEXT_MAX];  // only used by the publish task
+    static uint32_t seq = 0;
+    char topic[80];
+    int current, target;
+
+    fan_get_duty(&current, &target);
+    rec->timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    rec->fan_on = fan_actuator_is_on();
+    rec->fan_duty = (uint8_t)current;
+
+    publish_reason_t reason = publish_policy_check(rec, rec->timestamp_ms);
+    if (reason == PUBLISH_REASON_NONE) {
+        return false;
+    }
+    // consecutive for published records, so the receiver can spot losses
+    rec->seq = seq++;
+    ESP_LOGD(TAG, "Publishing record %" PRIu32 " (%s)", rec->seq, publish_reason_name(reason));
+
+    if (!mqtt_manager_is_connected()) {
+        telemetry_store_push(rec);
+        return false;
+    }
+
+    bool binary = telemetry_encoding == TELEMETRY_ENCODING_BINARY;
+    int len = encode_record(buf, sizeof(buf), rec, binary);
+    if (len < 0) {
+        ESP_LOGE(TAG, "Telemetry record does not fit in %u bytes.", (unsigned)sizeof(buf));
+        return false;
+    }
+    if (device_topic_format(topic, sizeof(topic), DEVICE_SCOPE_SELF, binary ? telemetry_bin_t : telemetry_t) < 0) {
+        return false;
+    }
+    // refused when the outbox is over budget: stored, and merged into a replay batch later
+    if (mqtt_manager_enqueue(topic, buf, len, 0, 0, MQTT_PRIORITY_TELEMETRY) < 0) {
+        telemetry_store_push(rec);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Publishes the oldest stored records as one batch message: a JSON
+ * array, or packed records back to back in binary mode.
+ * @return true if records are left to replay.
+ */
+static bool replay_backlog(void) {
+    static telemetry_record_t recs[TELEMETRY_REPLAY_BATCH];  // only used by the publish task
+    static char buf[TELEMETRY_REPLAY_BATCH * RECORD_TEXT_MAX + 2];
+    char topic[80];
+    size_t len = 0;
+
+    if (!mqtt_manager_is_connected() || telemetry_store_pending() == 0) {
+        return false;
+    }
+    size_t n = telemetry_store_peek(recs, TELEMETRY_REPLAY_BATCH);
+    bool binary = telemetry_encoding == TELEMETRY_ENCODING_BINARY;
+
+    if (!binary) {
+        buf[len++] = '[';
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!binary && i > 0) {
+            buf[len++] = ',';
+        }
+        int rec_len = encode_record(buf + len, sizeof(buf) - len - 1, &recs[i], binary);
+        if (rec_len < 0) {
+            return true;
+        }
+        len += rec_len;
+    }
+    if (!binary) {
+        buf[len++] = ']';
+    }
+
+    if (n > 0) {
+        if (device_topic_format(topic, sizeof(topic), DEVICE_SCOPE_SELF,
+                                binary ? telemetry_bin_batch_t : telemetry_batch_t) < 0) {
+            return false;
+        }
+        if (mqtt_manager_enqueue(topic, buf, (int)len, 0, 0, MQTT_PRIORITY_BULK) < 0) {
+            return true;    // try again next time, nothing is popped
+        }
+    }
+    // also skips unreadable slots when n is 0
+    telemetry_store_pop();
+    ESP_LOGI(TAG, "Replayed %u stored records, %u left", (unsigned)n, (unsigned)telemetry_store_pending());
+    return telemetry_store_pending() > 0;
+}
+
+void sensor_publish_task(void *pvParameters) {
+    ESP_LOGI(TAG, "Sensor Publish Task started.");
+    sensor_reading_t readings[SENSOR_COUNT];
+    esp_err_t status[SENSOR_COUNT];
+    telemetry_record_t rec = { .sensor_count = SENSOR_COUNT };
+
+    const sensor_filter_config_t temp_cfg = {
+        .ema_alpha_q8 = SENSOR_FILTER_EMA_ALPHA_Q8,
+        .max_rate_per_s = SENSOR_FILTER_TEMP_MAX_RATE,
+        .reject_limit = SENSOR_FILTER_REJECT_LIMIT,
+    };
+    const sensor_filter_config_t humidity_cfg = {
+        .ema_alpha_q8 = SENSOR_FILTER_EMA_ALPHA_Q8,
+        .max_rate_per_s = SENSOR_FILTER_HUMIDITY_MAX_RATE,
+        .reject_limit = SENSOR_FILTER_REJECT_LIMIT,
+    };
+    for (size_t i = 0; i < SENSOR_COUNT; i++) {
+        sensor_filter_init(&temp_filters[i], &temp_cfg);
+        sensor_filter_init(&humidity_filters[i], &humidity_cfg);
+    }
+
+    int64_t link_published_us = esp_timer_get_time();
+    int64_t next_sample_us = link_published_us + (int64_t)TELEMETRY_SAMPLE_INTERVAL_MS * 1000;
 
     while(1) {
-        vTaskDelay(pdMS_TO_TICKS(5000));
-        if(dht_read_float_data(DHT_TYPE_DHT11, dht_pin, &humidity_reading_global, &temp_reading_global) == ESP_OK) {
-            ESP_LOGD(TAG, "DHT: Temp=%.1fC, Hum=%.1f%%", temp_reading_global, humidity_reading_global);
-            snprintf(sens_buf, sizeof(sens_buf),"%.1f", humidity_reading_global);
-            mqtt_manager_publish(humidity_t, sens_buf, 0, 0, 0);
-            snprintf(sens_buf, sizeof(sens_buf),"%.1f", temp_reading_global);
-            mqtt_manager_publish(temp_t, sens_buf, 0, 0, 0);
-        } else {
-            ESP_LOGE(TAG, "Failed to read DHT sensor.");
+        // replay the backlog in paced batches while waiting for the next sample
+        int64_t wait_ms = (next_sample_us - esp_timer_get_time()) / 1000;
+        if (wait_ms > 0) {
+            if (replay_backlog() && wait_ms > TELEMETRY_REPLAY_INTERVAL_MS) {
+                wait_ms = TELEMETRY_REPLAY_INTERVAL_MS;
+            }
+            vTaskDelay(pdMS_TO_TICKS(wait_ms) ? pdMS_TO_TICKS(wait_ms) : 1);
+            continue;
+        }
+        next_sample_us += (int64_t)TELEMETRY_SAMPLE_INTERVAL_MS * 1000;
+
+        if (esp_timer_get_time() - link_published_us >= (int64_t)DHT_LINK_PUBLISH_INTERVAL_MS * 1000) {
+            link_published_us = esp_timer_get_time();
+            publish_dht_link_stats();
+            publish_telemetry_stats();
+        }
+        sensor_read_all(sensors, SENSOR_COUNT, readings, status);
+        int64_t now_us = esp_timer_get_time();
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (size_t i = 0; i < SENSOR_COUNT; i++) {
+            rec.sensors[i].valid = false;
+            if (status[i] != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to read sensor %u (%s): %s", (unsigned)i, sensors[i].driver->name, esp_err_to_name(status[i]));
+                if (last_good_us[i]) {
+                    ESP_LOGW(TAG, "Last good value of sensor %u is %" PRId64 " ms old.", (unsigned)i, (now_us - last_good_us[i]) / 1000);
+                }
+                continue;
+            }
+            last_good_us[i] = now_us;
+            uint32_t now_ms = (uint32_t)(now_us / 1000);
+            if (!sensor_filter_update(&temp_filters[i], readings[i].temperature, now_ms)) {
+                ESP_LOGW(TAG, "Sensor[%u]: temperature %d/10C rejected as outlier.", (unsigned)i, readings[i].temperature);
+            }
+            if (!sensor_filter_update(&humidity_filters[i], readings[i].humidity, now_ms)) {
+                ESP_LOGW(TAG, "Sensor[%u]: humidity %d/10%% rejected as outlier.", (unsigned)i, readings[i].humidity);
+            }
+            if (i == 0) {
+                humidity_reading_global = humidity_filters[i].filtered;
+                temp_reading_global = temp_filters[i].filtered;
+            }
+            ESP_LOGD(TAG, "Sensor[%u]: Temp=%d/10C (raw %d), Hum=%d/10%% (raw %d)", (unsigned)i,
+                     temp_filters[i].filtered, readings[i].temperature,
+                     humidity_filters[i].filtered, readings[i].humidity);
+
+            rec.sensors[i] = (telemetry_sensor_t){
+                .valid = true,
+                .temperature = temp_filters[i].filtered,
+                .humidity = humidity_filters[i].filtered,
+                .temperature_raw = readings[i].temperature,
+                .humidity_raw = readings[i].humidity,
+            };
+
+        }
+        // legacy topics follow the same policy as the record
+        if (publish_telemetry(&rec) && TELEMETRY_LEGACY_TOPICS) {
+            for (size_t i = 0; i < SENSOR_COUNT; i++) {
+                if (rec.sensors[i].valid) {
+                    publish_sensor_value(humidity_t, i, rec.sensors[i].humidity);
+                    publish_sensor_value(temp_t, i, rec.sensors[i].temperature);
+                    publish_sensor_value(humidity_raw_t, i, rec.sensors[i].humidity_raw);
+                    publish_sensor_value(temp_raw_t, i, rec.sensors[i].temperature_raw);
+                }
+            }
+        }
+        ESP_LOGD(TAG, "Sample: filter+format+publish %" PRIu32 " cycles, stack high-water %u bytes",
+                 esp_cpu_get_cycle_count() - start, (unsigned)uxTaskGetStackHighWaterMark(NULL));
+    }
+}
+
+static void on_policy(const mqtt_route_msg_t *msg, void *arg) {
+    if (publish_policy_configure(msg->data, msg->data_len) != ESP_OK) {
+        ESP_LOGW(TAG, "Rejected publish policy: %.*s", msg->data_len < 64 ? msg->data_len : 64, msg->data);
+    }
+}
+
+static void on_telemetry_encoding(const mqtt_route_msg_t *msg, void *arg) {
+    if (msg->data_len == 6 && memcmp(msg->data, "binary", 6) == 0) {
+        telemetry_encoding = TELEMETRY_ENCODING_BINARY;
+    } else if (msg->data_len == 4 && memcmp(msg->data, "text", 4) == 0) {
+        telemetry_encoding = TELEMETRY_ENCODING_TEXT;
+    } else {
+        ESP_LOGW(TAG, "Unknown telemetry encoding: %.*s", msg->data_len < 16 ? msg->data_len : 16, msg->data);
+        return;
+    }
+    ESP_LOGI(TAG, "Telemetry encoding: %s", telemetry_encoding == TELEMETRY_ENCODING_BINARY ? "binary" : "text");
+}
+
+/**
+ * @brief Subscribes to the command tree of every scope, one wildcard filter
+ * each; the routes below them need no subscription of their own. Also
+ * registers the telemetry policy and encoding commands.
+ */
+static esp_err_t register_command_subscriptions(void) {
+    for (int scope = 0; scope < DEVICE_SCOPE_MAX; scope++) {
+        const char *filter = device_topic(scope, cmd_t);
+        esp_err_t ret = mqtt_router_subscribe(filter, MQTT_COMMAND_QOS);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        // the publish policy can be tuned for a device, a group or the fleet
+        const char *policy = device_topic(scope, policy_t);
+        ret = mqtt_router_add(&(mqtt_route_config_t){
+            .filter = policy,
+            .payload = MQTT_PAYLOAD_RAW,
+            .handler = on_policy,
+        });
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    // the encoding is chosen per device, not per group or fleet
+    const char *encoding = device_topic(DEVICE_SCOPE_SELF, encoding_t);
+    return mqtt_router_register(encoding, 0, MQTT_PAYLOAD_RAW, on_telemetry_encoding, NULL);
+}
+
+/**
+ * @brief Gives the telemetry topics MQTT 5 topic aliases (MQTT_PROTOCOL_V5).
+ */
+static void register_topic_aliases(void) {
+    static const char *const suffixes[] = {
+        telemetry_bin_t, telemetry_t, telemetry_bin_batch_t, telemetry_batch_t, telemetry_stats_t, dht_link_t,
+    };
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        if (mqtt_manager_add_topic_alias(device_topic(DEVICE_SCOPE_SELF, suffixes[i])) != ESP_OK) {
+            return;
         }
     }
 }
@@ -75,21 +481,49 @@ void app_main(void) {
       ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    ESP_ERROR_CHECK(device_topics_init());
+    telemetry_store_init(TELEMETRY_STORE_PARTITION);
+    publish_policy_init(&(const publish_policy_config_t){
+        .deadband = {
+            [PUBLISH_METRIC_TEMPERATURE] = {
+                .abs = PUBLISH_POLICY_TEMP_ABS,
+                .rel_permille = PUBLISH_POLICY_TEMP_REL,
+                .jump = PUBLISH_POLICY_TEMP_JUMP,
+            },
+            [PUBLISH_METRIC_HUMIDITY] = {
+                .abs = PUBLISH_POLICY_HUMIDITY_ABS,
+                .rel_permille = PUBLISH_POLICY_HUMIDITY_REL,
+                .jump = PUBLISH_POLICY_HUMIDITY_JUMP,
+            },
+        },
+        .min_interval_ms = PUBLISH_POLICY_MIN_INTERVAL_MS,
+        .heartbeat_ms = PUBLISH_POLICY_HEARTBEAT_MS,
+    });
 
     if (initialize_system_peripherals() != ESP_OK) {
         ESP_LOGE(TAG, "Peripheral initialization failed. Application might not function correctly.");
     }
 
+    // Sampling doesn't depend on the network: without it records go to the
+    // telemetry store, and are replayed once the client connects
     if (wifi_manager_init_sta() == ESP_OK) {
         ESP_LOGI(TAG, "Wi-Fi initialized and connected.");
-        mqtt_manager_start();
-        if (xTaskCreate(dht_publish_task, "DHT_PublishTask", 3072, NULL, tskIDLE_PRIORITY + 4, NULL) != pdPASS) {
-            ESP_LOGE(TAG, "Failed to create DHT_PublishTask.");
-        } else {
-            ESP_LOGI(TAG, "DHT_PublishTask created successfully.");
-        }
     } else {
-        ESP_LOGE(TAG, "Failed to initialize Wi-Fi.");
+        ESP_LOGE(TAG, "Wi-Fi not connected, retrying in the background.");
+    }
+    if (register_command_subscriptions() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register command subscriptions.");
+    }
+    if (fan_actuator_register_routes() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register fan command routes.");
+    }
+    register_topic_aliases();
+    // the client keeps reconnecting until Wi-Fi and the broker are up
+    mqtt_manager_start();
+    if (xTaskCreate(sensor_publish_task, "Sensor_PublishTask", 4096, NULL, tskIDLE_PRIORITY + 4, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create Sensor_PublishTask.");
+    } else {
+        ESP_LOGI(TAG, "Sensor_PublishTask created successfully.");
     }
 
     ESP_LOGI(TAG, "app_main finished setup.");
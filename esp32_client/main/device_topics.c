@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+
+#include "app_config.h"
+#include "device_topics.h"
+
+static const char *TAG = "DEVICE_TOPICS";
+
+static char id[DEVICE_ID_MAX_LEN + 1];
+static char prefixes[DEVICE_SCOPE_MAX][DEVICE_ID_MAX_LEN + 24];
+static char topics[DEVICE_TOPICS_MAX][DEVICE_TOPIC_MAX_LEN];
+static int topic_count = 0;
+
+esp_err_t device_topics_init(void) {
+    if (strlen(DEVICE_ID) > 0) {
+        snprintf(id, sizeof(id), "%s", DEVICE_ID);
+    } else {
+        uint8_t mac[6];
+        esp_err_t ret = esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read MAC: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        snprintf(id, sizeof(id), "%02x%02x%02x%02x%02x%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+
+    snprintf(prefixes[DEVICE_SCOPE_SELF], sizeof(prefixes[0]), "%s/%s/", device_root_t, id);
+    snprintf(prefixes[DEVICE_SCOPE_GROUP], sizeof(prefixes[0]), "%s/%s/", group_root_t, DEVICE_GROUP);
+    snprintf(prefixes[DEVICE_SCOPE_ALL], sizeof(prefixes[0]), "%s/", broadcast_root_t);
+    ESP_LOGI(TAG, "Device id %s, group %s", id, DEVICE_GROUP);
+    return ESP_OK;
+}
+
+const char *device_id(void) {
+    return id;
+}
+
+int device_topic_format(char *buf, size_t size, device_scope_t scope, const char *suffix) {
+    if ((unsigned)scope >= DEVICE_SCOPE_MAX) {
+        return -1;
+    }
+    int len = snprintf(buf, size, "%s%s", prefixes[scope], suffix);
+    return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
+
+const char *device_topic(device_scope_t scope, const char *suffix) {
+    if (topic_count == DEVICE_TOPICS_MAX) {
+        ESP_LOGE(TAG, "More than %d topics, raise DEVICE_TOPICS_MAX for %s", DEVICE_TOPICS_MAX, suffix);
+        abort();
+    }
+    char *out = topics[topic_count];
+    if (device_topic_format(out, DEVICE_TOPIC_MAX_LEN, scope, suffix) < 0) {
+        ESP_LOGE(TAG, "Topic for %s longer than DEVICE_TOPIC_MAX_LEN", suffix);
+        abort();
+    }
+
+    // the same topic is often asked for by several modules
+    for (int i = 0; i < topic_count; i++) {
+        if (strcmp(topics[i], out) == 0) {
+            return topics[i];
+        }
+    }
+    topic_count++;
+    return out;
+}
@@ -0,0 +1,60 @@
+#ifndef DEVICE_TOPICS_H
+#define DEVICE_TOPICS_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+// Longest device id, 12 hex digits when derived from the MAC
+#define DEVICE_ID_MAX_LEN 32
+// Distinct topics device_topic() can keep; the firmware asks for 24
+#define DEVICE_TOPICS_MAX 28
+// Longest kept topic with its terminator: the longest prefix plus "cmd/telemetry/encoding"
+#define DEVICE_TOPIC_MAX_LEN 80
+
+/**
+ * @brief Topic trees a device listens on or publishes to.
+ */
+typedef enum {
+    DEVICE_SCOPE_SELF = 0,  // device_root_t "/<id>/", this device only
+    DEVICE_SCOPE_GROUP,     // group_root_t "/<DEVICE_GROUP>/", every device of the group
+    DEVICE_SCOPE_ALL,       // broadcast_root_t "/", the whole fleet
+    DEVICE_SCOPE_MAX,
+} device_scope_t;
+
+/**
+ * @brief Sets up the device id and the topic prefixes.
+ * The id is DEVICE_ID, or the station MAC in lowercase hex when DEVICE_ID is
+ * empty. Call once before anything builds a topic.
+ * @return ESP_OK, or the esp_read_mac() error.
+ */
+esp_err_t device_topics_init(void);
+
+/**
+ * @brief Gets the device id, "" before device_topics_init().
+ */
+const char *device_id(void);
+
+/**
+ * @brief Gets the full topic for a suffix, e.g. "devices/<id>/fan/read" for
+ * (DEVICE_SCOPE_SELF, read_t). The string is kept in a static table and stays
+ * valid, so it can be handed to the MQTT router. The table is not locked:
+ * call during setup, before mqtt_manager_start().
+ * Aborts when more than DEVICE_TOPICS_MAX topics are asked for or one is
+ * longer than DEVICE_TOPIC_MAX_LEN: the topic set is fixed at build time, so
+ * the first boot finds it.
+ *
+ * @param scope Topic tree.
+ * @param suffix Topic below the scope prefix.
+ * @return Topic, never NULL.
+ */
+const char *device_topic(device_scope_t scope, const char *suffix);
+
+/**
+ * @brief Writes the full topic for a suffix into a caller buffer.
+ * Safe from any task.
+ *
+ * @return Topic length, or -1 if buf is too small.
+ */
+int device_topic_format(char *buf, size_t size, device_scope_t scope, const char *suffix);
+
+#endif // DEVICE_TOPICS_H
@@ -39,10 +39,18 @@
  * BSD Licensed as described in the file LICENSE
  */
 #include "dht.h"
+#include "dht_decode.h"
+#include "dht_rmt.h"
+#include "dht_edge.h"
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <string.h>
+#include <inttypes.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 //#include <ets_sys.h>
 #include <esp32/rom/ets_sys.h>
 //#include <esp_idf_lib_helpers.h>
@@ -52,6 +60,11 @@
 #define DHT_DATA_BITS 40
 #define DHT_DATA_BYTES (DHT_DATA_BITS / 8)
 
+// Worker task serving dht_read_start()
+#define DHT_ASYNC_QUEUE_LEN 4
+#define DHT_ASYNC_TASK_STACK 3072
+#define DHT_ASYNC_TASK_PRIORITY (tskIDLE_PRIORITY + 5)
+
 /*
  *  Note:
  *  A suitable pull-up resistor should be connected to the selected GPIO line
@@ -80,17 +93,6 @@
  *
  */
 
-#define CHECK_ARG(VAL) do { if (!(VAL)) return ESP_ERR_INVALID_ARG; } while (0)
-
-#define CHECK_LOGE(x, msg, ...) do { \
-        esp_err_t __; \
-        if ((__ = x) != ESP_OK) { \
-            PORT_EXIT_CRITICAL(); /* Ensure this is defined as above */ \
-            ESP_LOGE(TAG, msg, ## __VA_ARGS__); \
-            return __; \
-        } \
-    } while (0)
-
 static const char *TAG = "dht";
 
 // For ESP32 target
@@ -98,17 +100,104 @@ static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
 #define PORT_ENTER_CRITICAL() portENTER_CRITICAL(&mux)
 #define PORT_EXIT_CRITICAL() portEXIT_CRITICAL(&mux)
 
+// Capture backend per pin, DHT_CAPTURE_POLLING unless dht_init() says otherwise
+static dht_capture_mode_t capture_modes[GPIO_NUM_MAX];
+
+typedef struct
+{
+    dht_sensor_type_t sensor_type;
+    gpio_num_t pin;
+    dht_read_cb_t cb;
+    void *arg;
+} dht_async_request_t;
+
+static QueueHandle_t async_queue = NULL;
+static dht_stats_t stats;
+
+// Outcome of one physical read, accounted by dht_record_read()
+typedef struct
+{
+    uint32_t critical_us;   // time interrupts were masked
+    uint32_t latency_us;    // whole read, start pulse included
+    dht_fail_t fail;        // DHT_FAIL_MAX until a failure is classified
+    dht_decoder_t dec;      // frame as decoded, for the pulse histograms
+} dht_read_info_t;
+
+static const char *const fail_names[DHT_FAIL_MAX] = {
+    [DHT_FAIL_PHASE_B] = "phase_b",
+    [DHT_FAIL_PHASE_C] = "phase_c",
+    [DHT_FAIL_PHASE_D] = "phase_d",
+    [DHT_FAIL_BIT_LOW] = "bit_low",
+    [DHT_FAIL_BIT_HIGH] = "bit_high",
+    [DHT_FAIL_NO_RESPONSE] = "no_response",
+    [DHT_FAIL_TRUNCATED] = "truncated",
+    [DHT_FAIL_TIMING] = "timing",
+    [DHT_FAIL_CHECKSUM] = "checksum",
+    [DHT_FAIL_OTHER] = "other",
+};
+
+// Last good value store, see dht_read_cached()
+typedef struct
+{
+    int64_t good_us;        // esp_timer time of the last good read, 0 if none
+    int64_t attempt_us;     // esp_timer time of the last physical read, 0 if none
+    esp_err_t status;       // result of the last physical read
+    int16_t humidity;
+    int16_t temperature;
+} dht_cache_entry_t;
+
+static dht_cache_entry_t cache[GPIO_NUM_MAX];
+// Serializes physical reads issued by dht_read_cached() so callers coalesce
+static SemaphoreHandle_t cache_lock = NULL;
+
 #define CHECK_ARG(VAL) do { if (!(VAL)) return ESP_ERR_INVALID_ARG; } while (0)
 
-#define CHECK_LOGE(x, msg, ...) do { \
+/* Leave the critical section entered by dht_fetch_data() and record how long
+ * it was held. Expects 'critical_start' and 'info' in scope. */
+#define DHT_EXIT_CRITICAL() do { \
+        info->critical_us = (uint32_t)(esp_timer_get_time() - critical_start); \
+        PORT_EXIT_CRITICAL(); \
+    } while (0)
+
+#define CHECK_LOGE(x, phase, msg, ...) do { \
         esp_err_t __; \
         if ((__ = x) != ESP_OK) { \
-            PORT_EXIT_CRITICAL(); \
+            DHT_EXIT_CRITICAL(); \
+            info->fail = phase; \
             ESP_LOGE(TAG, msg, ## __VA_ARGS__); \
             return __; \
         } \
     } while (0)
 
+/**
+ * Wait until esp_timer reaches 'deadline' without masking interrupts.
+ * Whole ticks are slept, only the remainder is busy-waited so phase 'A' is
+ * not stretched by tick granularity.
+ */
+static void dht_delay_until(int64_t deadline)
+{
+    int64_t remaining = deadline - esp_timer_get_time();
+    if (remaining <= 0)
+        return;
+
+    // vTaskDelay(n) sleeps at most n ticks
+    TickType_t ticks = remaining / (portTICK_PERIOD_MS * 1000);
+    if (ticks)
+        vTaskDelay(ticks);
+
+    remaining = deadline - esp_timer_get_time();
+    if (remaining > 0)
+        ets_delay_us((uint32_t)remaining);
+}
+
+/**
+ * Hold the line low for phase 'A' without masking interrupts.
+ */
+static void dht_start_pulse_delay(dht_sensor_type_t sensor_type)
+{
+    dht_delay_until(esp_timer_get_time() + dht_decode_get_timing(sensor_type)->start_pulse_us);
+}
+
 
 /**
  * Wait specified time for pin to go to a specified state.
@@ -141,107 +230,335 @@ static esp_err_t dht_await_pin_state(gpio_num_t pin, uint32_t timeout,
 
 /**
  * Request data from DHT and read raw bit stream.
- * The function call should be protected from task switching.
+ * Only the response window (phases 'B'-'D' and the data bits) runs in a
+ * critical section, its length and the failing phase are returned in 'info'.
+ * The pulse durations are recorded there and decoded afterwards.
  * Return false if error occurred.
  */
-static inline esp_err_t dht_fetch_data(dht_sensor_type_t sensor_type, gpio_num_t pin, uint8_t data[DHT_DATA_BYTES])
+static inline esp_err_t dht_fetch_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        uint8_t data[DHT_DATA_BYTES], dht_read_info_t *info)
 {
-    uint32_t low_duration;
-    uint32_t high_duration;
+    uint32_t low_duration[DHT_DATA_BITS];
+    uint32_t high_duration[DHT_DATA_BITS];
+    int64_t critical_start;
 
     // Phase 'A' pulling signal low to initiate read sequence
     gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
     gpio_set_level(pin, 0);
-    ets_delay_us(sensor_type == DHT_TYPE_SI7021 ? 500 : 20000);
+    dht_start_pulse_delay(sensor_type);
+
+    PORT_ENTER_CRITICAL();
+    critical_start = esp_timer_get_time();
     gpio_set_level(pin, 1);
 
     // Step through Phase 'B', 40us
-    CHECK_LOGE(dht_await_pin_state(pin, 40, 0, NULL),
+    CHECK_LOGE(dht_await_pin_state(pin, 40, 0, NULL), DHT_FAIL_PHASE_B,
             "Initialization error, problem in phase 'B'");
     // Step through Phase 'C', 88us
-    CHECK_LOGE(dht_await_pin_state(pin, 88, 1, NULL),
+    CHECK_LOGE(dht_await_pin_state(pin, 88, 1, NULL), DHT_FAIL_PHASE_C,
             "Initialization error, problem in phase 'C'");
     // Step through Phase 'D', 88us
-    CHECK_LOGE(dht_await_pin_state(pin, 88, 0, NULL),
+    CHECK_LOGE(dht_await_pin_state(pin, 88, 0, NULL), DHT_FAIL_PHASE_D,
             "Initialization error, problem in phase 'D'");
 
     // Read in each of the 40 bits of data...
     for (int i = 0; i < DHT_DATA_BITS; i++)
     {
-        CHECK_LOGE(dht_await_pin_state(pin, 65, 1, &low_duration),
+        CHECK_LOGE(dht_await_pin_state(pin, 65, 1, &low_duration[i]), DHT_FAIL_BIT_LOW,
                 "LOW bit timeout");
-        CHECK_LOGE(dht_await_pin_state(pin, 75, 0, &high_duration),
+        CHECK_LOGE(dht_await_pin_state(pin, 75, 0, &high_duration[i]), DHT_FAIL_BIT_HIGH,
                 "HIGH bit timeout");
+    }
+
+    DHT_EXIT_CRITICAL();
+
+    /* Polled durations count loop iterations, not real time, so they are
+     * only compared against each other and not against the timing table. */
+    dht_decoder_t *dec = &info->dec;
+    dht_decoder_reset(dec, NULL);
+    for (int i = 0; i < DHT_DATA_BITS; i++)
+    {
+        dht_decoder_feed(dec, 0, low_duration[i] + 1);
+        dht_decoder_feed(dec, 1, high_duration[i] + 1);
+    }
+    // the line went low again after the last bit
+    dht_decoder_feed(dec, 0, 1);
+    if (dht_decoder_finish(dec, data) == DHT_DECODE_ERR_TRUNCATED)
+        return ESP_ERR_INVALID_RESPONSE;
+
+    return ESP_OK;
+}
+
+/**
+ * Arm the capture backend of a pin and release the line, ending phase 'A'.
+ */
+static esp_err_t dht_capture_release(gpio_num_t pin, dht_capture_mode_t mode)
+{
+    esp_err_t res = mode == DHT_CAPTURE_RMT ? dht_rmt_arm(pin) : dht_edge_arm(pin);
+    gpio_set_level(pin, 1);
+    if (res != ESP_OK)
+        ESP_LOGE(TAG, "Failed to arm capture on pin %d: %s", pin, esp_err_to_name(res));
+    return res;
+}
+
+static esp_err_t dht_capture_collect(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        dht_capture_mode_t mode, uint8_t data[DHT_DATA_BYTES], dht_decoder_t *dec)
+{
+    return mode == DHT_CAPTURE_RMT
+        ? dht_rmt_collect(sensor_type, pin, data, dec)
+        : dht_edge_collect(sensor_type, pin, data, dec);
+}
 
-        uint8_t b = i / 8;
-        uint8_t m = i % 8;
-        if (!m)
-            data[b] = 0;
+/**
+ * Request data from DHT and let the capture backend of the pin (RMT channel
+ * or edge ISR) record the response. Interrupts stay enabled, the bits are
+ * decoded once the frame has ended.
+ */
+static esp_err_t dht_fetch_data_captured(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        dht_capture_mode_t mode, uint8_t data[DHT_DATA_BYTES], dht_decoder_t *dec)
+{
+    // Phase 'A' pulling signal low to initiate read sequence. The pin keeps
+    // its input enabled so the backend sees the line while it is driven.
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_level(pin, 0);
+    dht_start_pulse_delay(sensor_type);
 
-        data[b] |= (high_duration > low_duration) << (7 - m);
+    // Phases 'B'-'D' and the data bits are recorded by the backend
+    esp_err_t res = dht_capture_release(pin, mode);
+    if (res != ESP_OK)
+        return res;
+
+    return dht_capture_collect(sensor_type, pin, mode, data, dec);
+}
+
+/**
+ * Verify the checksum of a fetched frame and convert it.
+ */
+static esp_err_t dht_convert_frame(dht_sensor_type_t sensor_type, const uint8_t data[DHT_DATA_BYTES],
+        int16_t *humidity, int16_t *temperature)
+{
+    if (dht_decode_check(data) != DHT_DECODE_OK)
+    {
+        ESP_LOGE(TAG, "Checksum failed, invalid data received from sensor");
+        return ESP_ERR_INVALID_CRC;
     }
 
+    if (humidity)
+        *humidity = dht_decode_convert(sensor_type, data[0], data[1]);
+    if (temperature)
+        *temperature = dht_decode_convert(sensor_type, data[2], data[3]);
+
     return ESP_OK;
 }
 
+static void dht_read_info_init(dht_read_info_t *info)
+{
+    info->critical_us = 0;
+    info->latency_us = 0;
+    info->fail = DHT_FAIL_MAX;
+    dht_decoder_reset(&info->dec, NULL);
+}
+
 /**
- * Pack two data bytes into single value and take into account sign bit.
+ * Map a read error to a failure reason unless the polling path already did.
  */
-static inline int16_t dht_convert_data(dht_sensor_type_t sensor_type, uint8_t msb, uint8_t lsb)
+static dht_fail_t dht_classify_failure(esp_err_t result, const dht_read_info_t *info)
 {
-    int16_t data;
+    if (info->fail != DHT_FAIL_MAX)
+        return info->fail;
 
-    if (sensor_type == DHT_TYPE_DHT11)
+    switch (result)
     {
-        data = msb * 10;
+        case ESP_ERR_INVALID_CRC:
+            return DHT_FAIL_CHECKSUM;
+        case ESP_ERR_TIMEOUT:
+            return DHT_FAIL_NO_RESPONSE;
+        case ESP_ERR_INVALID_RESPONSE:
+            switch (info->dec.status)
+            {
+                case DHT_DECODE_ERR_NO_RESPONSE:
+                    return DHT_FAIL_PHASE_C;
+                case DHT_DECODE_ERR_TIMING:
+                    return DHT_FAIL_TIMING;
+                default:
+                    return DHT_FAIL_TRUNCATED;
+            }
+        default:
+            return DHT_FAIL_OTHER;
     }
+}
+
+static inline unsigned dht_hist_bin(uint16_t us)
+{
+    unsigned bin = us / DHT_HIST_BIN_US;
+    return bin < DHT_HIST_BINS ? bin : DHT_HIST_BINS - 1;
+}
+
+/**
+ * Account a finished physical read and update the last good value store.
+ */
+static void dht_record_read(gpio_num_t pin, esp_err_t result, int16_t humidity, int16_t temperature,
+        const dht_read_info_t *info)
+{
+    int64_t now = esp_timer_get_time();
+    dht_cache_entry_t *e = &cache[pin];
+    uint16_t low_us[DHT_DATA_BITS], high_us[DHT_DATA_BITS];
+    // bits are counted from the sensor response, partial frames included
+    size_t bits = dht_decoder_get_pulses(&info->dec, low_us, high_us);
+    dht_fail_t fail = result == ESP_OK ? DHT_FAIL_MAX : dht_classify_failure(result, info);
+
+    PORT_ENTER_CRITICAL();
+    stats.reads++;
+    stats.last_critical_us = info->critical_us;
+    if (info->critical_us > stats.max_critical_us)
+        stats.max_critical_us = info->critical_us;
+    if (result == ESP_OK)
+        stats.good_reads++;
     else
+        stats.failures[fail]++;
+    for (size_t i = 0; i < bits; i++)
+    {
+        stats.low_hist[dht_hist_bin(low_us[i])]++;
+        stats.high_hist[dht_hist_bin(high_us[i])]++;
+    }
+    stats.last_latency_us = info->latency_us;
+    if (stats.reads == 1 || info->latency_us < stats.min_latency_us)
+        stats.min_latency_us = info->latency_us;
+    if (info->latency_us > stats.max_latency_us)
+        stats.max_latency_us = info->latency_us;
+    stats.total_latency_us += info->latency_us;
+
+    e->attempt_us = now;
+    e->status = result;
+    if (result == ESP_OK)
     {
-        data = msb & 0x7F;
-        data <<= 8;
-        data |= lsb;
-        if (msb & BIT(7))
-            data = -data;       // convert it to negative
+        e->good_us = now;
+        e->humidity = humidity;
+        e->temperature = temperature;
     }
+    PORT_EXIT_CRITICAL();
+}
 
-    return data;
+static void dht_async_task(void *pvParameters)
+{
+    dht_async_request_t req;
+    dht_reading_t reading;
+
+    while (1)
+    {
+        if (xQueueReceive(async_queue, &req, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        reading.sensor_type = req.sensor_type;
+        reading.pin = req.pin;
+        reading.humidity = 0;
+        reading.temperature = 0;
+        reading.status = dht_read_data(req.sensor_type, req.pin, &reading.humidity, &reading.temperature);
+        req.cb(&reading, req.arg);
+    }
+}
+
+static esp_err_t dht_async_init(void)
+{
+    if (async_queue)
+        return ESP_OK;
+
+    QueueHandle_t queue = xQueueCreate(DHT_ASYNC_QUEUE_LEN, sizeof(dht_async_request_t));
+    if (!queue)
+        return ESP_ERR_NO_MEM;
+
+    async_queue = queue;
+    if (xTaskCreate(dht_async_task, "dht", DHT_ASYNC_TASK_STACK, NULL, DHT_ASYNC_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        async_queue = NULL;
+        vQueueDelete(queue);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t dht_init(gpio_num_t pin, dht_capture_mode_t mode)
+{
+    CHECK_ARG(GPIO_IS_VALID_OUTPUT_GPIO(pin));
+
+    esp_err_t res = ESP_OK;
+    switch (mode)
+    {
+        case DHT_CAPTURE_POLLING:
+            break;
+        case DHT_CAPTURE_RMT:
+            res = dht_rmt_init(pin);
+            break;
+        case DHT_CAPTURE_EDGE_ISR:
+            res = dht_edge_init(pin);
+            break;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+    if (res == ESP_OK)
+        res = dht_async_init();
+    if (res == ESP_OK && !cache_lock && !(cache_lock = xSemaphoreCreateMutex()))
+        res = ESP_ERR_NO_MEM;
+    if (res != ESP_OK)
+        return res;
+
+    if (capture_modes[pin] == DHT_CAPTURE_RMT && mode != DHT_CAPTURE_RMT)
+        dht_rmt_deinit(pin);
+    if (capture_modes[pin] == DHT_CAPTURE_EDGE_ISR && mode != DHT_CAPTURE_EDGE_ISR)
+        dht_edge_deinit(pin);
+    capture_modes[pin] = mode;
+
+    return ESP_OK;
 }
 
 esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
         int16_t *humidity, int16_t *temperature)
 {
     CHECK_ARG(humidity || temperature);
+    CHECK_ARG(GPIO_IS_VALID_OUTPUT_GPIO(pin));
 
     uint8_t data[DHT_DATA_BYTES] = { 0 };
+    dht_read_info_t info;
+    int16_t i_humidity = 0, i_temp = 0;
+    esp_err_t result;
 
-    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
-    gpio_set_level(pin, 1);
+    dht_read_info_init(&info);
+    int64_t start = esp_timer_get_time();
 
-    PORT_ENTER_CRITICAL();
-    esp_err_t result = dht_fetch_data(sensor_type, pin, data);
-    if (result == ESP_OK)
-        PORT_EXIT_CRITICAL();
+    if (capture_modes[pin] != DHT_CAPTURE_POLLING)
+    {
+        result = dht_fetch_data_captured(sensor_type, pin, capture_modes[pin], data, &info.dec);
+        gpio_set_level(pin, 1);
+    }
+    else
+    {
+        gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+        gpio_set_level(pin, 1);
 
-    /* restore GPIO direction because, after calling dht_fetch_data(), the
-     * GPIO direction mode changes */
-    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
-    gpio_set_level(pin, 1);
+        result = dht_fetch_data(sensor_type, pin, data, &info);
+
+        /* restore GPIO direction because, after calling dht_fetch_data(), the
+         * GPIO direction mode changes */
+        gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+        gpio_set_level(pin, 1);
+    }
 
+    ESP_LOGD(TAG, "Critical section held for %" PRIu32 " us", info.critical_us);
+
+    if (result == ESP_OK)
+        result = dht_convert_frame(sensor_type, data, &i_humidity, &i_temp);
+    info.latency_us = (uint32_t)(esp_timer_get_time() - start);
+    dht_record_read(pin, result, i_humidity, i_temp, &info);
     if (result != ESP_OK)
         return result;
 
-    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF))
-    {
-        ESP_LOGE(TAG, "Checksum failed, invalid data received from sensor");
-        return ESP_ERR_INVALID_CRC;
-    }
-
     if (humidity)
-        *humidity = dht_convert_data(sensor_type, data[0], data[1]);
+        *humidity = i_humidity;
     if (temperature)
-        *temperature = dht_convert_data(sensor_type, data[2], data[3]);
+        *temperature = i_temp;
 
-    ESP_LOGD(TAG, "Sensor data: humidity=%d, temp=%d", *humidity, *temperature);
+    ESP_LOGD(TAG, "Sensor data: humidity=%d, temp=%d", i_humidity, i_temp);
 
     return ESP_OK;
 }
@@ -264,3 +581,190 @@ esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
 
     return ESP_OK;
 }
+
+esp_err_t dht_read_multi(const dht_sensor_t *sensors, size_t count, dht_reading_t *readings)
+{
+    CHECK_ARG(sensors && readings && count <= DHT_MULTI_MAX_SENSORS);
+
+    uint8_t data[DHT_MULTI_MAX_SENSORS][DHT_DATA_BYTES] = { 0 };
+    // sensors with a capture backend, shortest start pulse first
+    size_t order[DHT_MULTI_MAX_SENSORS];
+    size_t captured = 0;
+    esp_err_t result = ESP_OK;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        dht_reading_t *r = &readings[i];
+        r->sensor_type = sensors[i].sensor_type;
+        r->pin = sensors[i].pin;
+        r->status = ESP_OK;
+        r->humidity = 0;
+        r->temperature = 0;
+
+        if (!GPIO_IS_VALID_OUTPUT_GPIO(r->pin))
+        {
+            r->status = ESP_ERR_INVALID_ARG;
+            continue;
+        }
+        if (capture_modes[r->pin] == DHT_CAPTURE_POLLING)
+            continue;
+
+        uint32_t pulse_us = dht_decode_get_timing(r->sensor_type)->start_pulse_us;
+        size_t j = captured++;
+        while (j > 0 && dht_decode_get_timing(sensors[order[j - 1]].sensor_type)->start_pulse_us > pulse_us)
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    // Phase 'A' on all captured pins at once
+    for (size_t k = 0; k < captured; k++)
+    {
+        gpio_set_direction(sensors[order[k]].pin, GPIO_MODE_INPUT_OUTPUT_OD);
+        gpio_set_level(sensors[order[k]].pin, 0);
+    }
+    int64_t start = esp_timer_get_time();
+    for (size_t k = 0; k < captured; k++)
+    {
+        const dht_sensor_t *s = &sensors[order[k]];
+        dht_delay_until(start + dht_decode_get_timing(s->sensor_type)->start_pulse_us);
+        readings[order[k]].status = dht_capture_release(s->pin, capture_modes[s->pin]);
+    }
+
+    // the frames were transmitted in parallel, collecting them costs one frame
+    dht_read_info_t info;
+    for (size_t k = 0; k < captured; k++)
+    {
+        const dht_sensor_t *s = &sensors[order[k]];
+        dht_reading_t *r = &readings[order[k]];
+        dht_read_info_init(&info);
+        if (r->status == ESP_OK)
+            r->status = dht_capture_collect(s->sensor_type, s->pin, capture_modes[s->pin], data[order[k]], &info.dec);
+        else
+            info.fail = DHT_FAIL_OTHER;
+        gpio_set_level(s->pin, 1);
+        if (r->status == ESP_OK)
+            r->status = dht_convert_frame(s->sensor_type, data[order[k]], &r->humidity, &r->temperature);
+        info.latency_us = (uint32_t)(esp_timer_get_time() - start);
+        dht_record_read(s->pin, r->status, r->humidity, r->temperature, &info);
+    }
+
+    // polled sensors need the CPU for the whole frame, read them one by one
+    for (size_t i = 0; i < count; i++)
+    {
+        dht_reading_t *r = &readings[i];
+        if (r->status == ESP_OK && capture_modes[r->pin] == DHT_CAPTURE_POLLING)
+            r->status = dht_read_data(r->sensor_type, r->pin, &r->humidity, &r->temperature);
+        if (r->status != ESP_OK)
+            result = ESP_FAIL;
+    }
+
+    return result;
+}
+
+esp_err_t dht_read_start(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        dht_read_cb_t cb, void *arg)
+{
+    CHECK_ARG(cb);
+    CHECK_ARG(GPIO_IS_VALID_OUTPUT_GPIO(pin));
+
+    if (!async_queue)
+        return ESP_ERR_INVALID_STATE;
+
+    dht_async_request_t req = {
+        .sensor_type = sensor_type,
+        .pin = pin,
+        .cb = cb,
+        .arg = arg,
+    };
+    if (xQueueSend(async_queue, &req, 0) != pdTRUE)
+        return ESP_ERR_NO_MEM;
+
+    return ESP_OK;
+}
+
+esp_err_t dht_get_stats(dht_stats_t *out)
+{
+    CHECK_ARG(out);
+
+    PORT_ENTER_CRITICAL();
+    *out = stats;
+    PORT_EXIT_CRITICAL();
+
+    return ESP_OK;
+}
+
+void dht_reset_stats(void)
+{
+    PORT_ENTER_CRITICAL();
+    memset(&stats, 0, sizeof(stats));
+    PORT_EXIT_CRITICAL();
+}
+
+const char *dht_fail_name(dht_fail_t fail)
+{
+    if ((unsigned)fail >= DHT_FAIL_MAX)
+        return "unknown";
+    return fail_names[fail];
+}
+
+esp_err_t dht_read_cached(dht_sensor_type_t sensor_type, gpio_num_t pin, uint32_t max_age_ms,
+        dht_cached_reading_t *out)
+{
+    CHECK_ARG(out);
+    CHECK_ARG(GPIO_IS_VALID_OUTPUT_GPIO(pin));
+
+    if (!cache_lock)
+        return ESP_ERR_INVALID_STATE;
+
+    int64_t max_age_us = (int64_t)max_age_ms * 1000;
+    int64_t min_interval_us = (int64_t)dht_decode_get_timing(sensor_type)->min_interval_ms * 1000;
+    dht_cache_entry_t e;
+    int64_t now;
+    bool fresh;
+
+    /* Waiting on the lock is what coalesces callers: whoever gets it after
+     * a physical read finds a fresh value and does not touch the wire. */
+    xSemaphoreTake(cache_lock, portMAX_DELAY);
+
+    now = esp_timer_get_time();
+    PORT_ENTER_CRITICAL();
+    e = cache[pin];
+    PORT_EXIT_CRITICAL();
+
+    fresh = e.good_us && now - e.good_us <= max_age_us;
+    if (!fresh && (!e.attempt_us || now - e.attempt_us >= min_interval_us))
+    {
+        dht_read_data(sensor_type, pin, &out->humidity, &out->temperature);
+
+        now = esp_timer_get_time();
+        PORT_ENTER_CRITICAL();
+        e = cache[pin];
+        stats.cache_misses++;
+        PORT_EXIT_CRITICAL();
+    }
+    else
+    {
+        PORT_ENTER_CRITICAL();
+        if (fresh)
+            stats.cache_hits++;
+        else
+            stats.cache_stale++;
+        PORT_EXIT_CRITICAL();
+    }
+
+    xSemaphoreGive(cache_lock);
+
+    out->last_status = e.status;
+    if (!e.good_us)
+        return e.attempt_us ? e.status : ESP_ERR_NOT_FOUND;
+
+    out->humidity = e.humidity;
+    out->temperature = e.temperature;
+    out->age_ms = (uint32_t)((now - e.good_us) / 1000);
+    out->stale = now - e.good_us > max_age_us;
+
+    return ESP_OK;
+}
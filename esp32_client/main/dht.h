@@ -46,22 +46,135 @@
 #ifndef __DHT_H__
 #define __DHT_H__
 
+#include <stdbool.h>
 #include <driver/gpio.h>
 #include <esp_err.h>
 
+#include "dht_decode.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- * Sensor type
+ * Capture backend used to record the sensor response
  */
 typedef enum
 {
-    DHT_TYPE_DHT11 = 0,   //!< DHT11
-    DHT_TYPE_AM2301,      //!< AM2301 (DHT21, DHT22, AM2302, AM2321)
-    DHT_TYPE_SI7021       //!< Itead Si7021
-} dht_sensor_type_t;
+    DHT_CAPTURE_POLLING = 0, //!< Busy-wait GPIO polling inside a critical section
+    DHT_CAPTURE_RMT,         //!< RMT receive channel, decoded after the frame ends
+    DHT_CAPTURE_EDGE_ISR,    //!< GPIO any-edge ISR with cycle counter timestamps
+} dht_capture_mode_t;
+
+/**
+ * Maximum number of sensors handled by one dht_read_multi() call
+ */
+#define DHT_MULTI_MAX_SENSORS 8
+
+/**
+ * Sensor on a pin
+ */
+typedef struct
+{
+    dht_sensor_type_t sensor_type; //!< Sensor type
+    gpio_num_t pin;                //!< GPIO pin connected to sensor OUT
+} dht_sensor_t;
+
+/**
+ * Result of a read, see dht_read_start() and dht_read_multi()
+ */
+typedef struct
+{
+    dht_sensor_type_t sensor_type; //!< Sensor type that was requested
+    gpio_num_t pin;                //!< Pin that was read
+    esp_err_t status;              //!< `ESP_OK` if the values below are valid
+    int16_t humidity;              //!< Humidity, percents * 10
+    int16_t temperature;           //!< Temperature, degrees Celsius * 10
+} dht_reading_t;
+
+/**
+ * Completion callback for dht_read_start(), runs in the DHT worker task
+ */
+typedef void (*dht_read_cb_t)(const dht_reading_t *reading, void *arg);
+
+/**
+ * Reason a read failed, index into dht_stats_t::failures
+ */
+typedef enum
+{
+    DHT_FAIL_PHASE_B = 0,   //!< Polling: sensor did not pull the line low after the release
+    DHT_FAIL_PHASE_C,       //!< Response low pulse too long (polling) or 80/80 us response not found (capture)
+    DHT_FAIL_PHASE_D,       //!< Polling: response high pulse too long
+    DHT_FAIL_BIT_LOW,       //!< Polling: low pulse before a bit too long
+    DHT_FAIL_BIT_HIGH,      //!< Polling: high pulse of a bit too long
+    DHT_FAIL_NO_RESPONSE,   //!< Capture: no edge or frame received
+    DHT_FAIL_TRUNCATED,     //!< Capture: fewer than 40 bits received
+    DHT_FAIL_TIMING,        //!< Capture: a bit pulse outside the sensor timing limits
+    DHT_FAIL_CHECKSUM,      //!< 40 bits received, checksum mismatch
+    DHT_FAIL_OTHER,         //!< Anything else (bad argument, capture could not be armed)
+    DHT_FAIL_MAX
+} dht_fail_t;
+
+/**
+ * Pulse width histograms: DHT_HIST_BINS bins of DHT_HIST_BIN_US each, the
+ * last bin collects everything longer
+ */
+#define DHT_HIST_BINS 16
+#define DHT_HIST_BIN_US 10
+
+/**
+ * Driver statistics
+ *
+ * Pulse widths come from the data bits of every frame that had all 40 bits.
+ * With ::DHT_CAPTURE_POLLING they are polling loop counts scaled to
+ * microseconds and therefore underestimate the real width.
+ */
+typedef struct
+{
+    uint32_t reads;            //!< Number of read attempts
+    uint32_t good_reads;       //!< Reads that returned `ESP_OK`
+    uint32_t failures[DHT_FAIL_MAX]; //!< Failed reads per ::dht_fail_t
+    uint32_t low_hist[DHT_HIST_BINS];  //!< Low pulse before each bit
+    uint32_t high_hist[DHT_HIST_BINS]; //!< High pulse of each bit
+    uint32_t last_latency_us;  //!< Duration of the last read, start pulse included
+    uint32_t min_latency_us;   //!< Shortest read
+    uint32_t max_latency_us;   //!< Longest read
+    uint64_t total_latency_us; //!< Sum over all reads, divide by `reads` for the mean
+    uint32_t last_critical_us; //!< Time interrupts were masked during the last read
+    uint32_t max_critical_us;  //!< Longest time interrupts were masked
+    uint32_t cache_hits;       //!< dht_read_cached() calls served within the caller's max age
+    uint32_t cache_misses;     //!< dht_read_cached() calls that read the sensor
+    uint32_t cache_stale;      //!< dht_read_cached() calls served an older value (rate limit)
+} dht_stats_t;
+
+/**
+ * Result of dht_read_cached()
+ */
+typedef struct
+{
+    int16_t humidity;       //!< Last good humidity, percents * 10
+    int16_t temperature;    //!< Last good temperature, degrees Celsius * 10
+    uint32_t age_ms;        //!< Age of the values
+    bool stale;             //!< Values are older than the requested max age
+    esp_err_t last_status;  //!< Result of the latest physical read
+} dht_cached_reading_t;
+
+/**
+ * @brief Select the capture backend for a pin
+ *
+ * Pins that were never initialized are read with ::DHT_CAPTURE_POLLING.
+ * ::DHT_CAPTURE_RMT allocates an RMT receive channel for the pin and records
+ * the response in hardware, so interrupts stay enabled during the read.
+ * ::DHT_CAPTURE_EDGE_ISR timestamps every edge with the CPU cycle counter
+ * from a GPIO interrupt; it needs no RMT channel and holds no critical
+ * section either.
+ * The first call also starts the worker task used by dht_read_start().
+ *
+ * @param pin GPIO pin connected to sensor OUT
+ * @param mode Capture backend
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_init(gpio_num_t pin, dht_capture_mode_t mode);
 
 /**
  * @brief Read integer data from sensor on specified pin
@@ -92,6 +205,77 @@ esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
 esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
         float *humidity, float *temperature);
 
+/**
+ * @brief Read several sensors in one pass
+ *
+ * All sensors whose pin uses a capture backend (see dht_init()) get their
+ * start pulse at the same time and transmit in parallel, so the bus time
+ * stays roughly that of a single read. Sensors on polled pins are read one
+ * after another afterwards.
+ *
+ * @param sensors Sensors to read
+ * @param count Number of sensors, at most ::DHT_MULTI_MAX_SENSORS
+ * @param[out] readings One result per sensor, in the order of `sensors`
+ * @return `ESP_OK` if every sensor was read, `ESP_FAIL` if at least one
+ *         reading has a non-OK status
+ */
+esp_err_t dht_read_multi(const dht_sensor_t *sensors, size_t count, dht_reading_t *readings);
+
+/**
+ * @brief Start a read without blocking the caller
+ *
+ * The read is queued to the DHT worker task which sleeps through the start
+ * pulse and calls `cb` with the result. dht_init() must have been called for
+ * the pin first.
+ *
+ * @param sensor_type DHT11 or DHT22
+ * @param pin GPIO pin connected to sensor OUT
+ * @param cb Completion callback
+ * @param arg Argument passed to `cb`
+ * @return `ESP_OK` if the read was queued, `ESP_ERR_NO_MEM` if the queue is full
+ */
+esp_err_t dht_read_start(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        dht_read_cb_t cb, void *arg);
+
+/**
+ * @brief Read the sensor through the last good value store
+ *
+ * A value no older than `max_age_ms` is returned without touching the
+ * sensor. Otherwise the sensor is read, but never more often than its
+ * minimum sampling interval allows (1 s for DHT11, 2 s for AM2301); within
+ * that interval, or when the read fails, the last good value is returned
+ * with `stale` set. Concurrent callers are coalesced onto one physical
+ * read. Reads done through dht_read_data() and dht_read_multi() update the
+ * store as well. dht_init() must have been called for the pin first.
+ *
+ * @param sensor_type DHT11 or DHT22
+ * @param pin GPIO pin connected to sensor OUT
+ * @param max_age_ms Oldest value the caller accepts as fresh
+ * @param[out] reading Last good value, its age and the latest read status
+ * @return `ESP_OK` if a good value is available (possibly stale),
+ *         `ESP_ERR_NOT_FOUND` or the read error if the sensor was never read successfully
+ */
+esp_err_t dht_read_cached(dht_sensor_type_t sensor_type, gpio_num_t pin, uint32_t max_age_ms,
+        dht_cached_reading_t *reading);
+
+/**
+ * @brief Get driver statistics
+ *
+ * @param[out] stats Statistics snapshot
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_get_stats(dht_stats_t *stats);
+
+/**
+ * @brief Clear driver statistics, e.g. before a tuning run
+ */
+void dht_reset_stats(void);
+
+/**
+ * @brief Short name of a failure reason, e.g. for telemetry keys
+ */
+const char *dht_fail_name(dht_fail_t fail);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,266 @@
+/**
+ * @file dht_decode.c
+ *
+ * Hardware independent decoder for the DHT pulse train.
+ */
+#include "dht_decode.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define RMT_DURATION_MASK 0x7FFF
+#define RMT_LEVEL_SHIFT 15
+
+/*
+ * Sampling intervals: DHT11 1 Hz, AM2301 0.5 Hz.
+ *
+ * The response is ~80 us low and ~80 us high on all types; the start pulse
+ * tail and phase 'B' (20-40 us high) never form a pair within its limits.
+ *
+ * Nominal data pulses from the datasheets: low ~50 us before every bit, high
+ * 22-30 us for '0' and 68-75 us for '1'. Limits leave room for the RMT
+ * glitch filter and interrupt latency of the capture backends.
+ */
+static const dht_decode_timing_t timings[] = {
+    [DHT_TYPE_DHT11] = {
+        .start_pulse_us = 20000,
+        .min_interval_ms = 1000,
+        .response_min_us = 60,
+        .response_max_us = 110,
+        .bit_low_min_us = 35,
+        .bit_low_max_us = 80,
+        .bit_high_min_us = 15,
+        .bit_high_max_us = 95,
+    },
+    [DHT_TYPE_AM2301] = {
+        .start_pulse_us = 20000,
+        .min_interval_ms = 2000,
+        .response_min_us = 60,
+        .response_max_us = 110,
+        .bit_low_min_us = 35,
+        .bit_low_max_us = 75,
+        .bit_high_min_us = 15,
+        .bit_high_max_us = 90,
+    },
+    [DHT_TYPE_SI7021] = {
+        .start_pulse_us = 500,
+        .min_interval_ms = 1000,
+        .response_min_us = 60,
+        .response_max_us = 110,
+        .bit_low_min_us = 35,
+        .bit_low_max_us = 75,
+        .bit_high_min_us = 15,
+        .bit_high_max_us = 90,
+    },
+};
+
+static bool dht_decoder_bit_valid(const dht_decode_timing_t *t, uint32_t low, uint32_t high)
+{
+    if (!t)
+        return true;
+    return low >= t->bit_low_min_us && low <= t->bit_low_max_us
+        && high >= t->bit_high_min_us && high <= t->bit_high_max_us;
+}
+
+static bool dht_decoder_is_response(const dht_decode_timing_t *t, uint32_t low, uint32_t high)
+{
+    return low >= t->response_min_us && low <= t->response_max_us
+        && high >= t->response_min_us && high <= t->response_max_us;
+}
+
+static void dht_decoder_bit(dht_decoder_t *dec, uint32_t low, uint32_t high)
+{
+    // extra bits only raise the count, the first 40 stay as decoded
+    if (dec->count < DHT_DECODE_DATA_BITS)
+    {
+        dec->low_us[dec->count] = low > UINT16_MAX ? UINT16_MAX : low;
+        dec->high_us[dec->count] = high > UINT16_MAX ? UINT16_MAX : high;
+        dec->bits = (dec->bits << 1) | (high > low);
+        dec->violations = (dec->violations << 1) | !dht_decoder_bit_valid(dec->timing, low, high);
+    }
+    if (dec->count < UINT16_MAX)
+        dec->count++;
+}
+
+static void dht_decoder_commit(dht_decoder_t *dec, int level, uint32_t duration)
+{
+    if (level == 0)
+    {
+        if (dec->high)
+        {
+            dht_decoder_bit(dec, dec->high_low, dec->high);
+            dec->high = 0;
+        }
+        dec->low = duration;
+    }
+    else if (!dec->synced)
+    {
+        // phases 'C' and 'D', the first data bit starts with the next low
+        dec->synced = dec->low && dht_decoder_is_response(dec->timing, dec->low, duration);
+        dec->low = 0;
+    }
+    else
+    {
+        // a high pulse only counts once the low pulse before it is known
+        dec->high = dec->low ? duration : 0;
+        dec->high_low = dec->low;
+        dec->low = 0;
+    }
+}
+
+const dht_decode_timing_t *dht_decode_get_timing(dht_sensor_type_t sensor_type)
+{
+    if ((unsigned)sensor_type >= sizeof(timings) / sizeof(timings[0]))
+        return &timings[DHT_TYPE_DHT11];
+    return &timings[sensor_type];
+}
+
+const char *dht_decode_status_name(dht_decode_status_t status)
+{
+    switch (status)
+    {
+        case DHT_DECODE_OK:
+            return "ok";
+        case DHT_DECODE_ERR_NO_RESPONSE:
+            return "no response";
+        case DHT_DECODE_ERR_TRUNCATED:
+            return "truncated";
+        case DHT_DECODE_ERR_TIMING:
+            return "timing";
+        case DHT_DECODE_ERR_CHECKSUM:
+            return "checksum";
+    }
+    return "unknown";
+}
+
+void dht_decoder_reset(dht_decoder_t *dec, const dht_decode_timing_t *timing)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->timing = timing;
+    // without limits the response can't be recognized, the caller feeds bits only
+    dec->synced = timing == NULL;
+    dec->level = -1;
+}
+
+void dht_decoder_feed(dht_decoder_t *dec, int level, uint32_t duration)
+{
+    level = level ? 1 : 0;
+    if (!duration)
+        return;
+
+    if (dec->level == level)
+    {
+        dec->duration += duration;
+        return;
+    }
+
+    if (dec->level >= 0)
+        dht_decoder_commit(dec, dec->level, dec->duration);
+    dec->level = level;
+    dec->duration = duration;
+}
+
+dht_decode_status_t dht_decoder_finish(dht_decoder_t *dec, uint8_t data[DHT_DECODE_DATA_BYTES])
+{
+    if (dec->level >= 0)
+        dht_decoder_commit(dec, dec->level, dec->duration);
+    dec->level = -1;
+
+    if (!dec->synced)
+        return dec->status = DHT_DECODE_ERR_NO_RESPONSE;
+    if (dec->count < DHT_DECODE_DATA_BITS)
+        return dec->status = DHT_DECODE_ERR_TRUNCATED;
+
+    for (int i = 0; i < DHT_DECODE_DATA_BYTES; i++)
+        data[i] = (uint8_t)(dec->bits >> (8 * (DHT_DECODE_DATA_BYTES - 1 - i)));
+
+    // a pulse beyond the 40th bit is a glitch that split one of them
+    if (dec->violations || dec->count > DHT_DECODE_DATA_BITS)
+        return dec->status = DHT_DECODE_ERR_TIMING;
+
+    return dec->status = dht_decode_check(data);
+}
+
+size_t dht_decoder_get_pulses(const dht_decoder_t *dec, uint16_t low_us[DHT_DECODE_DATA_BITS],
+        uint16_t high_us[DHT_DECODE_DATA_BITS])
+{
+    size_t n = dec->count < DHT_DECODE_DATA_BITS ? dec->count : DHT_DECODE_DATA_BITS;
+
+    memcpy(low_us, dec->low_us, n * sizeof(low_us[0]));
+    memcpy(high_us, dec->high_us, n * sizeof(high_us[0]));
+    return n;
+}
+
+dht_decode_status_t dht_decode_rmt_symbols(dht_decoder_t *dec, dht_sensor_type_t sensor_type,
+        const uint32_t *symbols, size_t num_symbols, uint8_t data[DHT_DECODE_DATA_BYTES])
+{
+    dht_decoder_reset(dec, dht_decode_get_timing(sensor_type));
+
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        uint32_t half[2] = { symbols[i] & 0xFFFF, symbols[i] >> 16 };
+        bool end = false;
+
+        for (int h = 0; h < 2; h++)
+        {
+            uint32_t duration = half[h] & RMT_DURATION_MASK;
+            if (!duration)
+            {
+                end = true;
+                break;
+            }
+            dht_decoder_feed(dec, (half[h] >> RMT_LEVEL_SHIFT) & 1, duration);
+        }
+        if (end)
+            break;
+    }
+
+    return dht_decoder_finish(dec, data);
+}
+
+dht_decode_status_t dht_decode_edges(dht_decoder_t *dec, dht_sensor_type_t sensor_type,
+        const uint32_t *edges_us, size_t num_edges, int first_level,
+        uint8_t data[DHT_DECODE_DATA_BYTES])
+{
+    dht_decoder_reset(dec, dht_decode_get_timing(sensor_type));
+
+    int level = first_level ? 1 : 0;
+    for (size_t i = 1; i < num_edges; i++)
+    {
+        // unsigned subtraction keeps working across a counter wrap
+        dht_decoder_feed(dec, level, edges_us[i] - edges_us[i - 1]);
+        level = !level;
+    }
+    // the level after the last edge lasts until the line idles, close it
+    if (num_edges)
+        dht_decoder_feed(dec, level, 1);
+
+    return dht_decoder_finish(dec, data);
+}
+
+dht_decode_status_t dht_decode_check(const uint8_t data[DHT_DECODE_DATA_BYTES])
+{
+    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF))
+        return DHT_DECODE_ERR_CHECKSUM;
+    return DHT_DECODE_OK;
+}
+
+int16_t dht_decode_convert(dht_sensor_type_t sensor_type, uint8_t msb, uint8_t lsb)
+{
+    int16_t data;
+
+    if (sensor_type == DHT_TYPE_DHT11)
+    {
+        data = msb * 10;
+    }
+    else
+    {
+        data = msb & 0x7F;
+        data <<= 8;
+        data |= lsb;
+        if (msb & 0x80)
+            data = -data;       // convert it to negative
+    }
+
+    return data;
+}
@@ -0,0 +1,196 @@
+/**
+ * @file dht_decode.h
+ *
+ * Hardware independent decoder for the DHT pulse train.
+ *
+ * The decoder only sees pulse levels and durations, so it builds and runs on
+ * the host as well as on the ESP32. Capture backends feed it whatever they
+ * recorded (polled durations, RMT symbols, edge timestamps) and get the raw
+ * 5 data bytes and the checksum status back.
+ */
+#ifndef __DHT_DECODE_H__
+#define __DHT_DECODE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_DECODE_DATA_BITS 40
+#define DHT_DECODE_DATA_BYTES (DHT_DECODE_DATA_BITS / 8)
+
+/**
+ * Sensor type
+ */
+typedef enum
+{
+    DHT_TYPE_DHT11 = 0,   //!< DHT11
+    DHT_TYPE_AM2301,      //!< AM2301 (DHT21, DHT22, AM2302, AM2321)
+    DHT_TYPE_SI7021       //!< Itead Si7021
+} dht_sensor_type_t;
+
+/**
+ * Decoder result
+ */
+typedef enum
+{
+    DHT_DECODE_OK = 0,          //!< All 40 data bits were recovered and the checksum matches
+    DHT_DECODE_ERR_NO_RESPONSE, //!< The 80/80 us sensor response (phases 'C' and 'D') was not found
+    DHT_DECODE_ERR_TRUNCATED,   //!< Fewer than 40 complete bits after the response
+    DHT_DECODE_ERR_TIMING,      //!< A data pulse is outside the sensor timing limits, or more than 40 bits
+    DHT_DECODE_ERR_CHECKSUM,    //!< 40 bits decoded but the checksum does not match
+} dht_decode_status_t;
+
+/**
+ * Timing limits of a sensor
+ */
+typedef struct
+{
+    uint32_t start_pulse_us;    //!< Phase 'A' length the MCU has to drive
+    uint32_t min_interval_ms;   //!< Shortest time between two reads the sensor supports
+    uint16_t response_min_us;   //!< Shortest accepted half of the response, phase 'C' or 'D' (nominal 80)
+    uint16_t response_max_us;   //!< Longest accepted half of the response
+    uint16_t bit_low_min_us;    //!< Shortest accepted low pulse before a bit (nominal 50)
+    uint16_t bit_low_max_us;    //!< Longest accepted low pulse before a bit
+    uint16_t bit_high_min_us;   //!< Shortest accepted high pulse of a '0' bit
+    uint16_t bit_high_max_us;   //!< Longest accepted high pulse of a '1' bit
+} dht_decode_timing_t;
+
+/**
+ * Streaming decoder state, see dht_decoder_reset()
+ */
+typedef struct
+{
+    const dht_decode_timing_t *timing; //!< Limits to check pulses against, NULL to skip
+    bool synced;            //!< The response was seen, bits are counted from there
+    uint64_t bits;          //!< First 40 decoded bits, newest in bit 0
+    uint64_t violations;    //!< Bits whose pulses broke the timing limits, same layout as `bits`
+    uint16_t count;         //!< Number of bits decoded so far, above 40 if there were extra pulses
+    int8_t level;           //!< Level of the pulse being accumulated, -1 if none
+    uint32_t duration;      //!< Duration of the pulse being accumulated
+    uint32_t low;           //!< Duration of the last complete low pulse, 0 if none
+    uint32_t high;          //!< High pulse waiting for its trailing low, 0 if none
+    uint32_t high_low;      //!< Low pulse that preceded `high`
+    uint16_t low_us[DHT_DECODE_DATA_BITS];  //!< Low pulse of the first bits
+    uint16_t high_us[DHT_DECODE_DATA_BITS]; //!< High pulse of the first bits
+    dht_decode_status_t status; //!< Result of the last dht_decoder_finish()
+} dht_decoder_t;
+
+/**
+ * @brief Get the timing limits of a sensor type
+ *
+ * @return Timing table entry, never NULL
+ */
+const dht_decode_timing_t *dht_decode_get_timing(dht_sensor_type_t sensor_type);
+
+/**
+ * @brief Short name of a decoder result, for logs
+ */
+const char *dht_decode_status_name(dht_decode_status_t status);
+
+/**
+ * @brief Reset decoder state before feeding a new pulse train
+ *
+ * @param dec Decoder state
+ * @param timing Limits to check data pulses against, NULL to accept any
+ *               duration (e.g. when durations are only approximate). Without
+ *               limits there is no response to look for, so the pulse train
+ *               must start with the first data bit.
+ */
+void dht_decoder_reset(dht_decoder_t *dec, const dht_decode_timing_t *timing);
+
+/**
+ * @brief Feed one pulse to the decoder
+ *
+ * Consecutive pulses of the same level are merged. Pulses are skipped until
+ * a low/high pair within the response limits (phases 'C' and 'D'), so the
+ * host start pulse and phase 'B' never count as bits. After it, every high
+ * pulse that is both preceded and followed by a low pulse is a bit; it
+ * decodes to 1 when it is longer than the low pulse before it. A missing bit
+ * leaves the frame short and a glitch adds a bit, neither shifts the others
+ * into a plausible frame.
+ *
+ * @param dec Decoder state
+ * @param level Line level during the pulse, 0 or 1
+ * @param duration Pulse duration in microseconds
+ */
+void dht_decoder_feed(dht_decoder_t *dec, int level, uint32_t duration);
+
+/**
+ * @brief Flush the last pulse and extract the data bytes
+ *
+ * @param dec Decoder state
+ * @param[out] data Raw sensor bytes, filled unless the frame is truncated
+ * @return `DHT_DECODE_OK` when 40 valid bits with a matching checksum were decoded
+ */
+dht_decode_status_t dht_decoder_finish(dht_decoder_t *dec, uint8_t data[DHT_DECODE_DATA_BYTES]);
+
+/**
+ * @brief Get the pulse durations of the decoded bits
+ *
+ * Durations are clamped to 65535 and are in whatever unit was fed. Partial
+ * frames return the bits that arrived.
+ *
+ * @param dec Decoder state
+ * @param[out] low_us Low pulse before each bit, oldest bit first
+ * @param[out] high_us High pulse of each bit, oldest bit first
+ * @return Number of bits copied, at most 40
+ */
+size_t dht_decoder_get_pulses(const dht_decoder_t *dec, uint16_t low_us[DHT_DECODE_DATA_BITS],
+        uint16_t high_us[DHT_DECODE_DATA_BITS]);
+
+/**
+ * @brief Decode a buffer of RMT receive symbols
+ *
+ * Symbols are taken as raw 32-bit RMT words: duration0 in bits 0-14, level0
+ * in bit 15, duration1 in bits 16-30 and level1 in bit 31, one tick per
+ * microsecond. A zero duration marks the end of the frame.
+ *
+ * @param dec Decoder state, reset by the call and left for inspection
+ * @param sensor_type Sensor type, selects the timing limits
+ * @param symbols Received symbol words
+ * @param num_symbols Number of words in `symbols`
+ * @param[out] data Raw sensor bytes
+ * @return Decoder status
+ */
+dht_decode_status_t dht_decode_rmt_symbols(dht_decoder_t *dec, dht_sensor_type_t sensor_type,
+        const uint32_t *symbols, size_t num_symbols, uint8_t data[DHT_DECODE_DATA_BYTES]);
+
+/**
+ * @brief Decode a list of edge timestamps
+ *
+ * @param dec Decoder state, reset by the call and left for inspection
+ * @param sensor_type Sensor type, selects the timing limits
+ * @param edges_us Timestamp of every edge in microseconds, ascending
+ *                 (wrap-around of the counter is handled)
+ * @param num_edges Number of timestamps
+ * @param first_level Line level right after the first edge
+ * @param[out] data Raw sensor bytes
+ * @return Decoder status
+ */
+dht_decode_status_t dht_decode_edges(dht_decoder_t *dec, dht_sensor_type_t sensor_type,
+        const uint32_t *edges_us, size_t num_edges, int first_level,
+        uint8_t data[DHT_DECODE_DATA_BYTES]);
+
+/**
+ * @brief Check the frame checksum
+ *
+ * @return `DHT_DECODE_OK` or `DHT_DECODE_ERR_CHECKSUM`
+ */
+dht_decode_status_t dht_decode_check(const uint8_t data[DHT_DECODE_DATA_BYTES]);
+
+/**
+ * @brief Pack two data bytes into single value and take into account sign bit
+ *
+ * @return Value * 10 (percents or degrees Celsius)
+ */
+int16_t dht_decode_convert(dht_sensor_type_t sensor_type, uint8_t msb, uint8_t lsb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __DHT_DECODE_H__
@@ -0,0 +1,185 @@
+/**
+ * @file dht_edge.c
+ *
+ * GPIO edge interrupt capture backend for the DHT driver.
+ *
+ * An any-edge ISR stamps every transition with the CPU cycle counter into a
+ * per-pin ring buffer. The ISR is the only writer and the reading task only
+ * looks at the buffer once the frame is over, so no lock is needed and no
+ * CPU is held in a critical section. The timestamps are converted to
+ * microseconds and decoded by dht_decode_edges().
+ */
+#include "dht_edge.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_attr.h>
+#include <esp_cpu.h>
+#include <esp_log.h>
+#include <esp_rom_sys.h>
+#include <inttypes.h>
+
+#define DHT_EDGE_MAX_CHANNELS 4
+// Power of two, comfortably above the edges of one frame
+#define DHT_EDGE_RING_SIZE 128
+#define DHT_EDGE_RING_MASK (DHT_EDGE_RING_SIZE - 1)
+/* Release, phases 'B'-'D', two edges per data bit and the end of the
+ * trailing low pulse */
+#define DHT_EDGE_FRAME_EDGES (4 + 2 * DHT_DECODE_DATA_BITS + 1)
+// A full frame lasts less than 5 ms
+#define DHT_EDGE_FRAME_TIMEOUT_MS 20
+
+typedef struct
+{
+    gpio_num_t pin;
+    bool in_use;
+    SemaphoreHandle_t done;
+    volatile uint32_t head;     // only written by the ISR while armed
+    uint32_t cycles[DHT_EDGE_RING_SIZE];
+} dht_edge_channel_t;
+
+static const char *TAG = "dht_edge";
+
+static dht_edge_channel_t channels[DHT_EDGE_MAX_CHANNELS];
+
+static void IRAM_ATTR dht_edge_isr(void *arg)
+{
+    dht_edge_channel_t *ch = (dht_edge_channel_t *)arg;
+    uint32_t now = esp_cpu_get_cycle_count();
+    uint32_t head = ch->head;
+
+    ch->cycles[head & DHT_EDGE_RING_MASK] = now;
+    ch->head = head + 1;
+
+    if (head + 1 == DHT_EDGE_FRAME_EDGES)
+    {
+        BaseType_t task_woken = pdFALSE;
+        xSemaphoreGiveFromISR(ch->done, &task_woken);
+        if (task_woken == pdTRUE)
+            portYIELD_FROM_ISR();
+    }
+}
+
+static dht_edge_channel_t *dht_edge_find(gpio_num_t pin)
+{
+    for (int i = 0; i < DHT_EDGE_MAX_CHANNELS; i++)
+        if (channels[i].in_use && channels[i].pin == pin)
+            return &channels[i];
+    return NULL;
+}
+
+esp_err_t dht_edge_init(gpio_num_t pin)
+{
+    if (dht_edge_find(pin))
+        return ESP_OK;
+
+    dht_edge_channel_t *ch = NULL;
+    for (int i = 0; i < DHT_EDGE_MAX_CHANNELS && !ch; i++)
+        if (!channels[i].in_use)
+            ch = &channels[i];
+    if (!ch)
+    {
+        ESP_LOGE(TAG, "No free capture slot for pin %d", pin);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // ESP_ERR_INVALID_STATE means the service is already installed
+    esp_err_t res = gpio_install_isr_service(0);
+    if (res != ESP_OK && res != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG, "gpio_install_isr_service failed: %s", esp_err_to_name(res));
+        return res;
+    }
+
+    ch->done = xSemaphoreCreateBinary();
+    if (!ch->done)
+        return ESP_ERR_NO_MEM;
+
+    ch->pin = pin;
+    ch->head = 0;
+    gpio_intr_disable(pin);
+    res = gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    if (res == ESP_OK)
+        res = gpio_isr_handler_add(pin, dht_edge_isr, ch);
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to attach edge ISR on pin %d: %s", pin, esp_err_to_name(res));
+        vSemaphoreDelete(ch->done);
+        ch->done = NULL;
+        return res;
+    }
+    // keep the interrupt off until armed
+    gpio_intr_disable(pin);
+
+    ch->in_use = true;
+    ESP_LOGI(TAG, "Edge capture enabled on pin %d", pin);
+    return ESP_OK;
+}
+
+esp_err_t dht_edge_deinit(gpio_num_t pin)
+{
+    dht_edge_channel_t *ch = dht_edge_find(pin);
+    if (!ch)
+        return ESP_ERR_INVALID_STATE;
+
+    gpio_intr_disable(pin);
+    gpio_isr_handler_remove(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+    vSemaphoreDelete(ch->done);
+    ch->done = NULL;
+    ch->in_use = false;
+    return ESP_OK;
+}
+
+esp_err_t dht_edge_arm(gpio_num_t pin)
+{
+    dht_edge_channel_t *ch = dht_edge_find(pin);
+    if (!ch)
+        return ESP_ERR_INVALID_STATE;
+
+    ch->head = 0;
+    xSemaphoreTake(ch->done, 0);
+    return gpio_intr_enable(pin);
+}
+
+esp_err_t dht_edge_collect(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        uint8_t data[DHT_DECODE_DATA_BYTES], dht_decoder_t *dec)
+{
+    dht_edge_channel_t *ch = dht_edge_find(pin);
+    if (!ch)
+        return ESP_ERR_INVALID_STATE;
+
+    // a frame with missing edges never gives the semaphore, decode what arrived
+    xSemaphoreTake(ch->done, pdMS_TO_TICKS(DHT_EDGE_FRAME_TIMEOUT_MS));
+    gpio_intr_disable(pin);
+
+    uint32_t head = ch->head;
+    if (!head)
+    {
+        ESP_LOGE(TAG, "No response from sensor on pin %d", pin);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // oldest edge still in the ring, edge 0 is the release (line goes high)
+    uint32_t first = head > DHT_EDGE_RING_SIZE ? head - DHT_EDGE_RING_SIZE : 0;
+    uint32_t count = head - first;
+    uint32_t ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+    uint32_t base = ch->cycles[first & DHT_EDGE_RING_MASK];
+
+    // relative to the first edge, so a counter wrap inside the frame is harmless
+    uint32_t edges_us[DHT_EDGE_RING_SIZE];
+    for (uint32_t i = 0; i < count; i++)
+        edges_us[i] = (ch->cycles[(first + i) & DHT_EDGE_RING_MASK] - base) / ticks_per_us;
+
+    ESP_LOGD(TAG, "Captured %" PRIu32 " edges on pin %d", head, pin);
+
+    dht_decode_status_t st = dht_decode_edges(dec, sensor_type, edges_us, count, (first & 1) == 0, data);
+    if (st != DHT_DECODE_OK && st != DHT_DECODE_ERR_CHECKSUM)
+    {
+        ESP_LOGE(TAG, "Bad frame on pin %d (%" PRIu32 " edges, %s)", pin, head,
+                dht_decode_status_name(st));
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file dht_edge.h
+ *
+ * GPIO edge interrupt capture backend for the DHT driver. Internal to dht.c.
+ */
+#ifndef __DHT_EDGE_H__
+#define __DHT_EDGE_H__
+
+#include <driver/gpio.h>
+#include <esp_err.h>
+
+#include "dht_decode.h"
+
+/**
+ * @brief Register the any-edge interrupt handler for a pin
+ *
+ * Installs the GPIO ISR service if nobody did so yet. The interrupt stays
+ * disabled until dht_edge_arm().
+ */
+esp_err_t dht_edge_init(gpio_num_t pin);
+
+/**
+ * @brief Remove the interrupt handler of a pin
+ */
+esp_err_t dht_edge_deinit(gpio_num_t pin);
+
+/**
+ * @brief Start timestamping edges on the pin
+ *
+ * Must be called while the start pulse is still driven low, so the first
+ * recorded edge is the release of the line.
+ */
+esp_err_t dht_edge_arm(gpio_num_t pin);
+
+/**
+ * @brief Wait for the frame to end and decode the recorded edges
+ *
+ * @param sensor_type Sensor type, selects the timing limits
+ * @param pin Armed pin
+ * @param[out] data Raw sensor bytes, checksum not verified
+ * @param[out] dec Decoder state after the frame, for pulse statistics
+ * @return `ESP_OK` on success, `ESP_ERR_TIMEOUT` if no edge was seen,
+ *         `ESP_ERR_INVALID_RESPONSE` if the pulse train could not be decoded
+ */
+esp_err_t dht_edge_collect(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        uint8_t data[DHT_DECODE_DATA_BYTES], dht_decoder_t *dec);
+
+#endif  // __DHT_EDGE_H__
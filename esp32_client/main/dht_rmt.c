@@ -0,0 +1,171 @@
+/**
+ * @file dht_rmt.c
+ *
+ * RMT receive capture backend for the DHT driver.
+ *
+ * The RMT peripheral records the whole response in hardware, so no CPU has to
+ * spin on the GPIO while the 40 bits are transmitted. The frame is decoded
+ * after the receive-done interrupt by dht_decode_rmt_symbols().
+ */
+#include "dht_rmt.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <driver/rmt_rx.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+
+// 1 tick == 1 us
+#define DHT_RMT_RESOLUTION_HZ 1000000
+// One memory block on the ESP32, a full frame needs ~43 symbols
+#define DHT_RMT_MEM_SYMBOLS 64
+#define DHT_RMT_MAX_CHANNELS 4
+// Glitch filter, must stay below ~3 us on the ESP32 (8 bit APB tick counter)
+#define DHT_RMT_FILTER_NS 1000
+// Longest pulse inside a frame is ~80 us, anything longer ends the frame
+#define DHT_RMT_IDLE_NS 200000
+// A full frame lasts less than 5 ms
+#define DHT_RMT_FRAME_TIMEOUT_MS 20
+
+typedef struct
+{
+    gpio_num_t pin;
+    rmt_channel_handle_t channel;
+    QueueHandle_t done_queue;
+    rmt_symbol_word_t symbols[DHT_RMT_MEM_SYMBOLS];
+} dht_rmt_channel_t;
+
+static const char *TAG = "dht_rmt";
+
+static dht_rmt_channel_t channels[DHT_RMT_MAX_CHANNELS];
+
+static bool IRAM_ATTR dht_rmt_rx_done(rmt_channel_handle_t channel,
+        const rmt_rx_done_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t task_woken = pdFALSE;
+    xQueueSendFromISR((QueueHandle_t)user_ctx, edata, &task_woken);
+    return task_woken == pdTRUE;
+}
+
+static dht_rmt_channel_t *dht_rmt_find(gpio_num_t pin)
+{
+    for (int i = 0; i < DHT_RMT_MAX_CHANNELS; i++)
+        if (channels[i].channel && channels[i].pin == pin)
+            return &channels[i];
+    return NULL;
+}
+
+esp_err_t dht_rmt_init(gpio_num_t pin)
+{
+    if (dht_rmt_find(pin))
+        return ESP_OK;
+
+    dht_rmt_channel_t *ch = NULL;
+    for (int i = 0; i < DHT_RMT_MAX_CHANNELS && !ch; i++)
+        if (!channels[i].channel)
+            ch = &channels[i];
+    if (!ch)
+    {
+        ESP_LOGE(TAG, "No free capture slot for pin %d", pin);
+        return ESP_ERR_NO_MEM;
+    }
+
+    rmt_rx_channel_config_t rx_conf = {
+        .gpio_num = pin,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = DHT_RMT_RESOLUTION_HZ,
+        .mem_block_symbols = DHT_RMT_MEM_SYMBOLS,
+    };
+    esp_err_t res = rmt_new_rx_channel(&rx_conf, &ch->channel);
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "rmt_new_rx_channel failed on pin %d: %s", pin, esp_err_to_name(res));
+        ch->channel = NULL;
+        return res;
+    }
+
+    ch->done_queue = xQueueCreate(1, sizeof(rmt_rx_done_event_data_t));
+    if (!ch->done_queue)
+    {
+        rmt_del_channel(ch->channel);
+        ch->channel = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    rmt_rx_event_callbacks_t cbs = { .on_recv_done = dht_rmt_rx_done };
+    res = rmt_rx_register_event_callbacks(ch->channel, &cbs, ch->done_queue);
+    if (res == ESP_OK)
+        res = rmt_enable(ch->channel);
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to enable RMT channel on pin %d: %s", pin, esp_err_to_name(res));
+        rmt_del_channel(ch->channel);
+        vQueueDelete(ch->done_queue);
+        ch->channel = NULL;
+        ch->done_queue = NULL;
+        return res;
+    }
+
+    ch->pin = pin;
+    ESP_LOGI(TAG, "RMT capture enabled on pin %d", pin);
+    return ESP_OK;
+}
+
+esp_err_t dht_rmt_deinit(gpio_num_t pin)
+{
+    dht_rmt_channel_t *ch = dht_rmt_find(pin);
+    if (!ch)
+        return ESP_ERR_INVALID_STATE;
+
+    rmt_disable(ch->channel);
+    rmt_del_channel(ch->channel);
+    vQueueDelete(ch->done_queue);
+    ch->channel = NULL;
+    ch->done_queue = NULL;
+    return ESP_OK;
+}
+
+esp_err_t dht_rmt_arm(gpio_num_t pin)
+{
+    dht_rmt_channel_t *ch = dht_rmt_find(pin);
+    if (!ch)
+        return ESP_ERR_INVALID_STATE;
+
+    rmt_receive_config_t rx_conf = {
+        .signal_range_min_ns = DHT_RMT_FILTER_NS,
+        .signal_range_max_ns = DHT_RMT_IDLE_NS,
+    };
+    xQueueReset(ch->done_queue);
+    return rmt_receive(ch->channel, ch->symbols, sizeof(ch->symbols), &rx_conf);
+}
+
+esp_err_t dht_rmt_collect(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        uint8_t data[DHT_DECODE_DATA_BYTES], dht_decoder_t *dec)
+{
+    dht_rmt_channel_t *ch = dht_rmt_find(pin);
+    if (!ch)
+        return ESP_ERR_INVALID_STATE;
+
+    rmt_rx_done_event_data_t done;
+    if (xQueueReceive(ch->done_queue, &done, pdMS_TO_TICKS(DHT_RMT_FRAME_TIMEOUT_MS)) != pdTRUE)
+    {
+        // abort the pending receive so the channel can be armed again
+        rmt_disable(ch->channel);
+        rmt_enable(ch->channel);
+        ESP_LOGE(TAG, "No response from sensor on pin %d", pin);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ESP_LOGD(TAG, "Received %u symbols on pin %d", (unsigned)done.num_symbols, pin);
+
+    dht_decode_status_t st = dht_decode_rmt_symbols(dec, sensor_type,
+            (const uint32_t *)done.received_symbols, done.num_symbols, data);
+    if (st != DHT_DECODE_OK && st != DHT_DECODE_ERR_CHECKSUM)
+    {
+        ESP_LOGE(TAG, "Bad frame on pin %d (%u symbols, %s)", pin, (unsigned)done.num_symbols,
+                dht_decode_status_name(st));
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file dht_rmt.h
+ *
+ * RMT receive capture backend for the DHT driver. Internal to dht.c.
+ */
+#ifndef __DHT_RMT_H__
+#define __DHT_RMT_H__
+
+#include <driver/gpio.h>
+#include <esp_err.h>
+
+#include "dht_decode.h"
+
+/**
+ * @brief Allocate and enable an RMT receive channel on a pin
+ */
+esp_err_t dht_rmt_init(gpio_num_t pin);
+
+/**
+ * @brief Release the RMT channel allocated for a pin
+ */
+esp_err_t dht_rmt_deinit(gpio_num_t pin);
+
+/**
+ * @brief Start recording the pin
+ *
+ * Must be called right before the start pulse is released so the sensor
+ * response is not missed.
+ */
+esp_err_t dht_rmt_arm(gpio_num_t pin);
+
+/**
+ * @brief Wait for the recorded frame and decode it
+ *
+ * @param sensor_type Sensor type, selects the timing limits
+ * @param pin Armed pin
+ * @param[out] data Raw sensor bytes, checksum not verified
+ * @param[out] dec Decoder state after the frame, for pulse statistics
+ * @return `ESP_OK` on success, `ESP_ERR_TIMEOUT` if the frame never ended,
+ *         `ESP_ERR_INVALID_RESPONSE` if the pulse train could not be decoded
+ */
+esp_err_t dht_rmt_collect(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        uint8_t data[DHT_DECODE_DATA_BYTES], dht_decoder_t *dec);
+
+#endif  // __DHT_RMT_H__
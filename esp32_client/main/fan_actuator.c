@@ -0,0 +1,337 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "app_config.h"
+#include "device_topics.h"
+#include "fan_actuator.h"
+#include "fan_ctrl.h"
+#include "mqtt_manager.h"
+#include "mqtt_router.h"
+
+#define FAN_ACTUATOR_TASK_STACK     3072
+#define FAN_ACTUATOR_TASK_PRIORITY  (tskIDLE_PRIORITY + 3)
+// A fade whose end interrupt hasn't come this long after its nominal end is
+// finished with fan_complete_fade()
+#define FAN_ACTUATOR_FADE_MARGIN_MS 200
+
+/**
+ * @brief A target in the mailbox, with the command's correlation id if it had one.
+ */
+typedef struct {
+    int duty_percentage;
+    int64_t rx_us;                          // command receipt
+    char cid[MQTT_ROUTER_MAX_CID_LEN + 1];  // empty if untraced
+} fan_target_t;
+
+/**
+ * @brief A traced command whose fade is running, actuator task only.
+ */
+typedef struct {
+    bool active;
+    fan_target_t target;
+    int64_t start_us;                       // fade started
+} fan_trace_t;
+
+static const char *TAG = "FAN_ACTUATOR";
+
+// Depth-1 mailbox, written with xQueueOverwrite() so the latest target wins.
+// Targets posted while the task is busy collapse into one. Posting also
+// notifies the task, as fan_ctrl does when a fade ends.
+static QueueHandle_t target_mailbox = NULL;
+static TaskHandle_t actuator_task = NULL;
+static fan_actuator_stats_t stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Fan command state, only written from the MQTT client task
+static int last_on_duty_percentage = 80; // Default "ON" duty
+static volatile bool state = false;
+static const char *read_topic = NULL;
+static const char *ack_topic = NULL;
+
+/**
+ * @brief Publishes the duty the PWM outputs now on read_topic.
+ */
+static void publish_read(void) {
+    char duty_str[5];
+    int current;
+
+    fan_get_duty(&current, NULL);
+    int len = snprintf(duty_str, sizeof(duty_str), "%d", current);
+    mqtt_manager_enqueue(read_topic, duty_str, len, 0, 0, MQTT_PRIORITY_STATE);
+    portENTER_CRITICAL(&stats_mux);
+    stats.reported++;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**
+ * @brief Publishes the trace of a command on ack_topic: times from receipt
+ * to fade start and fade end, in microseconds. A fade that was retargeted
+ * before it ended is reported as superseded, without an end time.
+ */
+static void publish_trace(const fan_trace_t *trace, int64_t done_us) {
+    char buf[160];
+    int len;
+
+    if (done_us) {
+        len = snprintf(buf, sizeof(buf),
+                       "{\"cid\":\"%s\",\"duty\":%d,\"queue_us\":%" PRId64 ",\"fade_us\":%" PRId64 "}",
+                       trace->target.cid, trace->target.duty_percentage,
+                       trace->start_us - trace->target.rx_us, done_us - trace->start_us);
+    } else {
+        len = snprintf(buf, sizeof(buf),
+                       "{\"cid\":\"%s\",\"duty\":%d,\"queue_us\":%" PRId64 ",\"superseded\":true}",
+                       trace->target.cid, trace->target.duty_percentage, trace->start_us - trace->target.rx_us);
+    }
+    if (len > 0 && len < (int)sizeof(buf)) {
+        mqtt_manager_enqueue(ack_topic, buf, len, 0, 0, MQTT_PRIORITY_ACK);
+    }
+}
+
+static esp_err_t fan_actuator_post(const fan_target_t *target) {
+    if (target_mailbox == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&stats_mux);
+    stats.posted++;
+    portEXIT_CRITICAL(&stats_mux);
+    xQueueOverwrite(target_mailbox, target);
+    xTaskNotifyGive(actuator_task);
+    return ESP_OK;
+}
+
+static void fan_actuator_post_msg(const mqtt_route_msg_t *msg, int duty_percentage) {
+    fan_target_t target = { .duty_percentage = duty_percentage, .rx_us = msg->rx_us };
+    if (msg->cid) {
+        memcpy(target.cid, msg->cid, msg->cid_len);
+    }
+    fan_actuator_post(&target);
+}
+
+static void on_status(const mqtt_route_msg_t *msg, void *arg) {
+    ESP_LOGI(TAG, "Processing %.*s: %s", msg->topic_len, msg->topic, msg->value ? "ON" : "OFF");
+    if (msg->value) {
+        fan_actuator_post_msg(msg, last_on_duty_percentage);
+        state = true;
+    } else {
+        fan_actuator_post_msg(msg, 0);
+        state = false;
+    }
+}
+
+/**
+ * @brief Parses a desired state, "ON,<duty>" or "OFF,<duty>".
+ */
+static bool parse_desired(const char *data, int len, bool *on, int *duty_percentage) {
+    const char *comma = memchr(data, ',', len);
+    if (comma == NULL) {
+        return false;
+    }
+    int on_len = (int)(comma - data);
+    if (on_len == 2 && memcmp(data, "ON", 2) == 0) {
+        *on = true;
+    } else if (on_len == 3 && memcmp(data, "OFF", 3) == 0) {
+        *on = false;
+    } else {
+        return false;
+    }
+    int duty = 0;
+    const char *p = comma + 1;
+    const char *end = data + len;
+    if (p == end) {
+        return false;
+    }
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9' || (duty = duty * 10 + (*p - '0')) > 100) {
+            return false;
+        }
+    }
+    *duty_percentage = duty;
+    return true;
+}
+
+/**
+ * @brief Retained desired state, delivered on every (re)connect: restores
+ * the fan without waiting for a new command.
+ */
+static void on_desired(const mqtt_route_msg_t *msg, void *arg) {
+    bool on;
+    int duty;
+
+    if (!parse_desired(msg->data, msg->data_len, &on, &duty)) {
+        ESP_LOGW(TAG, "Invalid desired state: %.*s", msg->data_len < 16 ? msg->data_len : 16, msg->data);
+        return;
+    }
+    ESP_LOGI(TAG, "Desired state: %s, %d%%", on ? "ON" : "OFF", duty);
+    last_on_duty_percentage = duty;
+    state = on;
+    fan_actuator_post_msg(msg, on ? duty : 0);
+}
+
+static void on_output(const mqtt_route_msg_t *msg, void *arg) {
+    ESP_LOGI(TAG, "Processing %.*s: %" PRId32, msg->topic_len, msg->topic, msg->value);
+    if (msg->value < 0 || msg->value > 100) {
+        ESP_LOGW(TAG, "Invalid duty for %.*s: %" PRId32, msg->topic_len, msg->topic, msg->value);
+        return;
+    }
+    last_on_duty_percentage = msg->value;
+    // while off only the ON duty changes, the fan doesn't and nothing is reported
+    if (state) {
+        fan_actuator_post_msg(msg, msg->value);
+    }
+}
+
+// Ticks until an esp_timer deadline, at least 1
+static TickType_t ticks_until(int64_t deadline_us, int64_t now_us) {
+    TickType_t ticks = pdMS_TO_TICKS((deadline_us - now_us + 999) / 1000);
+    return ticks ? ticks : 1;
+}
+
+/**
+ * @brief Applies targets and reports what the fan actually does. Sleeps on
+ * its task notification, given by new targets and by fan_ctrl when a fade
+ * ends. fan/read goes out FAN_ACTUATOR_REPORT_DEBOUNCE_MS after the last fade
+ * ended, so a burst of commands gives one report, of the duty read back from
+ * the PWM.
+ */
+static void fan_actuator_task(void *pvParameters) {
+    fan_target_t target;
+    fan_trace_t trace = { .active = false };
+    bool fading = false;
+    bool report_due = false;
+    int64_t fade_deadline_us = 0;
+    int64_t report_us = 0;
+
+    while (1) {
+        int64_t now_us = esp_timer_get_time();
+        TickType_t wait = portMAX_DELAY;
+        if (fading) {
+            wait = ticks_until(fade_deadline_us, now_us);
+        } else if (report_due) {
+            wait = ticks_until(report_us, now_us);
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        if (xQueueReceive(target_mailbox, &target, 0) == pdTRUE) {
+            if (trace.active) {
+                publish_trace(&trace, 0);
+                trace.active = false;
+            }
+            portENTER_CRITICAL(&stats_mux);
+            stats.applied++;
+            if (fading) {
+                stats.superseded++;
+            }
+            portEXIT_CRITICAL(&stats_mux);
+
+            // retargets a running fade right away, nothing to wait for
+            int64_t start_us = esp_timer_get_time();
+            esp_err_t ret = fan_set_duty_fade_async(target.duty_percentage, 0);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Fade to %d%% failed: %s", target.duty_percentage, esp_err_to_name(ret));
+            } else if (target.cid[0] != '\0') {
+                trace = (fan_trace_t){ .active = true, .target = target, .start_us = start_us };
+            }
+            fading = true;
+            fade_deadline_us = start_us + (int64_t)(FAN_FADE_TIME_DEFAULT_MS + FAN_ACTUATOR_FADE_MARGIN_MS) * 1000;
+        }
+
+        now_us = esp_timer_get_time();
+        if (fading) {
+            bool done = (xEventGroupGetBits(fan_get_event_group()) & FAN_EVT_FADE_DONE) != 0;
+            if (!done && now_us >= fade_deadline_us) {
+                fan_complete_fade();
+                portENTER_CRITICAL(&stats_mux);
+                stats.fade_timeouts++;
+                portEXIT_CRITICAL(&stats_mux);
+                done = true;
+            }
+            if (done) {
+                if (trace.active) {
+                    publish_trace(&trace, fan_get_fade_done_us());
+                    trace.active = false;
+                }
+                fading = false;
+                report_due = true;
+                report_us = now_us + (int64_t)FAN_ACTUATOR_REPORT_DEBOUNCE_MS * 1000;
+            }
+        }
+        if (report_due && !fading && now_us >= report_us) {
+            publish_read();
+            report_due = false;
+        }
+    }
+}
+
+esp_err_t fan_actuator_start(void) {
+    if (target_mailbox != NULL) {
+        return ESP_OK;
+    }
+    target_mailbox = xQueueCreate(1, sizeof(fan_target_t));
+    if (target_mailbox == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(fan_actuator_task, "FanActuator", FAN_ACTUATOR_TASK_STACK, NULL,
+                    FAN_ACTUATOR_TASK_PRIORITY, &actuator_task) != pdPASS) {
+        vQueueDelete(target_mailbox);
+        target_mailbox = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    fan_set_event_task(actuator_task);
+    ESP_LOGI(TAG, "Fan actuator task started.");
+    return ESP_OK;
+}
+
+esp_err_t fan_actuator_register_routes(void) {
+    read_topic = device_topic(DEVICE_SCOPE_SELF, read_t);
+    ack_topic = device_topic(DEVICE_SCOPE_SELF, fan_ack_t);
+    mqtt_manager_add_topic_alias(read_topic);
+    mqtt_manager_add_topic_alias(ack_topic);
+
+    // retained per device, a group or broadcast retained state would compete with it
+    const char *desired = device_topic(DEVICE_SCOPE_SELF, desired_t);
+    esp_err_t ret = mqtt_router_register(desired, MQTT_COMMAND_QOS, MQTT_PAYLOAD_RAW, on_desired, NULL);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // the same commands are accepted for this device, its group and the fleet
+    for (int scope = 0; scope < DEVICE_SCOPE_MAX; scope++) {
+        const char *status = device_topic(scope, status_t);
+        const char *output = device_topic(scope, output_t);
+        ret = mqtt_router_register(status, 0, MQTT_PAYLOAD_ON_OFF, on_status, NULL);
+        if (ret == ESP_OK) {
+            ret = mqtt_router_register(output, 0, MQTT_PAYLOAD_INT, on_output, NULL);
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t fan_actuator_set_target(int duty_percentage) {
+    fan_target_t target = { .duty_percentage = duty_percentage, .rx_us = esp_timer_get_time() };
+    return fan_actuator_post(&target);
+}
+
+bool fan_actuator_is_on(void) {
+    return state;
+}
+
+void fan_actuator_get_stats(fan_actuator_stats_t *out) {
+    // a target still waiting in the mailbox is not lost yet
+    uint32_t waiting = target_mailbox ? uxQueueMessagesWaiting(target_mailbox) : 0;
+
+    portENTER_CRITICAL(&stats_mux);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_mux);
+    uint32_t pending = out->applied + waiting;
+    out->coalesced = out->posted > pending ? out->posted - pending : 0;
+}
@@ -0,0 +1,61 @@
+#ifndef FAN_ACTUATOR_H
+#define FAN_ACTUATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Actuator counters.
+ */
+typedef struct {
+    uint32_t posted;        // targets handed to fan_actuator_set_target()
+    uint32_t applied;       // targets the task actually faded to
+    uint32_t coalesced;     // targets overwritten by a newer one before being applied
+    uint32_t superseded;    // fades retargeted by a newer target before they ended
+    uint32_t reported;      // fan/read reports of the actual duty
+    uint32_t fade_timeouts; // fades finished by fan_complete_fade(), their end interrupt never came
+} fan_actuator_stats_t;
+
+/**
+ * @brief Starts the actuator task that owns the fan fades. The task also
+ * reports the duty the fan actually reached on read_t, once fades have
+ * settled, and finishes fades whose end interrupt doesn't come.
+ * fan_pwm_init() must have succeeded first.
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the task or mailbox can't be created.
+ */
+esp_err_t fan_actuator_start(void);
+
+/**
+ * @brief Registers the fan command topics (status_t, output_t) with the MQTT
+ * router, in every device_scope_t. Call after device_topics_init() and before
+ * mqtt_manager_start(). Commands carrying a correlation id (";cid=<id>") are
+ * traced: once the fade ends, fan_ack_t gets the id with the time from
+ * receipt to fade start ("queue_us") and from fade start to end ("fade_us").
+ * Also registers desired_t, the retained desired state of this device, which
+ * the broker delivers on every connect.
+ * @return ESP_OK on success, or the router error.
+ */
+esp_err_t fan_actuator_register_routes(void);
+
+/**
+ * @brief Posts a new fan target without blocking.
+ * The mailbox holds one target: a newer target replaces one that has not been
+ * picked up yet, so only the latest value is ever faded to.
+ *
+ * @param duty_percentage Desired duty cycle (0-100).
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if the actuator is not running.
+ */
+esp_err_t fan_actuator_set_target(int duty_percentage);
+
+/**
+ * @brief Whether the fan was last commanded ON (status_t), readable from any task.
+ */
+bool fan_actuator_is_on(void);
+
+/**
+ * @brief Gets the actuator counters.
+ */
+void fan_actuator_get_stats(fan_actuator_stats_t *stats);
+
+#endif // FAN_ACTUATOR_H
@@ -2,10 +2,12 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/event_groups.h"
 #include "inttypes.h"
 #include "driver/ledc.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "fan_ctrl.h" 
 
@@ -19,11 +21,18 @@ static const char *TAG_FAN = "FAN_CTRL";
 #define FAN_CTRL_PWM_RESOLUTION_ENUM    LEDC_TIMER_13_BIT
 #define FAN_CTRL_PWM_RESOLUTION_BITS    (13)
 #define FAN_CTRL_PWM_FREQUENCY_HZ       (5000)
-#define FAN_CTRL_PWM_FADE_TIME_MS       (1000) // Default fade time in ms
+#define FAN_CTRL_PWM_FADE_TIME_MS       FAN_FADE_TIME_DEFAULT_MS
 
 #define MAX_LEDC_DUTY_VALUE        ((1 << FAN_CTRL_PWM_RESOLUTION_BITS) - 1)
 
-static SemaphoreHandle_t fan_fade_end_semaphore = NULL;
+static EventGroupHandle_t fan_events = NULL;
+// Serializes stop/read/restart of a fade between callers
+static SemaphoreHandle_t fan_fade_lock = NULL;
+static volatile int fan_target_percentage = 0;
+// esp_timer time FAN_EVT_FADE_DONE was last set
+static volatile int64_t fan_fade_done_us = 0;
+// Notified whenever FAN_EVT_FADE_DONE is set, see fan_set_event_task()
+static TaskHandle_t fan_event_task = NULL;
 
 static uint32_t map_percentage_to_duty(int percentage) {
     if (percentage < 0) percentage = 0;
@@ -31,17 +40,42 @@ static uint32_t map_percentage_to_duty(int percentage) {
     return (uint32_t)(((float)percentage / 100.0f) * MAX_LEDC_DUTY_VALUE);
 }
 
+static int map_duty_to_percentage(uint32_t duty) {
+    return (int)((duty * 100 + MAX_LEDC_DUTY_VALUE / 2) / MAX_LEDC_DUTY_VALUE);
+}
+
 static IRAM_ATTR bool cb_fan_fade_end_event(const ledc_cb_param_t *param, void *user_arg) {
     BaseType_t taskAwoken = pdFALSE;
     if (param->event == LEDC_FADE_END_EVT) {
-        SemaphoreHandle_t sem = (SemaphoreHandle_t) user_arg;
-        if (sem != NULL) {
-            xSemaphoreGiveFromISR(sem, &taskAwoken);
+        EventGroupHandle_t events = (EventGroupHandle_t) user_arg;
+        if (events != NULL) {
+            fan_fade_done_us = esp_timer_get_time();
+            xEventGroupSetBitsFromISR(events, FAN_EVT_FADE_DONE, &taskAwoken);
+            if (fan_event_task != NULL) {
+                vTaskNotifyGiveFromISR(fan_event_task, &taskAwoken);
+            }
         }
     }
     return (taskAwoken == pdTRUE);
 }
 
+// Task context counterpart of the fade-end interrupt
+static void fan_mark_fade_done(void) {
+    fan_fade_done_us = esp_timer_get_time();
+    xEventGroupSetBits(fan_events, FAN_EVT_FADE_DONE);
+    if (fan_event_task != NULL) {
+        xTaskNotifyGive(fan_event_task);
+    }
+}
+
+// Ends the fade to fan_target_percentage by setting its duty directly. Call with fan_fade_lock held.
+static void fan_force_target_duty(void) {
+    ledc_fade_stop(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL);
+    ledc_set_duty(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, map_percentage_to_duty(fan_target_percentage));
+    ledc_update_duty(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL);
+    fan_mark_fade_done();
+}
+
 esp_err_t fan_pwm_init(void) {
     ESP_LOGI(TAG_FAN, "Initializing Fan PWM Control");
 
@@ -82,18 +116,19 @@ esp_err_t fan_pwm_init(void) {
         return ret;
     }
 
-    fan_fade_end_semaphore = xSemaphoreCreateBinary();
-    if (fan_fade_end_semaphore == NULL) {
-        ESP_LOGE(TAG_FAN, "Failed to create fan_fade_end_semaphore!");
+    fan_events = xEventGroupCreate();
+    fan_fade_lock = xSemaphoreCreateMutex();
+    if (fan_events == NULL || fan_fade_lock == NULL) {
+        ESP_LOGE(TAG_FAN, "Failed to create fan event group/lock!");
         return ESP_FAIL;
     }
+    // duty starts at 0, nothing is fading
+    xEventGroupSetBits(fan_events, FAN_EVT_FADE_DONE);
 
     ledc_cbs_t callbacks = {.fade_cb = cb_fan_fade_end_event};
-    ret = ledc_cb_register(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, &callbacks, (void *) fan_fade_end_semaphore);
+    ret = ledc_cb_register(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, &callbacks, (void *) fan_events);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG_FAN, "ledc_cb_register failed: %s", esp_err_to_name(ret));
-        vSemaphoreDelete(fan_fade_end_semaphore);
-        fan_fade_end_semaphore = NULL;
         return ret;
     }
 
@@ -101,27 +136,99 @@ esp_err_t fan_pwm_init(void) {
     return ESP_OK;
 }
 
-esp_err_t fan_set_duty_fade(int duty_percentage) {
-    if (fan_fade_end_semaphore == NULL) {
+esp_err_t fan_set_duty_fade_async(int duty_percentage, uint32_t time_ms) {
+    if (fan_events == NULL) {
         ESP_LOGE(TAG_FAN, "Fan PWM not initialized");
         return ESP_ERR_INVALID_STATE;
     }
+    if (duty_percentage < 0) duty_percentage = 0;
+    if (duty_percentage > 100) duty_percentage = 100;
+    if (time_ms == 0) time_ms = FAN_CTRL_PWM_FADE_TIME_MS;
     uint32_t target_duty_raw = map_percentage_to_duty(duty_percentage);
-    ESP_LOGI(TAG_FAN, "Fading fan to %d%% (raw: %" PRIu32 ")", duty_percentage, target_duty_raw);
 
-    esp_err_t ret = ledc_set_fade_with_time(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, target_duty_raw, FAN_CTRL_PWM_FADE_TIME_MS);
-    if (ret != ESP_OK) return ret;
+    xSemaphoreTake(fan_fade_lock, portMAX_DELAY);
+    // Freeze a running fade where it is; the new one starts from that duty.
+    // The stop takes effect within one PWM period.
+    ledc_fade_stop(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL);
+    xEventGroupClearBits(fan_events, FAN_EVT_FADE_DONE);
+    fan_target_percentage = duty_percentage;
+
+    uint32_t current_duty_raw = ledc_get_duty(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL);
+    ESP_LOGD(TAG_FAN, "Fading fan %" PRIu32 " -> %" PRIu32 " (%d%%) in %" PRIu32 " ms",
+             current_duty_raw, target_duty_raw, duty_percentage, time_ms);
+
+    esp_err_t ret = ESP_OK;
+    if (current_duty_raw == target_duty_raw) {
+        // no fade, so no fade-end interrupt either
+        fan_mark_fade_done();
+    } else {
+        ret = ledc_set_fade_with_time(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, target_duty_raw, time_ms);
+        if (ret == ESP_OK) {
+            ret = ledc_fade_start(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, LEDC_FADE_NO_WAIT);
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG_FAN, "Failed to start fade to %d%%: %s", duty_percentage, esp_err_to_name(ret));
+        }
+    }
+    xSemaphoreGive(fan_fade_lock);
+    return ret;
+}
+
+EventGroupHandle_t fan_get_event_group(void) {
+    return fan_events;
+}
 
-    ret = ledc_fade_start(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, LEDC_FADE_NO_WAIT);
+int64_t fan_get_fade_done_us(void) {
+    return fan_fade_done_us;
+}
+
+void fan_set_event_task(TaskHandle_t task) {
+    fan_event_task = task;
+}
+
+esp_err_t fan_complete_fade(void) {
+    if (fan_events == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(fan_fade_lock, portMAX_DELAY);
+    bool done = (xEventGroupGetBits(fan_events) & FAN_EVT_FADE_DONE) != 0;
+    if (!done) {
+        ESP_LOGW(TAG_FAN, "Fade to %d%% did not end. Setting duty directly.", fan_target_percentage);
+        fan_force_target_duty();
+    }
+    xSemaphoreGive(fan_fade_lock);
+    return done ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void fan_get_duty(int *current_percentage, int *target_percentage) {
+    if (current_percentage) {
+        *current_percentage = map_duty_to_percentage(ledc_get_duty(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL));
+    }
+    if (target_percentage) {
+        *target_percentage = fan_target_percentage;
+    }
+}
+
+esp_err_t fan_set_duty_fade(int duty_percentage) {
+    uint32_t target_duty_raw = map_percentage_to_duty(duty_percentage);
+    ESP_LOGI(TAG_FAN, "Fading fan to %d%% (raw: %" PRIu32 ")", duty_percentage, target_duty_raw);
+
+    esp_err_t ret = fan_set_duty_fade_async(duty_percentage, FAN_CTRL_PWM_FADE_TIME_MS);
     if (ret != ESP_OK) return ret;
 
-    if (xSemaphoreTake(fan_fade_end_semaphore, pdMS_TO_TICKS(FAN_CTRL_PWM_FADE_TIME_MS + 200)) == pdTRUE) {
+    EventBits_t bits = xEventGroupWaitBits(fan_events, FAN_EVT_FADE_DONE, pdFALSE, pdTRUE,
+                                           pdMS_TO_TICKS(FAN_CTRL_PWM_FADE_TIME_MS + 200));
+    if (bits & FAN_EVT_FADE_DONE) {
         ESP_LOGI(TAG_FAN, "Fan fade to %d%% complete.", duty_percentage);
         return ESP_OK;
     } else {
-        ESP_LOGW(TAG_FAN, "Fan fade to %d%% timed out. Setting duty directly.", duty_percentage);
-        ledc_set_duty(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL, target_duty_raw);
-        ledc_update_duty(FAN_CTRL_PWM_MODE, FAN_CTRL_PWM_CHANNEL);
+        xSemaphoreTake(fan_fade_lock, portMAX_DELAY);
+        // a newer target owns the channel now, leave its fade alone
+        if (fan_target_percentage == duty_percentage) {
+            ESP_LOGW(TAG_FAN, "Fan fade to %d%% timed out. Setting duty directly.", duty_percentage);
+            fan_force_target_duty();
+        }
+        xSemaphoreGive(fan_fade_lock);
         return ESP_ERR_TIMEOUT;
     }
 }
@@ -1,7 +1,16 @@
 #ifndef FAN_CTRL_H
 #define FAN_CTRL_H
 
+#include <stdint.h>
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#define FAN_FADE_TIME_DEFAULT_MS    1000
+
+// Bits of fan_get_event_group()
+#define FAN_EVT_FADE_DONE           BIT0    // set while no fade is running
 
 /**
  * @brief Initializes the PWM fan control module.
@@ -12,7 +21,8 @@ esp_err_t fan_pwm_init(void);
 
 /**
  * @brief Sets the fan speed using PWM with a fade effect.
- * This function is blocking until the fade completes or times out.
+ * This function is blocking until the fade completes or times out. It is
+ * fan_set_duty_fade_async() plus a wait on FAN_EVT_FADE_DONE.
  *
  * @param duty_percentage Desired duty cycle (0-100).
  * @return ESP_OK on successful fade, ESP_ERR_TIMEOUT if fade timed out,
@@ -20,6 +30,56 @@ esp_err_t fan_pwm_init(void);
  */
 esp_err_t fan_set_duty_fade(int duty_percentage);
 
+/**
+ * @brief Starts a fade to a new duty cycle and returns immediately.
+ * A fade already running is stopped where it is (within one PWM period) and
+ * the new fade starts from that duty, so a new target always takes over
+ * right away. FAN_EVT_FADE_DONE is cleared now and set when the fade ends;
+ * a fade that gets retargeted never sets it.
+ *
+ * @param duty_percentage Desired duty cycle (0-100).
+ * @param time_ms Fade duration, 0 for FAN_FADE_TIME_DEFAULT_MS.
+ * @return ESP_OK if the fade was started, or an error code on failure.
+ */
+esp_err_t fan_set_duty_fade_async(int duty_percentage, uint32_t time_ms);
+
+/**
+ * @brief Gets the fan event group, see FAN_EVT_* bits.
+ * @return Event group handle, NULL before fan_pwm_init().
+ */
+EventGroupHandle_t fan_get_event_group(void);
+
+/**
+ * @brief Gets the time the last fade ended, taken in the fade-end interrupt.
+ * Valid while FAN_EVT_FADE_DONE is set.
+ * @return esp_timer time in microseconds, 0 before the first fade.
+ */
+int64_t fan_get_fade_done_us(void);
+
+/**
+ * @brief Sets a task to notify (xTaskNotifyGive()) whenever FAN_EVT_FADE_DONE
+ * gets set: fade-end interrupt, a fade with nothing to do, or a timeout
+ * fallback. Lets the task wait with ulTaskNotifyTake() instead of polling.
+ * @param task Task handle, NULL to stop notifying.
+ */
+void fan_set_event_task(TaskHandle_t task);
+
+/**
+ * @brief Ends a fade whose fade-end interrupt hasn't arrived in time by
+ * setting the target duty directly, like fan_set_duty_fade() does on timeout.
+ * @return ESP_OK if no fade was running, ESP_ERR_TIMEOUT if the duty was
+ *         forced, ESP_ERR_INVALID_STATE before fan_pwm_init().
+ */
+esp_err_t fan_complete_fade(void);
+
+/**
+ * @brief Gets the duty cycle the hardware outputs now and the one being faded to.
+ *
+ * @param[out] current_percentage Current duty (0-100), nullable.
+ * @param[out] target_percentage Target of the last fade (0-100), nullable.
+ */
+void fan_get_duty(int *current_percentage, int *target_percentage);
+
 /**
  * @brief Turns the fan on to a specified duty cycle with a fade.
  *
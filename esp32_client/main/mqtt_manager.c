@@ -1,6 +1,7 @@
 #include "mqtt_manager.h"
 #include "app_config.h"
-#include "fan_ctrl.h"
+#include "mqtt_router.h"
+#include "device_topics.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,33 +9,116 @@
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "mqtt_client.h"
 #include <inttypes.h>
 
+#if MQTT_PROTOCOL_V5 && !CONFIG_MQTT_PROTOCOL_5
+#error "MQTT_PROTOCOL_V5 needs CONFIG_MQTT_PROTOCOL_5 in sdkconfig"
+#endif
+
 static const char *TAG = "MQTT_MANAGER";
+// Longest payload prefix written to the log, payloads are sized by the broker
+#define MQTT_LOG_DATA_MAX 64
 static esp_mqtt_client_handle_t client = NULL;
-static int last_on_duty_percentage = 80; // Default "ON" duty
-static bool state = 0;
+static volatile bool connected = false;
+// Retained "online"/"offline", see presence_t
+static const char *presence_topic = NULL;
+// Retained DEVICE_GROUP, see group_t
+static const char *group_topic = NULL;
+// Outbox budget per priority, bytes
+static const uint32_t outbox_budget[MQTT_PRIORITY_MAX] = {
+    [MQTT_PRIORITY_BULK] = MQTT_OUTBOX_BULK_BUDGET,
+    [MQTT_PRIORITY_TELEMETRY] = MQTT_OUTBOX_TELEMETRY_BUDGET,
+    [MQTT_PRIORITY_STATE] = MQTT_OUTBOX_STATE_BUDGET,
+    [MQTT_PRIORITY_ACK] = MQTT_OUTBOX_BUDGET,
+};
+_Static_assert(MQTT_OUTBOX_BULK_BUDGET < MQTT_OUTBOX_TELEMETRY_BUDGET
+               && MQTT_OUTBOX_TELEMETRY_BUDGET < MQTT_OUTBOX_STATE_BUDGET
+               && MQTT_OUTBOX_STATE_BUDGET < MQTT_OUTBOX_BUDGET, "each priority needs room of its own");
+// Updated from the MQTT client task and the publish task
+static mqtt_manager_stats_t stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+#if MQTT_PROTOCOL_V5
+_Static_assert(MQTT5_TOPIC_ALIAS_MAX <= 32, "alias_announced is a 32-bit mask");
+// Topic n gets alias n + 1, see mqtt_manager_add_topic_alias()
+static const char *alias_topics[MQTT5_TOPIC_ALIAS_MAX];
+static uint16_t alias_count = 0;
+// Publish properties are client-wide in esp-mqtt: setting them and publishing
+// must not interleave between tasks. Recursive, the birth message is sent by
+// whoever holds it, see mqtt_manager_flush_birth(). Also guards the three below.
+static SemaphoreHandle_t publish_lock = NULL;
+// Bumped by the MQTT task on CONNECTED and DISCONNECTED. The event handlers
+// run with the client's own lock held and must not wait for publish_lock.
+static volatile uint32_t connection_gen = 0;
+// connection_gen the two below belong to
+static uint32_t alias_gen = 0;
+// Aliases the broker has seen with their topic on this connection, bit n for alias n + 1
+static uint32_t alias_announced = 0;
+// Aliases above this were refused by the client, the broker allows fewer
+static uint16_t alias_limit = MQTT5_TOPIC_ALIAS_MAX;
+#endif
+// Birth message of this connection not queued yet: refused, or
+// (MQTT_PROTOCOL_V5) publish_lock was taken when the connection came up
+static volatile bool birth_pending = false;
+
+/**
+ * @brief Enqueues the birth message, and the group membership ahead of it,
+ * if it is pending. Called on CONNECTED and after every enqueue, so a refused
+ * one goes out once the outbox has room, and the publish_lock holder the MQTT
+ * task ran into sends it.
+ */
+static void mqtt_manager_flush_birth(void) {
+    if (!birth_pending) {
+        return;
+    }
+#if MQTT_PROTOCOL_V5
+    if (xSemaphoreTakeRecursive(publish_lock, 0) != pdTRUE) {
+        return;
+    }
+#endif
+    portENTER_CRITICAL(&stats_mux);
+    bool claimed = birth_pending;
+    birth_pending = false;
+    portEXIT_CRITICAL(&stats_mux);
+    // group first, the bridge knows it by the time the device shows up online;
+    // both are retained, sending them again after a refusal is harmless
+    if (claimed && (mqtt_manager_enqueue(group_topic, DEVICE_GROUP, 0, 1, 1, MQTT_PRIORITY_STATE) < 0
+                    || mqtt_manager_enqueue(presence_topic, PRESENCE_ONLINE, 0, 1, 1, MQTT_PRIORITY_STATE) < 0)) {
+        birth_pending = connected;
+    }
+#if MQTT_PROTOCOL_V5
+    xSemaphoreGiveRecursive(publish_lock);
+#endif
+}
 
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
     esp_mqtt_client_handle_t client_local = event->client;
-    int msg_id;
 
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            msg_id = esp_mqtt_client_subscribe(client_local, status_t, 0);
-            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", status_t, msg_id);
-            msg_id = esp_mqtt_client_subscribe(client_local, output_t, 0);
-            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", output_t, msg_id);
-
-            mqtt_manager_publish(read_t, "0", 0, 0, 0);
-            mqtt_manager_publish(temp_t, "0", 0, 0, 0);
-            mqtt_manager_publish(humidity_t, "0", 0, 0, 0);
+#if MQTT_PROTOCOL_V5
+            // aliases only live as long as the connection
+            connection_gen++;
+#endif
+            connected = true;
+            // retained desired state (desired_t) arrives right after the SUBACK
+            mqtt_router_subscribe_all(client_local);
+            // birth message, the broker replaces it with the will when the connection drops
+            birth_pending = true;
+            mqtt_manager_flush_birth();
             break;
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            connected = false;
+            birth_pending = false;
+#if MQTT_PROTOCOL_V5
+            connection_gen++;
+#endif
             break;
 
         case MQTT_EVENT_SUBSCRIBED:
@@ -50,46 +134,31 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
             break;
 
         case MQTT_EVENT_DATA: {
-            ESP_LOGI(TAG, "MQTT_EVENT_DATA: TOPIC=%.*s, DATA=%.*s",
-                     event->topic_len, event->topic, event->data_len, event->data);
-
-            char topic_str[event->topic_len + 1];
-            strncpy(topic_str, event->topic, event->topic_len);
-            topic_str[event->topic_len] = '\0';
-
-            char data_str[event->data_len + 1];
-            strncpy(data_str, event->data, event->data_len);
-            data_str[event->data_len] = '\0';
-
-            if (strcmp(topic_str, status_t) == 0) {
-                ESP_LOGI(TAG, "Processing %s: %s", status_t, data_str);
-                if (strcmp(data_str, "ON") == 0) {
-                    fan_turn_on_fade(last_on_duty_percentage);
-                    char current_duty_str[5];
-                    snprintf(current_duty_str, sizeof(current_duty_str), "%d", last_on_duty_percentage);
-		    state = true;
-                    mqtt_manager_publish(read_t, current_duty_str, 0, 0, 0);
-                } else if (strcmp(data_str, "OFF") == 0) {
-                    fan_turn_off_fade();
-		    state = false;
-                } else {
-                    ESP_LOGW(TAG, "Invalid payload for %s: %s", status_t, data_str);
-                }
-            } else if (strcmp(topic_str, output_t) == 0) {
-                ESP_LOGI(TAG, "Processing %s: %s", output_t, data_str);
-                int duty_percentage = atoi(data_str);
-                if (duty_percentage >= 0 && duty_percentage <= 100) {
-                    last_on_duty_percentage = duty_percentage;
-		    if (state){
-                    fan_set_duty_fade(duty_percentage);
-		    }
-                    mqtt_manager_publish(read_t, data_str, 0, 0, 0);
-                } else {
-                    ESP_LOGW(TAG, "Invalid duty for %s: %s", output_t, data_str);
-                }
+            int64_t handler_start = esp_timer_get_time();
+            // topic and data are (ptr,len) views into the client buffer, not terminated.
+            // Payloads larger than the client buffer arrive as several events,
+            // only the first one carries the topic.
+            if (event->topic_len > 0) {
+                ESP_LOGI(TAG, "MQTT_EVENT_DATA: TOPIC=%.*s, DATA=%.*s%s (%d bytes)",
+                         event->topic_len, event->topic,
+                         event->data_len < MQTT_LOG_DATA_MAX ? event->data_len : MQTT_LOG_DATA_MAX, event->data,
+                         event->data_len > MQTT_LOG_DATA_MAX ? "..." : "", event->total_data_len);
             } else {
-                ESP_LOGW(TAG, "Unhandled topic: %s", topic_str);
+                ESP_LOGD(TAG, "MQTT_EVENT_DATA: fragment %d+%d of %d bytes",
+                         event->current_data_offset, event->data_len, event->total_data_len);
             }
+
+            mqtt_router_dispatch_fragment(event->topic, event->topic_len, event->data, event->data_len,
+                                          event->current_data_offset, event->total_data_len);
+
+            uint32_t handler_us = (uint32_t)(esp_timer_get_time() - handler_start);
+            portENTER_CRITICAL(&stats_mux);
+            stats.data_handler_last_us = handler_us;
+            if (handler_us > stats.data_handler_max_us) {
+                stats.data_handler_max_us = handler_us;
+            }
+            portEXIT_CRITICAL(&stats_mux);
+            ESP_LOGD(TAG, "MQTT_EVENT_DATA handled in %" PRIu32 " us", handler_us);
             break;
         }
 
@@ -114,28 +183,181 @@ static void mqtt_event_handler_wrapper(void *handler_args, esp_event_base_t base
 
 void mqtt_manager_start(void) {
     esp_mqtt_client_config_t mqtt_cfg = { .broker.address.uri = MQTT_BROKER_URI };
-    if (strlen(MQTT_CLIENT_ID) > 0) {
-        mqtt_cfg.credentials.client_id = MQTT_CLIENT_ID;
-    }
+    // every device of the fleet needs its own client id
+    mqtt_cfg.credentials.client_id = strlen(MQTT_CLIENT_ID) > 0 ? MQTT_CLIENT_ID : device_id();
+    // hard limit, mqtt_manager_enqueue() keeps each priority below its own budget
+    mqtt_cfg.outbox.limit = MQTT_OUTBOX_BUDGET;
+#if MQTT_PROTOCOL_V5
+    mqtt_cfg.session.protocol_ver = MQTT_PROTOCOL_V_5;
+    // the broker keeps commands for MQTT5_SESSION_EXPIRY_S while we are away,
+    // each until its own message expiry
+    mqtt_cfg.session.disable_clean_session = true;
+    publish_lock = xSemaphoreCreateRecursiveMutex();
+#endif
+
+    presence_topic = device_topic(DEVICE_SCOPE_SELF, presence_t);
+    group_topic = device_topic(DEVICE_SCOPE_SELF, group_t);
+    mqtt_cfg.session.last_will.topic = presence_topic;
+    mqtt_cfg.session.last_will.msg = PRESENCE_OFFLINE;
+    mqtt_cfg.session.last_will.qos = 1;
+    mqtt_cfg.session.last_will.retain = 1;
     client = esp_mqtt_client_init(&mqtt_cfg);
+#if MQTT_PROTOCOL_V5
+    esp_mqtt5_connection_property_config_t connect_property = {
+        .session_expiry_interval = MQTT5_SESSION_EXPIRY_S,
+    };
+    esp_mqtt5_client_set_connect_property(client, &connect_property);
+#endif
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler_wrapper, NULL);
     esp_mqtt_client_start(client);
     ESP_LOGI(TAG, "MQTT client started.");
 }
 
-int mqtt_manager_publish(const char *topic, const char *data, int len, int qos, int retain) {
+bool mqtt_manager_is_connected(void) {
+    return connected;
+}
+
+esp_err_t mqtt_manager_add_topic_alias(const char *topic) {
+#if MQTT_PROTOCOL_V5
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (alias_count == MQTT5_TOPIC_ALIAS_MAX) {
+        ESP_LOGW(TAG, "No topic alias left for %s", topic);
+        return ESP_ERR_NO_MEM;
+    }
+    alias_topics[alias_count++] = topic;
+    ESP_LOGI(TAG, "Topic alias %u: %s", alias_count, topic);
+#endif
+    return ESP_OK;
+}
+
+#if MQTT_PROTOCOL_V5
+static uint16_t mqtt_manager_find_alias(const char *topic) {
+    for (uint16_t i = 0; i < alias_count; i++) {
+        if (strcmp(alias_topics[i], topic) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Enqueues, on QoS 0 messages with a registered topic using its alias.
+ * The first message of a connection on an alias carries the topic too, the
+ * following ones an empty topic. Those are only elided while the outbox is
+ * empty, so the client task writes them on its next pass: the alias mapping
+ * is per connection, and one left in the outbox when the link drops reaches
+ * the next connection unresolved. The broker then closes that connection
+ * and the client, which deletes QoS 0 messages once written, reconnects
+ * without it.
+ */
+static int mqtt_manager_client_enqueue_v5(const char *topic, const char *data, int len, int qos, int retain) {
+    uint16_t alias = qos == 0 ? mqtt_manager_find_alias(topic) : 0;
+    esp_mqtt5_publish_property_config_t property = { 0 };
+    int msg_id = -1;
+
+    xSemaphoreTakeRecursive(publish_lock, portMAX_DELAY);
+    uint32_t gen = connection_gen;
+    if (gen != alias_gen) {
+        // aliases only live as long as the connection
+        alias_gen = gen;
+        alias_announced = 0;
+        alias_limit = MQTT5_TOPIC_ALIAS_MAX;
+    }
+    if (alias > alias_limit || !connected) {
+        alias = 0;
+    }
+    if (alias) {
+        uint32_t bit = 1u << (alias - 1);
+        bool elide = (alias_announced & bit) && esp_mqtt_client_get_outbox_size(client) == 0;
+        property.topic_alias = alias;
+        esp_mqtt5_client_set_publish_property(client, &property);
+        msg_id = esp_mqtt_client_enqueue(client, elide ? "" : topic, data, len, 0, retain, true);
+        property.topic_alias = 0;
+        esp_mqtt5_client_set_publish_property(client, &property);
+        if (msg_id >= 0) {
+            alias_announced |= bit;
+        }
+    }
+    if (msg_id < 0) {
+        int refused = msg_id;
+        msg_id = esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, true);
+        // the client checks aliases against the CONNACK Topic Alias Maximum
+        // while building the packet and fails with -1; an enqueue doesn't
+        // write to the link, so the same message taken without the alias
+        // means the broker allows fewer
+        if (alias && refused == -1 && msg_id >= 0) {
+            ESP_LOGW(TAG, "Topic alias %u refused, aliases limited to %u", alias, alias - 1);
+            alias_limit = alias - 1;
+        }
+    }
+    xSemaphoreGiveRecursive(publish_lock);
+    return msg_id;
+}
+#endif
+
+int mqtt_manager_enqueue(const char *topic, const char *data, int len, int qos, int retain, mqtt_priority_t priority) {
     if (client == NULL) {
-        ESP_LOGE(TAG, "MQTT client not initialized for publish.");
+        ESP_LOGE(TAG, "MQTT client not initialized for enqueue.");
         return -1;
     }
+    if ((unsigned)priority >= MQTT_PRIORITY_MAX) {
+        priority = MQTT_PRIORITY_TELEMETRY;
+    }
     int actual_len = (len == 0 && data != NULL) ? strlen(data) : len;
-    int msg_id = esp_mqtt_client_publish(client, topic, data, actual_len, qos, retain);
+    // approximate: the outbox also holds the fixed header and the topic
+    int outbox = esp_mqtt_client_get_outbox_size(client);
+    uint32_t needed = (uint32_t)(outbox > 0 ? outbox : 0) + actual_len + strlen(topic) + 4;
+    int msg_id = -2;
+    uint32_t elapsed_us = 0;
 
+    if (needed <= outbox_budget[priority]) {
+        int64_t start = esp_timer_get_time();
+        // store: QoS 0 messages wait in the outbox too instead of being sent from here
+#if MQTT_PROTOCOL_V5
+        msg_id = mqtt_manager_client_enqueue_v5(topic, data, actual_len, qos, retain);
+#else
+        msg_id = esp_mqtt_client_enqueue(client, topic, data, actual_len, qos, retain, true);
+#endif
+        elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+        outbox = esp_mqtt_client_get_outbox_size(client);
+    }
+
+    portENTER_CRITICAL(&stats_mux);
     if (msg_id < 0) {
-        ESP_LOGE(TAG, "Publish failed: topic %s, len %d, err %d", topic, actual_len, msg_id);
+        stats.dropped[priority]++;
     } else {
-        ESP_LOGD(TAG, "Publish sent: topic %s, len %d, msg_id %d: %s",
-                 topic, actual_len, msg_id, data ? data : "NULL");
+        stats.enqueued[priority]++;
+        stats.enqueue_last_us = elapsed_us;
+        stats.enqueue_total_us += elapsed_us;
+        if (elapsed_us > stats.enqueue_max_us) {
+            stats.enqueue_max_us = elapsed_us;
+        }
     }
+    stats.outbox_bytes = outbox > 0 ? (uint32_t)outbox : 0;
+    if (stats.outbox_bytes > stats.outbox_max_bytes) {
+        stats.outbox_max_bytes = stats.outbox_bytes;
+    }
+    portEXIT_CRITICAL(&stats_mux);
+
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Enqueue refused: topic %s, len %d, priority %d, outbox %d bytes, err %d",
+                 topic, actual_len, (int)priority, outbox, msg_id);
+    } else {
+        ESP_LOGD(TAG, "Enqueued: topic %s, len %d, msg_id %d in %" PRIu32 " us: %.*s",
+                 topic, actual_len, msg_id, elapsed_us, actual_len < MQTT_LOG_DATA_MAX ? actual_len : MQTT_LOG_DATA_MAX,
+                 data ? data : "");
+    }
+    mqtt_manager_flush_birth();
     return msg_id;
 }
+
+void mqtt_manager_get_stats(mqtt_manager_stats_t *out) {
+    int outbox = client ? esp_mqtt_client_get_outbox_size(client) : 0;
+
+    portENTER_CRITICAL(&stats_mux);
+    stats.outbox_bytes = outbox > 0 ? (uint32_t)outbox : 0;
+    *out = stats;
+    portEXIT_CRITICAL(&stats_mux);
+}
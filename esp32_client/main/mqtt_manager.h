@@ -1,22 +1,77 @@
 #ifndef MQTT_MANAGER_H
 #define MQTT_MANAGER_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 
+/**
+ * @brief Publish priority. When the outbox fills up, lower priorities are
+ * refused first; see MQTT_OUTBOX_*_BUDGET in app_config.h.
+ */
+typedef enum {
+    MQTT_PRIORITY_BULK = 0,         // backlog and statistics, they make way for live telemetry
+    MQTT_PRIORITY_TELEMETRY,        // live records, the caller can store or merge it
+    MQTT_PRIORITY_STATE,            // state changes, e.g. the fan duty
+    MQTT_PRIORITY_ACK,              // replies to commands
+    MQTT_PRIORITY_MAX,
+} mqtt_priority_t;
+
+/**
+ * @brief Enqueue counters.
+ */
+typedef struct {
+    uint32_t enqueued[MQTT_PRIORITY_MAX];
+    uint32_t dropped[MQTT_PRIORITY_MAX];    // refused: over budget or outbox full
+    uint32_t outbox_bytes;                  // outbox size after the last enqueue
+    uint32_t outbox_max_bytes;
+    uint32_t enqueue_last_us;               // time spent in esp_mqtt_client_enqueue()
+    uint32_t enqueue_max_us;
+    uint64_t enqueue_total_us;              // divide by the sum of enqueued for the average
+    uint32_t data_handler_last_us;          // MQTT_EVENT_DATA handling, blocks the client task
+    uint32_t data_handler_max_us;
+} mqtt_manager_stats_t;
+
 /**
  * @brief Starts the MQTT client.
  */
 void mqtt_manager_start(void);
 
 /**
- * @brief Publishes a message to an MQTT topic.
+ * @brief Whether the client is connected to the broker right now.
+ */
+bool mqtt_manager_is_connected(void);
+
+/**
+ * @brief Queues a message in the client's outbox; the MQTT task sends it.
+ * Never waits for the network. The message is refused, not queued, when the
+ * outbox would grow past the budget of its priority, so a slow or absent
+ * broker never stalls the caller.
  * @param topic MQTT topic.
- * @param data Payload data.
+ * @param data Payload data, copied.
  * @param len Length of data. If 0, strlen(data) is used.
  * @param qos QoS level.
  * @param retain Retain flag.
- * @return Message ID if successful, negative on error.
+ * @param priority Decides the outbox budget.
+ * @return Message ID (0 for QoS 0) if queued, negative if refused.
+ */
+int mqtt_manager_enqueue(const char *topic, const char *data, int len, int qos, int retain, mqtt_priority_t priority);
+
+/**
+ * @brief Gives a fixed publish topic an MQTT 5 topic alias, so only its first
+ * message on each connection carries the topic string. Only QoS 0 messages
+ * use it, and only those queued while the outbox is empty leave the topic
+ * out. Up to MQTT5_TOPIC_ALIAS_MAX topics,
+ * in the order added; does nothing unless MQTT_PROTOCOL_V5 is set. Call
+ * before mqtt_manager_start().
+ * @param topic Full topic, must stay valid (e.g. from device_topic()).
+ * @return ESP_OK, ESP_ERR_NO_MEM when all aliases are taken.
+ */
+esp_err_t mqtt_manager_add_topic_alias(const char *topic);
+
+/**
+ * @brief Gets the enqueue and receive counters; outbox_bytes is read when called.
  */
-int mqtt_manager_publish(const char *topic, const char *data, int len, int qos, int retain);
+void mqtt_manager_get_stats(mqtt_manager_stats_t *stats);
 
 #endif // MQTT_MANAGER_H
@@ -0,0 +1,509 @@
+#include <inttypes.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "mqtt_router.h"
+
+// Power of two
+#define MQTT_ROUTER_BUCKETS 32
+#define MQTT_ROUTER_NONE    0xFF
+// Routes one message can match
+#define MQTT_ROUTER_MAX_MATCH 8
+
+typedef struct {
+    const char *filter;
+    uint16_t filter_len;
+    uint8_t qos;
+    uint8_t payload;        // mqtt_payload_type_t
+    uint8_t next;           // next route in the same bucket, MQTT_ROUTER_NONE at the end
+    uint32_t max_len;
+    mqtt_route_handler_t handler;
+    mqtt_route_fragment_handler_t fragment_handler;
+    void *arg;
+} mqtt_route_t;
+
+// Fragmented message in progress, esp-mqtt delivers one message at a time
+typedef struct {
+    bool active;
+    bool skipping;          // rest of a dropped message, its later fragments are ignored
+    uint32_t total_len;
+    uint32_t next_offset;
+    uint8_t match[MQTT_ROUTER_MAX_MATCH];   // routes still receiving this message
+    uint8_t match_count;
+    bool use_arena;         // some matched route wants the complete message
+    uint16_t topic_len;
+    char topic[MQTT_ROUTER_MAX_TOPIC_LEN];
+} mqtt_reassembly_t;
+
+static const char *TAG = "MQTT_ROUTER";
+
+static mqtt_route_t routes[MQTT_ROUTER_MAX_ROUTES];
+static uint8_t route_count = 0;
+// Exact topics, chained through mqtt_route_t.next
+static uint8_t buckets[MQTT_ROUTER_BUCKETS];
+static bool buckets_ready = false;
+// Filters with '+' or '#'
+static uint8_t wildcards[MQTT_ROUTER_MAX_ROUTES];
+static uint8_t wildcard_count = 0;
+
+typedef struct {
+    const char *filter;
+    uint8_t qos;
+} mqtt_subscription_t;
+
+static mqtt_subscription_t subscriptions[MQTT_ROUTER_MAX_SUBSCRIPTIONS];
+static uint8_t subscription_count = 0;
+
+static mqtt_reassembly_t pending;
+static char arena[MQTT_ROUTER_ARENA_SIZE];
+static mqtt_router_stats_t stats;
+
+static inline unsigned mqtt_router_bucket(const char *topic, int len) {
+    return ((unsigned)len * 7u ^ (unsigned char)topic[0] ^ ((unsigned char)topic[len - 1] << 2))
+           & (MQTT_ROUTER_BUCKETS - 1);
+}
+
+static bool mqtt_router_parse(mqtt_payload_type_t type, const char *data, int len, int32_t *value) {
+    *value = 0;
+    switch (type) {
+        case MQTT_PAYLOAD_RAW:
+            return true;
+        case MQTT_PAYLOAD_ON_OFF:
+            if ((len == 2 && memcmp(data, "ON", 2) == 0) || (len == 1 && data[0] == '1')) {
+                *value = 1;
+                return true;
+            }
+            return (len == 3 && memcmp(data, "OFF", 3) == 0) || (len == 1 && data[0] == '0');
+        case MQTT_PAYLOAD_INT: {
+            int i = 0;
+            bool neg = false;
+            int64_t v = 0;
+            if (len > 0 && (data[0] == '-' || data[0] == '+')) {
+                neg = data[0] == '-';
+                i = 1;
+            }
+            if (i == len) {
+                return false;
+            }
+            for (; i < len; i++) {
+                if (data[i] < '0' || data[i] > '9') {
+                    return false;
+                }
+                v = v * 10 + (data[i] - '0');
+                if (v > INT32_MAX) {
+                    return false;
+                }
+            }
+            *value = (int32_t)(neg ? -v : v);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool mqtt_topic_matches(const char *filter, const char *topic, int topic_len) {
+    const char *t = topic;
+    const char *end = topic + topic_len;
+
+    // wildcards at the first level don't match $SYS-style topics
+    if (topic_len > 0 && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+
+    while (*filter) {
+        if (*filter == '#') {
+            return true;    // also matches the parent level ("a/#" matches "a")
+        }
+        if (*filter == '+') {
+            while (t < end && *t != '/') t++;
+            filter++;
+        } else {
+            while (*filter && *filter != '/') {
+                if (t == end || *t != *filter) {
+                    return false;
+                }
+                t++;
+                filter++;
+            }
+            if (t < end && *t != '/') {
+                return false;
+            }
+        }
+        // both at a level separator or at the end
+        if (*filter == '/') {
+            if (t == end) {
+                return filter[1] == '#' && filter[2] == '\0';
+            }
+            filter++;
+            t++;
+        } else {
+            return t == end;
+        }
+    }
+    return t == end;
+}
+
+esp_err_t mqtt_router_add(const mqtt_route_config_t *cfg) {
+    if (cfg == NULL || cfg->filter == NULL || cfg->filter[0] == '\0'
+            || (cfg->handler == NULL) == (cfg->fragment_handler == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (route_count >= MQTT_ROUTER_MAX_ROUTES) {
+        ESP_LOGE(TAG, "Route table full, dropping %s", cfg->filter);
+        return ESP_ERR_NO_MEM;
+    }
+    if (!buckets_ready) {
+        memset(buckets, MQTT_ROUTER_NONE, sizeof(buckets));
+        buckets_ready = true;
+    }
+
+    uint8_t idx = route_count++;
+    mqtt_route_t *r = &routes[idx];
+    r->filter = cfg->filter;
+    r->filter_len = (uint16_t)strlen(cfg->filter);
+    r->qos = (uint8_t)cfg->qos;
+    r->payload = (uint8_t)cfg->payload;
+    r->max_len = cfg->max_len ? cfg->max_len : MQTT_ROUTER_DEFAULT_MAX_LEN;
+    r->handler = cfg->handler;
+    r->fragment_handler = cfg->fragment_handler;
+    r->arg = cfg->arg;
+    r->next = MQTT_ROUTER_NONE;
+
+    if (strpbrk(r->filter, "+#") != NULL) {
+        wildcards[wildcard_count++] = idx;
+    } else {
+        unsigned b = mqtt_router_bucket(r->filter, r->filter_len);
+        r->next = buckets[b];
+        buckets[b] = idx;
+    }
+    ESP_LOGD(TAG, "Route %u: %s (max %" PRIu32 " bytes)", idx, r->filter, r->max_len);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_router_register(const char *filter, int qos, mqtt_payload_type_t payload,
+                               mqtt_route_handler_t handler, void *arg) {
+    mqtt_route_config_t cfg = {
+        .filter = filter,
+        .qos = qos,
+        .payload = payload,
+        .handler = handler,
+        .arg = arg,
+    };
+    return mqtt_router_add(&cfg);
+}
+
+esp_err_t mqtt_router_subscribe(const char *filter, int qos) {
+    if (filter == NULL || filter[0] == '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (subscription_count >= MQTT_ROUTER_MAX_SUBSCRIPTIONS) {
+        ESP_LOGE(TAG, "Subscription table full, dropping %s", filter);
+        return ESP_ERR_NO_MEM;
+    }
+    subscriptions[subscription_count].filter = filter;
+    subscriptions[subscription_count].qos = (uint8_t)qos;
+    subscription_count++;
+    return ESP_OK;
+}
+
+/**
+ * True if every topic matching `filter` also matches `sub`. Exact filters
+ * are checked as topics; wildcard filters only against a trailing '#'.
+ */
+static bool mqtt_filter_covers(const char *sub, const char *filter) {
+    size_t sub_len = strlen(sub);
+
+    if (strpbrk(filter, "+#") == NULL) {
+        return mqtt_topic_matches(sub, filter, strlen(filter));
+    }
+    if (sub_len > 0 && sub[sub_len - 1] == '#') {
+        return strncmp(sub, filter, sub_len - 1) == 0;
+    }
+    return strcmp(sub, filter) == 0;
+}
+
+void mqtt_router_subscribe_all(esp_mqtt_client_handle_t client) {
+    for (uint8_t i = 0; i < subscription_count; i++) {
+        int msg_id = esp_mqtt_client_subscribe(client, subscriptions[i].filter, subscriptions[i].qos);
+        ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", subscriptions[i].filter, msg_id);
+    }
+
+    for (uint8_t i = 0; i < route_count; i++) {
+        // several handlers may share a filter, subscribe once
+        bool seen = false;
+        for (uint8_t j = 0; j < subscription_count && !seen; j++) {
+            seen = mqtt_filter_covers(subscriptions[j].filter, routes[i].filter);
+        }
+        for (uint8_t j = 0; j < i && !seen; j++) {
+            seen = strcmp(routes[j].filter, routes[i].filter) == 0;
+        }
+        if (!seen) {
+            int msg_id = esp_mqtt_client_subscribe(client, routes[i].filter, routes[i].qos);
+            ESP_LOGI(TAG, "Subscribed to %s, msg_id=%d", routes[i].filter, msg_id);
+        }
+    }
+}
+
+/**
+ * Collects the routes matching a topic, exact ones first.
+ */
+static int mqtt_router_match(const char *topic, int topic_len, uint8_t match[MQTT_ROUTER_MAX_MATCH]) {
+    int n = 0;
+
+    if (buckets_ready) {
+        for (uint8_t i = buckets[mqtt_router_bucket(topic, topic_len)]; i != MQTT_ROUTER_NONE; i = routes[i].next) {
+            const mqtt_route_t *r = &routes[i];
+            if (r->filter_len == topic_len && memcmp(r->filter, topic, topic_len) == 0 && n < MQTT_ROUTER_MAX_MATCH) {
+                match[n++] = i;
+            }
+        }
+    }
+    for (uint8_t i = 0; i < wildcard_count && n < MQTT_ROUTER_MAX_MATCH; i++) {
+        if (mqtt_topic_matches(routes[wildcards[i]].filter, topic, topic_len)) {
+            match[n++] = wildcards[i];
+        }
+    }
+    return n;
+}
+
+/**
+ * Whether a correlation id only has [A-Za-z0-9_-], so handlers can echo it
+ * in JSON or a topic without escaping.
+ */
+static bool mqtt_router_valid_cid(const char *cid, int len) {
+    for (int i = 0; i < len; i++) {
+        char c = cid[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Splits a trailing ";cid=<id>" off a payload. An invalid id stays in the
+ * payload, which then fails to parse.
+ */
+static void mqtt_router_split_cid(mqtt_route_msg_t *msg) {
+    const char *sep = memchr(msg->data, ';', msg->data_len);
+    if (sep == NULL) {
+        return;
+    }
+    const char *cid = sep + 5;
+    int cid_len = (int)(msg->data + msg->data_len - cid);
+    if (cid_len > 0 && cid_len <= MQTT_ROUTER_MAX_CID_LEN && memcmp(sep, ";cid=", 5) == 0
+        && mqtt_router_valid_cid(cid, cid_len)) {
+        msg->cid = cid;
+        msg->cid_len = cid_len;
+        msg->data_len = (int)(sep - msg->data);
+    }
+}
+
+static bool mqtt_router_call(const mqtt_route_t *r, const mqtt_route_msg_t *in) {
+    // each route parses its own copy, a RAW route sees the payload as sent
+    mqtt_route_msg_t msg = *in;
+    if (r->payload != MQTT_PAYLOAD_RAW) {
+        mqtt_router_split_cid(&msg);
+    }
+    if (!mqtt_router_parse(r->payload, msg.data, msg.data_len, &msg.value)) {
+        ESP_LOGW(TAG, "Invalid payload for %.*s: %.*s", msg.topic_len, msg.topic,
+                 msg.data_len < 32 ? msg.data_len : 32, msg.data);
+        return false;
+    }
+    r->handler(&msg, r->arg);
+    stats.delivered++;
+    return true;
+}
+
+static void mqtt_router_call_fragment(const mqtt_route_t *r, const mqtt_route_fragment_t *frag) {
+    r->fragment_handler(frag, r->arg);
+    if (frag->offset + frag->data_len == frag->total_len) {
+        stats.delivered++;
+    }
+}
+
+static void mqtt_router_drop_oversize(const mqtt_route_t *r, const char *topic, int topic_len, uint32_t len) {
+    stats.dropped_oversize++;
+    ESP_LOGW(TAG, "Dropping %" PRIu32 " byte message on %.*s for %s (max %" PRIu32 ")",
+             len, topic_len, topic, r->filter, r->max_len);
+}
+
+int mqtt_router_dispatch(const char *topic, int topic_len, const char *data, int data_len) {
+    return mqtt_router_dispatch_fragment(topic, topic_len, data, data_len, 0, data_len);
+}
+
+/**
+ * Starts a fragmented message: remembers the topic and the routes that take it.
+ */
+static int mqtt_router_begin(const char *topic, int topic_len, uint32_t total_len) {
+    uint8_t match[MQTT_ROUTER_MAX_MATCH];
+    int n = mqtt_router_match(topic, topic_len, match);
+
+    pending.active = false;
+    if (n == 0) {
+        ESP_LOGW(TAG, "Unhandled topic: %.*s", topic_len, topic);
+        return 0;
+    }
+    if (topic_len > MQTT_ROUTER_MAX_TOPIC_LEN) {
+        stats.dropped_topic++;
+        ESP_LOGW(TAG, "Topic of fragmented message too long (%d bytes)", topic_len);
+        return 0;
+    }
+
+    pending.match_count = 0;
+    pending.use_arena = false;
+    for (int i = 0; i < n; i++) {
+        const mqtt_route_t *r = &routes[match[i]];
+        if (total_len > r->max_len) {
+            mqtt_router_drop_oversize(r, topic, topic_len, total_len);
+            continue;
+        }
+        if (r->handler && total_len > MQTT_ROUTER_ARENA_SIZE) {
+            stats.dropped_arena++;
+            ESP_LOGW(TAG, "Dropping %" PRIu32 " byte message on %.*s, arena holds %d",
+                     total_len, topic_len, topic, MQTT_ROUTER_ARENA_SIZE);
+            continue;
+        }
+        pending.use_arena |= r->handler != NULL;
+        pending.match[pending.match_count++] = match[i];
+    }
+    if (pending.match_count == 0) {
+        return 0;
+    }
+
+    memcpy(pending.topic, topic, topic_len);
+    pending.topic_len = (uint16_t)topic_len;
+    pending.total_len = total_len;
+    pending.next_offset = 0;
+    pending.active = true;
+    pending.skipping = false;
+    return pending.match_count;
+}
+
+/**
+ * Ignores the rest of a fragmented message, so it is counted once.
+ */
+static void mqtt_router_skip(uint32_t next_offset, uint32_t total_len) {
+    pending.active = false;
+    pending.skipping = true;
+    pending.next_offset = next_offset;
+    pending.total_len = total_len;
+}
+
+int mqtt_router_dispatch_fragment(const char *topic, int topic_len, const char *data, int data_len,
+                                  int offset, int total_len) {
+    int called = 0;
+
+    if (data_len < 0 || offset < 0 || total_len < data_len + offset) {
+        return 0;
+    }
+
+    // Complete message: dispatch in place, nothing is copied
+    if (offset == 0 && data_len == total_len) {
+        uint8_t match[MQTT_ROUTER_MAX_MATCH];
+        pending.active = false;
+        pending.skipping = false;
+        if (topic == NULL || topic_len <= 0) {
+            return 0;
+        }
+        int n = mqtt_router_match(topic, topic_len, match);
+        if (n == 0) {
+            ESP_LOGW(TAG, "Unhandled topic: %.*s", topic_len, topic);
+            return 0;
+        }
+        mqtt_route_msg_t msg = {
+            .topic = topic,
+            .topic_len = topic_len,
+            .data = data,
+            .data_len = data_len,
+            .rx_us = esp_timer_get_time(),
+        };
+        mqtt_route_fragment_t frag = {
+            .topic = topic,
+            .topic_len = topic_len,
+            .data = data,
+            .data_len = data_len,
+            .offset = 0,
+            .total_len = (uint32_t)total_len,
+        };
+        for (int i = 0; i < n; i++) {
+            const mqtt_route_t *r = &routes[match[i]];
+            if ((uint32_t)data_len > r->max_len) {
+                mqtt_router_drop_oversize(r, topic, topic_len, data_len);
+            } else if (r->handler) {
+                called += mqtt_router_call(r, &msg);
+            } else {
+                mqtt_router_call_fragment(r, &frag);
+                called++;
+            }
+        }
+        return called;
+    }
+
+    if (offset == 0) {
+        if (topic == NULL || topic_len <= 0 || mqtt_router_begin(topic, topic_len, total_len) == 0) {
+            mqtt_router_skip(data_len, total_len);
+            return 0;
+        }
+    } else if ((!pending.active && !pending.skipping) || (uint32_t)offset != pending.next_offset
+               || (uint32_t)total_len != pending.total_len) {
+        // a fragment went missing or the start was never seen
+        stats.dropped_sequence++;
+        mqtt_router_skip(offset + data_len, total_len);
+        return 0;
+    } else if (pending.skipping) {
+        // rest of a message already dropped, and counted, at its start
+        pending.next_offset = offset + data_len;
+        return 0;
+    }
+
+    if (pending.use_arena) {
+        memcpy(arena + offset, data, data_len);
+    }
+    pending.next_offset = offset + data_len;
+
+    mqtt_route_fragment_t frag = {
+        .topic = pending.topic,
+        .topic_len = pending.topic_len,
+        .data = data,
+        .data_len = data_len,
+        .offset = (uint32_t)offset,
+        .total_len = pending.total_len,
+    };
+    for (int i = 0; i < pending.match_count; i++) {
+        const mqtt_route_t *r = &routes[pending.match[i]];
+        if (r->fragment_handler) {
+            mqtt_router_call_fragment(r, &frag);
+            called++;
+        }
+    }
+
+    if (pending.next_offset < pending.total_len) {
+        return called;
+    }
+
+    // last fragment: hand the reassembled message to the other routes
+    mqtt_route_msg_t msg = {
+        .topic = pending.topic,
+        .topic_len = pending.topic_len,
+        .data = arena,
+        .data_len = (int)pending.total_len,
+        .rx_us = esp_timer_get_time(),
+    };
+    for (int i = 0; i < pending.match_count; i++) {
+        const mqtt_route_t *r = &routes[pending.match[i]];
+        if (r->handler) {
+            called += mqtt_router_call(r, &msg);
+        }
+    }
+    if (pending.use_arena) {
+        stats.reassembled++;
+    }
+    pending.active = false;
+    return called;
+}
+
+void mqtt_router_get_stats(mqtt_router_stats_t *out) {
+    *out = stats;
+}
@@ -0,0 +1,183 @@
+#ifndef MQTT_ROUTER_H
+#define MQTT_ROUTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#ifndef MQTT_ROUTER_MAX_ROUTES
+#define MQTT_ROUTER_MAX_ROUTES 64
+#endif
+// Subscriptions added with mqtt_router_subscribe()
+#ifndef MQTT_ROUTER_MAX_SUBSCRIPTIONS
+#define MQTT_ROUTER_MAX_SUBSCRIPTIONS 8
+#endif
+// Largest message a route accepts unless it sets max_len
+#ifndef MQTT_ROUTER_DEFAULT_MAX_LEN
+#define MQTT_ROUTER_DEFAULT_MAX_LEN 256
+#endif
+// Reassembly buffer for messages esp-mqtt delivers in several fragments
+#ifndef MQTT_ROUTER_ARENA_SIZE
+#define MQTT_ROUTER_ARENA_SIZE 4096
+#endif
+// Longest topic of a fragmented message (only the first fragment carries it)
+#define MQTT_ROUTER_MAX_TOPIC_LEN 128
+// Longest correlation id, see mqtt_route_msg_t
+#define MQTT_ROUTER_MAX_CID_LEN 32
+
+/**
+ * @brief How the router parses a payload before calling the handler.
+ * Parsed payloads may end with ";cid=<id>", a correlation id the handler
+ * echoes in its reply; it is split off before parsing. <id> is 1 to
+ * MQTT_ROUTER_MAX_CID_LEN of [A-Za-z0-9_-], other ids fail the parse.
+ */
+typedef enum {
+    MQTT_PAYLOAD_RAW = 0,   // no parsing, value is 0
+    MQTT_PAYLOAD_INT,       // decimal integer, optional sign
+    MQTT_PAYLOAD_ON_OFF,    // "ON"/"OFF" (or "1"/"0"), value is 1/0
+} mqtt_payload_type_t;
+
+/**
+ * @brief A routed message. Topic and data point into the MQTT client's
+ * buffer, are not NUL-terminated and are only valid during the handler call;
+ * a handler that needs them longer copies what it keeps (see fan_actuator.c).
+ */
+typedef struct {
+    const char *topic;
+    int topic_len;
+    const char *data;
+    int data_len;
+    int32_t value;          // parsed payload, see mqtt_payload_type_t
+    const char *cid;        // correlation id, not NUL-terminated, NULL if none
+    int cid_len;
+    int64_t rx_us;          // esp_timer time the message was received
+} mqtt_route_msg_t;
+
+typedef void (*mqtt_route_handler_t)(const mqtt_route_msg_t *msg, void *arg);
+
+/**
+ * @brief A piece of a message, as handed to fragment handlers.
+ */
+typedef struct {
+    const char *topic;      // topic of the whole message
+    int topic_len;
+    const char *data;       // this fragment only
+    int data_len;
+    uint32_t offset;        // position of data in the message
+    uint32_t total_len;     // length of the whole message
+} mqtt_route_fragment_t;
+
+/**
+ * @brief Streaming handler. Called for every fragment in order; the last
+ * one has offset + data_len == total_len.
+ */
+typedef void (*mqtt_route_fragment_handler_t)(const mqtt_route_fragment_t *frag, void *arg);
+
+/**
+ * @brief Full route description for mqtt_router_add().
+ * Set exactly one of handler and fragment_handler.
+ */
+typedef struct {
+    const char *filter;         // must stay valid (string literal or static)
+    int qos;
+    mqtt_payload_type_t payload;    // parser for handler, ignored for fragment_handler
+    uint32_t max_len;           // larger messages are dropped, 0 for MQTT_ROUTER_DEFAULT_MAX_LEN
+    mqtt_route_handler_t handler;   // complete messages, reassembled if fragmented
+    mqtt_route_fragment_handler_t fragment_handler; // fragments as they arrive, no copy
+    void *arg;
+} mqtt_route_config_t;
+
+/**
+ * @brief Router counters.
+ */
+typedef struct {
+    uint32_t delivered;         // handler calls (fragment handlers count once per message)
+    uint32_t reassembled;       // fragmented messages delivered from the arena
+    uint32_t dropped_oversize;  // route skipped, message above its max_len
+    uint32_t dropped_arena;     // route skipped, message above MQTT_ROUTER_ARENA_SIZE
+    uint32_t dropped_sequence;  // fragmented message cut short: a fragment missing or out of order
+    uint32_t dropped_topic;     // fragmented message with a topic above MQTT_ROUTER_MAX_TOPIC_LEN
+} mqtt_router_stats_t;
+
+/**
+ * @brief Adds a route.
+ * Filters may contain '+' (one level) and '#' (remaining levels) wildcards.
+ * Call before mqtt_manager_start(); the table is not locked.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the table is full, ESP_ERR_INVALID_ARG.
+ */
+esp_err_t mqtt_router_add(const mqtt_route_config_t *cfg);
+
+/**
+ * @brief Registers a handler for complete messages up to MQTT_ROUTER_DEFAULT_MAX_LEN.
+ * Filters may contain '+' (one level) and '#' (remaining levels) wildcards.
+ * Call before mqtt_manager_start(); the table is not locked.
+ *
+ * @param filter Topic filter, must stay valid (string literal or static).
+ * @param qos Subscription QoS.
+ * @param payload How to parse the payload; messages that don't parse are dropped.
+ * @param handler Called from the MQTT client task.
+ * @param arg Passed to handler.
+ * @return ESP_OK, ESP_ERR_NO_MEM if the table is full, ESP_ERR_INVALID_ARG.
+ */
+esp_err_t mqtt_router_register(const char *filter, int qos, mqtt_payload_type_t payload,
+                               mqtt_route_handler_t handler, void *arg);
+
+/**
+ * @brief Adds a subscription that covers several routes, e.g. "devices/<id>/cmd/#".
+ * Routes whose filter falls under it get no subscription of their own, so
+ * the broker sees one filter per device instead of one per command.
+ * Call before mqtt_manager_start(); the table is not locked.
+ *
+ * @param filter Topic filter, must stay valid (string literal or static).
+ * @param qos Subscription QoS.
+ * @return ESP_OK, ESP_ERR_NO_MEM if the table is full, ESP_ERR_INVALID_ARG.
+ */
+esp_err_t mqtt_router_subscribe(const char *filter, int qos);
+
+/**
+ * @brief Subscribes the client to the mqtt_router_subscribe() filters and to
+ * every route filter they don't cover. Called on MQTT_EVENT_CONNECTED.
+ */
+void mqtt_router_subscribe_all(esp_mqtt_client_handle_t client);
+
+/**
+ * @brief Dispatches a complete inbound message to the matching handlers.
+ * Exact topics are found through a hash on length and first/last character,
+ * wildcard filters are matched afterwards.
+ *
+ * @return Number of handlers called.
+ */
+int mqtt_router_dispatch(const char *topic, int topic_len, const char *data, int data_len);
+
+/**
+ * @brief Dispatches one MQTT_EVENT_DATA, which may be a fragment.
+ * esp-mqtt splits messages larger than its buffer into consecutive events;
+ * only the first carries the topic. Fragment handlers get each piece right
+ * away, message handlers get the message once the last piece has been
+ * copied into the arena. Only called from the MQTT client task.
+ *
+ * @param topic Topic, only in the first fragment.
+ * @param topic_len Topic length, 0 in later fragments.
+ * @param data Fragment data.
+ * @param data_len Fragment length.
+ * @param offset event->current_data_offset.
+ * @param total_len event->total_data_len.
+ * @return Number of handlers called for this event.
+ */
+int mqtt_router_dispatch_fragment(const char *topic, int topic_len, const char *data, int data_len,
+                                  int offset, int total_len);
+
+/**
+ * @brief Gets router counters. Safe from any task: each counter is a word
+ * written by the MQTT client task only, the set is not a snapshot.
+ */
+void mqtt_router_get_stats(mqtt_router_stats_t *stats);
+
+/**
+ * @brief Matches a topic against an MQTT topic filter.
+ */
+bool mqtt_topic_matches(const char *filter, const char *topic, int topic_len);
+
+#endif // MQTT_ROUTER_H
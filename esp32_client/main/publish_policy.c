@@ -0,0 +1,232 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "publish_policy.h"
+
+static const char *TAG = "PUBLISH_POLICY";
+
+// Config is written by the MQTT client task and read by the publish task
+static publish_policy_config_t config;
+static portMUX_TYPE config_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Publish task only
+static telemetry_record_t last;
+static uint32_t last_ms;
+static uint32_t last_deadband_ms;
+static bool published = false;
+static publish_policy_stats_t stats;
+
+static const char *const reason_names[PUBLISH_REASON_MAX] = {
+    [PUBLISH_REASON_NONE] = "none",
+    [PUBLISH_REASON_FIRST] = "first",
+    [PUBLISH_REASON_STATE] = "state",
+    [PUBLISH_REASON_JUMP] = "jump",
+    [PUBLISH_REASON_DEADBAND] = "deadband",
+    [PUBLISH_REASON_HEARTBEAT] = "heartbeat",
+};
+
+void publish_policy_init(const publish_policy_config_t *cfg) {
+    portENTER_CRITICAL(&config_mux);
+    config = *cfg;
+    portEXIT_CRITICAL(&config_mux);
+    published = false;
+}
+
+void publish_policy_get_config(publish_policy_config_t *cfg) {
+    portENTER_CRITICAL(&config_mux);
+    *cfg = config;
+    portEXIT_CRITICAL(&config_mux);
+}
+
+/**
+ * Points the key at the field it sets, NULL if unknown.
+ */
+static uint32_t *publish_policy_field32(publish_policy_config_t *cfg, const char *key, int key_len) {
+    if (key_len == 15 && memcmp(key, "min_interval_ms", 15) == 0) {
+        return &cfg->min_interval_ms;
+    }
+    if (key_len == 12 && memcmp(key, "heartbeat_ms", 12) == 0) {
+        return &cfg->heartbeat_ms;
+    }
+    return NULL;
+}
+
+static uint16_t *publish_policy_field16(publish_policy_config_t *cfg, const char *key, int key_len) {
+    static const struct {
+        const char *name;
+        publish_metric_t metric;
+    } prefixes[] = {
+        { "temp_", PUBLISH_METRIC_TEMPERATURE },
+        { "humidity_", PUBLISH_METRIC_HUMIDITY },
+    };
+
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        int n = (int)strlen(prefixes[i].name);
+        if (key_len <= n || memcmp(key, prefixes[i].name, n) != 0) {
+            continue;
+        }
+        publish_deadband_t *db = &cfg->deadband[prefixes[i].metric];
+        const char *field = key + n;
+        int field_len = key_len - n;
+        if (field_len == 3 && memcmp(field, "abs", 3) == 0) {
+            return &db->abs;
+        }
+        if (field_len == 3 && memcmp(field, "rel", 3) == 0) {
+            return &db->rel_permille;
+        }
+        if (field_len == 4 && memcmp(field, "jump", 4) == 0) {
+            return &db->jump;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t publish_policy_configure(const char *data, int len) {
+    publish_policy_config_t cfg;
+    const char *p = data;
+    const char *end = data + len;
+
+    publish_policy_get_config(&cfg);
+    while (p < end) {
+        const char *key = p;
+        while (p < end && *p != '=') p++;
+        int key_len = (int)(p - key);
+        if (p == end || key_len == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        p++;
+
+        uint32_t value = 0;
+        const char *digits = p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            uint32_t digit = (uint32_t)(*p++ - '0');
+            if (value > (UINT32_MAX - digit) / 10) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            value = value * 10 + digit;
+        }
+        if (p == digits || (p < end && *p != ',')) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (p < end) {
+            p++;    // ','
+        }
+
+        uint32_t *field32 = publish_policy_field32(&cfg, key, key_len);
+        uint16_t *field16 = publish_policy_field16(&cfg, key, key_len);
+        if (field32) {
+            *field32 = value;
+        } else if (field16 && value <= UINT16_MAX) {
+            *field16 = (uint16_t)value;
+        } else {
+            ESP_LOGW(TAG, "Invalid policy setting %.*s", key_len, key);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    portENTER_CRITICAL(&config_mux);
+    config = cfg;
+    portEXIT_CRITICAL(&config_mux);
+    ESP_LOGI(TAG, "Policy: min_interval %" PRIu32 " ms, heartbeat %" PRIu32 " ms, temp %u/%u/%u, humidity %u/%u/%u",
+             cfg.min_interval_ms, cfg.heartbeat_ms,
+             cfg.deadband[PUBLISH_METRIC_TEMPERATURE].abs, cfg.deadband[PUBLISH_METRIC_TEMPERATURE].rel_permille,
+             cfg.deadband[PUBLISH_METRIC_TEMPERATURE].jump,
+             cfg.deadband[PUBLISH_METRIC_HUMIDITY].abs, cfg.deadband[PUBLISH_METRIC_HUMIDITY].rel_permille,
+             cfg.deadband[PUBLISH_METRIC_HUMIDITY].jump);
+    return ESP_OK;
+}
+
+/**
+ * Classifies the change of one metric against its deadband.
+ */
+static publish_reason_t publish_policy_metric(const publish_deadband_t *db, int16_t value, int16_t reference) {
+    uint32_t delta = (uint32_t)abs((int32_t)value - reference);
+    uint32_t rel = (uint32_t)abs(reference) * db->rel_permille / 1000;
+    uint32_t threshold = db->abs > rel ? db->abs : rel;
+
+    if (delta == 0) {
+        return PUBLISH_REASON_NONE;
+    }
+    if (db->jump && delta >= db->jump) {
+        return PUBLISH_REASON_JUMP;
+    }
+    return delta >= threshold ? PUBLISH_REASON_DEADBAND : PUBLISH_REASON_NONE;
+}
+
+static publish_reason_t publish_policy_compare(const publish_policy_config_t *cfg, const telemetry_record_t *rec) {
+    publish_reason_t reason = PUBLISH_REASON_NONE;
+
+    if (rec->fan_on != last.fan_on || rec->fan_duty != last.fan_duty || rec->sensor_count != last.sensor_count) {
+        return PUBLISH_REASON_STATE;
+    }
+    for (uint8_t i = 0; i < rec->sensor_count && i < TELEMETRY_MAX_SENSORS; i++) {
+        const telemetry_sensor_t *s = &rec->sensors[i];
+        const telemetry_sensor_t *ref = &last.sensors[i];
+        if (s->valid != ref->valid) {
+            return PUBLISH_REASON_STATE;
+        }
+        if (!s->valid) {
+            continue;
+        }
+        publish_reason_t r[] = {
+            publish_policy_metric(&cfg->deadband[PUBLISH_METRIC_TEMPERATURE], s->temperature, ref->temperature),
+            publish_policy_metric(&cfg->deadband[PUBLISH_METRIC_HUMIDITY], s->humidity, ref->humidity),
+        };
+        for (size_t j = 0; j < sizeof(r) / sizeof(r[0]); j++) {
+            if (r[j] == PUBLISH_REASON_JUMP) {
+                return PUBLISH_REASON_JUMP;
+            }
+            if (r[j] == PUBLISH_REASON_DEADBAND) {
+                reason = PUBLISH_REASON_DEADBAND;
+            }
+        }
+    }
+    return reason;
+}
+
+publish_reason_t publish_policy_check(const telemetry_record_t *rec, uint32_t now_ms) {
+    publish_policy_config_t cfg;
+    publish_reason_t reason;
+
+    publish_policy_get_config(&cfg);
+    if (!published) {
+        reason = PUBLISH_REASON_FIRST;
+    } else {
+        reason = publish_policy_compare(&cfg, rec);
+        // small changes are rate limited, state changes and jumps are not
+        if (reason == PUBLISH_REASON_DEADBAND && now_ms - last_deadband_ms < cfg.min_interval_ms) {
+            reason = PUBLISH_REASON_NONE;
+        }
+        if (reason == PUBLISH_REASON_NONE && now_ms - last_ms >= cfg.heartbeat_ms) {
+            reason = PUBLISH_REASON_HEARTBEAT;
+        }
+    }
+
+    if (reason == PUBLISH_REASON_NONE) {
+        stats.suppressed++;
+        return reason;
+    }
+    stats.sent[reason]++;
+    last = *rec;
+    last_ms = now_ms;
+    if (reason == PUBLISH_REASON_DEADBAND) {
+        last_deadband_ms = now_ms;
+    }
+    published = true;
+    return reason;
+}
+
+void publish_policy_get_stats(publish_policy_stats_t *out) {
+    *out = stats;
+}
+
+const char *publish_reason_name(publish_reason_t reason) {
+    if ((unsigned)reason >= PUBLISH_REASON_MAX) {
+        return "?";
+    }
+    return reason_names[reason];
+}
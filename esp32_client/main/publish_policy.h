@@ -0,0 +1,94 @@
+#ifndef PUBLISH_POLICY_H
+#define PUBLISH_POLICY_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "telemetry.h"
+
+/**
+ * @brief Metrics with a deadband, per sensor.
+ */
+typedef enum {
+    PUBLISH_METRIC_TEMPERATURE = 0,
+    PUBLISH_METRIC_HUMIDITY,
+    PUBLISH_METRIC_MAX,
+} publish_metric_t;
+
+/**
+ * @brief Change thresholds of one metric, compared against the last
+ * published value. Units are those of the record (tenths).
+ */
+typedef struct {
+    uint16_t abs;           // publish once |change| >= abs
+    uint16_t rel_permille;  // ... or >= |last| * rel_permille / 1000, whichever is larger
+    uint16_t jump;          // publish right away, even inside min_interval_ms; 0 disables
+} publish_deadband_t;
+
+typedef struct {
+    publish_deadband_t deadband[PUBLISH_METRIC_MAX];
+    uint32_t min_interval_ms;   // shortest time between two deadband publishes
+    uint32_t heartbeat_ms;      // longest silence, a record is sent after this even if nothing changed
+} publish_policy_config_t;
+
+/**
+ * @brief Why a record was (or wasn't) published.
+ */
+typedef enum {
+    PUBLISH_REASON_NONE = 0,    // suppressed
+    PUBLISH_REASON_FIRST,       // nothing published yet
+    PUBLISH_REASON_STATE,       // fan on/off or duty changed, or a sensor failed/recovered
+    PUBLISH_REASON_JUMP,        // a metric moved by at least its jump threshold
+    PUBLISH_REASON_DEADBAND,    // a metric left its deadband
+    PUBLISH_REASON_HEARTBEAT,   // heartbeat_ms of silence
+    PUBLISH_REASON_MAX,
+} publish_reason_t;
+
+typedef struct {
+    uint32_t suppressed;                    // records not published
+    uint32_t sent[PUBLISH_REASON_MAX];      // published records per reason, [NONE] unused
+} publish_policy_stats_t;
+
+/**
+ * @brief Sets the policy and forgets the last published record.
+ */
+void publish_policy_init(const publish_policy_config_t *cfg);
+
+/**
+ * @brief Updates the policy from a command payload. Only the keys present
+ * change; nothing changes if any key or value is invalid.
+ * Keys: min_interval_ms, heartbeat_ms, temp_abs, temp_rel, temp_jump,
+ * humidity_abs, humidity_rel, humidity_jump, e.g. "heartbeat_ms=600000,temp_abs=5".
+ *
+ * @param data Payload, not NUL-terminated.
+ * @param len Payload length.
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG.
+ */
+esp_err_t publish_policy_configure(const char *data, int len);
+
+/**
+ * @brief Gets the current policy.
+ */
+void publish_policy_get_config(publish_policy_config_t *cfg);
+
+/**
+ * @brief Decides whether a sampled record is published. A record that is
+ * published becomes the new reference for the deadbands.
+ * Only called from the publish task.
+ *
+ * @param rec Sampled record (seq and timestamp are not compared).
+ * @param now_ms Monotonic time.
+ * @return Reason to publish, PUBLISH_REASON_NONE to drop the record.
+ */
+publish_reason_t publish_policy_check(const telemetry_record_t *rec, uint32_t now_ms);
+
+/**
+ * @brief Gets the sent/suppressed counters.
+ */
+void publish_policy_get_stats(publish_policy_stats_t *stats);
+
+/**
+ * @brief Gets a short name for a reason ("heartbeat", ...).
+ */
+const char *publish_reason_name(publish_reason_t reason);
+
+#endif // PUBLISH_POLICY_H
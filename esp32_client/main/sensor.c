@@ -0,0 +1,109 @@
+#include <stdbool.h>
+
+#include "sensor.h"
+
+// Sensors handed to one read_batch call
+#define SENSOR_MAX_BATCH 8
+
+esp_err_t sensor_init(sensor_t *sensor) {
+    if (sensor == NULL || sensor->driver == NULL || sensor->driver->init == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return sensor->driver->init(sensor);
+}
+
+esp_err_t sensor_start(sensor_t *sensor) {
+    if (sensor == NULL || sensor->driver == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sensor->driver->start == NULL) {
+        return ESP_OK;
+    }
+    return sensor->driver->start(sensor);
+}
+
+esp_err_t sensor_read(sensor_t *sensor, sensor_reading_t *reading) {
+    if (sensor == NULL || sensor->driver == NULL || reading == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return sensor->driver->read(sensor, reading);
+}
+
+void sensor_caps(const sensor_t *sensor, sensor_caps_t *caps) {
+    caps->flags = 0;
+    caps->min_interval_ms = 0;
+    caps->conversion_ms = 0;
+    if (sensor != NULL && sensor->driver != NULL && sensor->driver->caps != NULL) {
+        sensor->driver->caps(sensor, caps);
+    }
+}
+
+static void sensor_read_batches(sensor_t *sensors, size_t count,
+                                sensor_reading_t *readings, esp_err_t *status) {
+    sensor_t *batch[SENSOR_MAX_BATCH];
+    size_t index[SENSOR_MAX_BATCH];
+    sensor_reading_t batch_readings[SENSOR_MAX_BATCH];
+    esp_err_t batch_status[SENSOR_MAX_BATCH];
+    bool queued[count > 0 ? count : 1];
+
+    for (size_t i = 0; i < count; i++) {
+        queued[i] = false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const sensor_driver_t *drv = sensors[i].driver;
+        if (queued[i] || drv->read_batch == NULL) {
+            continue;
+        }
+
+        // everything else on the same backend goes into this batch
+        size_t n = 0;
+        for (size_t j = i; j < count && n < SENSOR_MAX_BATCH; j++) {
+            if (!queued[j] && sensors[j].driver == drv) {
+                queued[j] = true;
+                batch[n] = &sensors[j];
+                index[n++] = j;
+            }
+        }
+
+        // a backend that gives up early leaves status unset, count those as failed
+        for (size_t k = 0; k < n; k++) {
+            batch_status[k] = ESP_FAIL;
+        }
+        drv->read_batch(batch, n, batch_readings, batch_status);
+        for (size_t k = 0; k < n; k++) {
+            status[index[k]] = batch_status[k];
+            if (batch_status[k] == ESP_OK) {
+                readings[index[k]] = batch_readings[k];
+            }
+        }
+    }
+}
+
+esp_err_t sensor_read_all(sensor_t *sensors, size_t count,
+                          sensor_reading_t *readings, esp_err_t *status) {
+    if (sensors == NULL || readings == NULL || status == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // kick off the unbatched sensors first so they convert while the batches run
+    for (size_t i = 0; i < count; i++) {
+        status[i] = ESP_OK;
+        if (sensors[i].driver->read_batch == NULL) {
+            status[i] = sensor_start(&sensors[i]);
+        }
+    }
+
+    sensor_read_batches(sensors, count, readings, status);
+
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < count; i++) {
+        if (sensors[i].driver->read_batch == NULL && status[i] == ESP_OK) {
+            status[i] = sensor_read(&sensors[i], &readings[i]);
+        }
+        if (status[i] != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+    }
+    return ret;
+}
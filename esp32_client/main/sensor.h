@@ -0,0 +1,101 @@
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// sensor_caps_t.flags
+#define SENSOR_CAP_TEMPERATURE  (1u << 0)
+#define SENSOR_CAP_HUMIDITY     (1u << 1)
+#define SENSOR_CAP_ASYNC        (1u << 2)   // start() returns before the measurement is done
+
+/**
+ * @brief One measurement, fixed point like the rest of the telemetry path.
+ */
+typedef struct {
+    int16_t temperature;    // degrees Celsius * 10
+    int16_t humidity;       // percent * 10
+} sensor_reading_t;
+
+/**
+ * @brief What a sensor can do and how fast.
+ */
+typedef struct {
+    uint32_t flags;             // SENSOR_CAP_* bits
+    uint32_t min_interval_ms;   // shortest supported time between two measurements
+    uint32_t conversion_ms;     // time from start() until read() can return a value
+} sensor_caps_t;
+
+typedef struct sensor sensor_t;
+
+/**
+ * @brief Backend operations. Every backend provides init, read and caps;
+ * start and read_batch are optional.
+ */
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(sensor_t *sensor);
+    // Trigger a measurement; NULL when read() does the whole job
+    esp_err_t (*start)(sensor_t *sensor);
+    // Fetch the measurement, waiting for a pending start() if needed
+    esp_err_t (*read)(sensor_t *sensor, sensor_reading_t *reading);
+    void (*caps)(const sensor_t *sensor, sensor_caps_t *caps);
+    // Measure several sensors of this backend in one pass, NULL if not supported.
+    // status[] comes in as ESP_FAIL, entries left alone count as failed.
+    esp_err_t (*read_batch)(sensor_t *const *sensors, size_t count,
+                            sensor_reading_t *readings, esp_err_t *status);
+} sensor_driver_t;
+
+/**
+ * @brief A configured sensor instance. `config` points to the backend's
+ * config struct (sensor_dht_config_t, sensor_i2c_config_t, ...).
+ */
+struct sensor {
+    const sensor_driver_t *driver;
+    const void *config;
+    void *ctx;              // backend state, set up by init
+};
+
+/**
+ * @brief Initializes a sensor through its backend.
+ * @return ESP_OK on success, or the backend error.
+ */
+esp_err_t sensor_init(sensor_t *sensor);
+
+/**
+ * @brief Starts a measurement. A no-op for backends without a start step.
+ * @return ESP_OK if the measurement was triggered.
+ */
+esp_err_t sensor_start(sensor_t *sensor);
+
+/**
+ * @brief Reads a measurement, completing a previous sensor_start() if any.
+ * @param sensor Sensor.
+ * @param[out] reading Values, only valid on ESP_OK.
+ * @return ESP_OK on success, or the backend error.
+ */
+esp_err_t sensor_read(sensor_t *sensor, sensor_reading_t *reading);
+
+/**
+ * @brief Gets the capabilities of a sensor.
+ */
+void sensor_caps(const sensor_t *sensor, sensor_caps_t *caps);
+
+/**
+ * @brief Reads several sensors, overlapping their measurements.
+ * Sensors whose backend supports batching are read in one batch per backend;
+ * the others are all started first and read afterwards, so their
+ * conversion times overlap.
+ *
+ * @param sensors Sensors to read.
+ * @param count Number of sensors.
+ * @param[out] readings One reading per sensor.
+ * @param[out] status One result per sensor, readings[i] is valid when status[i] is ESP_OK.
+ * @return ESP_OK if every sensor was read, ESP_FAIL otherwise.
+ */
+esp_err_t sensor_read_all(sensor_t *sensors, size_t count,
+                          sensor_reading_t *readings, esp_err_t *status);
+
+#endif // SENSOR_H
@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "sensor_dht.h"
+
+// A read takes ~25 ms plus the start pulse; allow for a few queued ahead of us
+#define SENSOR_DHT_READ_TIMEOUT_MS 500
+
+typedef struct {
+    SemaphoreHandle_t done;
+    bool pending;
+    dht_reading_t reading;
+} sensor_dht_ctx_t;
+
+static const char *TAG = "SENSOR_DHT";
+
+static void sensor_dht_read_done(const dht_reading_t *reading, void *arg) {
+    sensor_dht_ctx_t *ctx = (sensor_dht_ctx_t *)arg;
+    ctx->reading = *reading;
+    xSemaphoreGive(ctx->done);
+}
+
+/**
+ * @brief Reads through the driver's last good value store. A value the
+ * sensor's rate limit held back is served as is; the last good value after
+ * a failed read is not, the failure is returned instead.
+ */
+static esp_err_t sensor_dht_read_cached(const sensor_dht_config_t *cfg, sensor_reading_t *reading) {
+    dht_cached_reading_t cached;
+
+    esp_err_t ret = dht_read_cached(cfg->sensor_type, cfg->pin, cfg->max_age_ms, &cached);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (cached.stale && cached.last_status != ESP_OK) {
+        return cached.last_status;
+    }
+    reading->humidity = cached.humidity;
+    reading->temperature = cached.temperature;
+    return ESP_OK;
+}
+
+static esp_err_t sensor_dht_init(sensor_t *sensor) {
+    const sensor_dht_config_t *cfg = sensor->config;
+
+    esp_err_t ret = gpio_set_pull_mode(cfg->pin, GPIO_PULLUP_ONLY);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set DHT pin %d pull-up: %s", (int)cfg->pin, esp_err_to_name(ret));
+    }
+
+    ret = dht_init(cfg->pin, cfg->mode);
+    if (ret != ESP_OK && cfg->mode != DHT_CAPTURE_POLLING) {
+        ESP_LOGE(TAG, "DHT capture init failed on pin %d: %s. Falling back to polling.", (int)cfg->pin, esp_err_to_name(ret));
+        ret = dht_init(cfg->pin, DHT_CAPTURE_POLLING);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    sensor_dht_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->done = xSemaphoreCreateBinary();
+    if (ctx->done == NULL) {
+        free(ctx);
+        return ESP_ERR_NO_MEM;
+    }
+    sensor->ctx = ctx;
+    ESP_LOGI(TAG, "DHT sensor on pin %d ready.", (int)cfg->pin);
+    return ESP_OK;
+}
+
+static esp_err_t sensor_dht_start(sensor_t *sensor) {
+    const sensor_dht_config_t *cfg = sensor->config;
+    sensor_dht_ctx_t *ctx = sensor->ctx;
+
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ctx->pending) {
+        return ESP_OK;
+    }
+    xSemaphoreTake(ctx->done, 0);
+    // with the worker queue full read() simply reads synchronously
+    ctx->pending = dht_read_start(cfg->sensor_type, cfg->pin, sensor_dht_read_done, ctx) == ESP_OK;
+    return ESP_OK;
+}
+
+static esp_err_t sensor_dht_read(sensor_t *sensor, sensor_reading_t *reading) {
+    const sensor_dht_config_t *cfg = sensor->config;
+    sensor_dht_ctx_t *ctx = sensor->ctx;
+
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!ctx->pending) {
+        return sensor_dht_read_cached(cfg, reading);
+    }
+
+    if (xSemaphoreTake(ctx->done, pdMS_TO_TICKS(SENSOR_DHT_READ_TIMEOUT_MS)) != pdTRUE) {
+        // the worker still owns the request; the next start() picks its result up
+        return ESP_ERR_TIMEOUT;
+    }
+    ctx->pending = false;
+    if (ctx->reading.status == ESP_OK) {
+        reading->humidity = ctx->reading.humidity;
+        reading->temperature = ctx->reading.temperature;
+    }
+    return ctx->reading.status;
+}
+
+static void sensor_dht_caps(const sensor_t *sensor, sensor_caps_t *caps) {
+    const sensor_dht_config_t *cfg = sensor->config;
+    const dht_decode_timing_t *timing = dht_decode_get_timing(cfg->sensor_type);
+
+    caps->flags = SENSOR_CAP_TEMPERATURE | SENSOR_CAP_HUMIDITY | SENSOR_CAP_ASYNC;
+    caps->min_interval_ms = timing->min_interval_ms;
+    // start pulse plus a 5 ms frame
+    caps->conversion_ms = timing->start_pulse_us / 1000 + 5;
+}
+
+static esp_err_t sensor_dht_read_batch(sensor_t *const *sensors, size_t count,
+                                       sensor_reading_t *readings, esp_err_t *status) {
+    dht_sensor_t dht_sensors[DHT_MULTI_MAX_SENSORS];
+    dht_reading_t dht_readings[DHT_MULTI_MAX_SENSORS];
+
+    if (count > DHT_MULTI_MAX_SENSORS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // a single sensor gains nothing from the parallel capture, use the store
+    if (count == 1) {
+        status[0] = sensor_dht_read_cached(sensors[0]->config, &readings[0]);
+        return status[0];
+    }
+    for (size_t i = 0; i < count; i++) {
+        const sensor_dht_config_t *cfg = sensors[i]->config;
+        dht_sensors[i].sensor_type = cfg->sensor_type;
+        dht_sensors[i].pin = cfg->pin;
+    }
+
+    esp_err_t ret = dht_read_multi(dht_sensors, count, dht_readings);
+    for (size_t i = 0; i < count; i++) {
+        status[i] = dht_readings[i].status;
+        readings[i].humidity = dht_readings[i].humidity;
+        readings[i].temperature = dht_readings[i].temperature;
+    }
+    return ret;
+}
+
+const sensor_driver_t sensor_dht_driver = {
+    .name = "dht",
+    .init = sensor_dht_init,
+    .start = sensor_dht_start,
+    .read = sensor_dht_read,
+    .caps = sensor_dht_caps,
+    .read_batch = sensor_dht_read_batch,
+};
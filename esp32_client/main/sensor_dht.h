@@ -0,0 +1,24 @@
+#ifndef SENSOR_DHT_H
+#define SENSOR_DHT_H
+
+#include "sensor.h"
+#include "dht.h"
+
+/**
+ * @brief Config of a DHT sensor behind the sensor interface.
+ */
+typedef struct {
+    dht_sensor_type_t sensor_type;
+    gpio_num_t pin;
+    dht_capture_mode_t mode;    // falls back to DHT_CAPTURE_POLLING if the backend can't be set up
+    uint32_t max_age_ms;        // readings up to this old come from the driver's last good value store
+} sensor_dht_config_t;
+
+/**
+ * @brief DHT backend. start() queues the read to the DHT worker task,
+ * read_batch() reads all DHT sensors with dht_read_multi(). Single sensors
+ * are read through dht_read_cached().
+ */
+extern const sensor_driver_t sensor_dht_driver;
+
+#endif // SENSOR_DHT_H
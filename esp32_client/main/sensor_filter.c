@@ -0,0 +1,80 @@
+#include "sensor_filter.h"
+
+#include <string.h>
+
+static int16_t window_median(const sensor_filter_t *f) {
+    int16_t sorted[SENSOR_FILTER_WINDOW];
+    uint8_t n = f->count;
+
+    memcpy(sorted, f->window, n * sizeof(sorted[0]));
+    for (uint8_t i = 1; i < n; i++) {
+        int16_t v = sorted[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    return sorted[n / 2];
+}
+
+static bool rate_plausible(const sensor_filter_t *f, int16_t raw, uint32_t now_ms) {
+    if (!f->primed || f->cfg.max_rate_per_s == 0) {
+        return true;
+    }
+    int32_t delta = (int32_t)raw - f->last_accepted;
+    if (delta < 0) {
+        delta = -delta;
+    }
+    // allow at least one step per sample so coarse sensors are never stuck
+    uint32_t elapsed_ms = now_ms - f->last_ms;
+    int64_t allowed = ((int64_t)f->cfg.max_rate_per_s * elapsed_ms) / 1000;
+    if (allowed < f->cfg.max_rate_per_s / 10 + 1) {
+        allowed = f->cfg.max_rate_per_s / 10 + 1;
+    }
+    return delta <= allowed;
+}
+
+void sensor_filter_init(sensor_filter_t *f, const sensor_filter_config_t *cfg) {
+    memset(f, 0, sizeof(*f));
+    f->cfg = *cfg;
+    if (f->cfg.ema_alpha_q8 == 0 || f->cfg.ema_alpha_q8 > 256) {
+        f->cfg.ema_alpha_q8 = 256;
+    }
+}
+
+bool sensor_filter_update(sensor_filter_t *f, int16_t raw, uint32_t now_ms) {
+    f->raw = raw;
+
+    if (!rate_plausible(f, raw, now_ms)) {
+        f->rejected++;
+        if (++f->rejected_run <= f->cfg.reject_limit) {
+            return false;
+        }
+        // the jump persisted, the signal really moved: restart from here
+        f->count = 0;
+        f->head = 0;
+        f->primed = false;
+    }
+    f->rejected_run = 0;
+    f->last_accepted = raw;
+    f->last_ms = now_ms;
+
+    f->window[f->head] = raw;
+    f->head = (f->head + 1) % SENSOR_FILTER_WINDOW;
+    if (f->count < SENSOR_FILTER_WINDOW) {
+        f->count++;
+    }
+    int32_t median = window_median(f);
+
+    if (!f->primed) {
+        f->ema_q8 = median * 256;
+        f->primed = true;
+    } else {
+        f->ema_q8 += (int32_t)(((int64_t)(median * 256 - f->ema_q8) * f->cfg.ema_alpha_q8) / 256);
+    }
+    // round half away from zero
+    f->filtered = (int16_t)((f->ema_q8 + (f->ema_q8 >= 0 ? 128 : -128)) / 256);
+    return true;
+}
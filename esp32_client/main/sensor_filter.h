@@ -0,0 +1,59 @@
+#ifndef SENSOR_FILTER_H
+#define SENSOR_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sliding median window, odd so the median is a sample
+#ifndef SENSOR_FILTER_WINDOW
+#define SENSOR_FILTER_WINDOW 5
+#endif
+
+/**
+ * @brief Filter parameters. All values are integers in the unit of the samples
+ * (tenths for DHT readings).
+ */
+typedef struct {
+    uint16_t ema_alpha_q8;      // EMA weight of a new sample, 1..256 (256 = no smoothing)
+    uint16_t max_rate_per_s;    // Largest plausible change per second, 0 disables outlier rejection
+    uint8_t reject_limit;       // Consecutive rejections after which a jump is accepted as real
+} sensor_filter_config_t;
+
+/**
+ * @brief Filter state for one metric.
+ * Pipeline: rate-of-change outlier rejection -> sliding median -> EMA.
+ */
+typedef struct {
+    sensor_filter_config_t cfg;
+    int16_t window[SENSOR_FILTER_WINDOW];
+    uint8_t count;              // valid samples in window
+    uint8_t head;               // next slot to overwrite
+    int32_t ema_q8;             // EMA state, value << 8
+    int16_t last_accepted;      // last sample that passed the rate check
+    uint32_t last_ms;           // time of last_accepted
+    uint8_t rejected_run;
+    uint32_t rejected;          // total rejected samples
+    int16_t raw;                // last raw sample
+    int16_t filtered;           // current filter output
+    bool primed;                // at least one sample accepted
+} sensor_filter_t;
+
+/**
+ * @brief Initializes a filter.
+ * @param f Filter state.
+ * @param cfg Parameters, copied.
+ */
+void sensor_filter_init(sensor_filter_t *f, const sensor_filter_config_t *cfg);
+
+/**
+ * @brief Feeds a raw sample through the filter.
+ * f->raw always holds the sample afterwards, f->filtered the filter output.
+ *
+ * @param f Filter state.
+ * @param raw Raw sample.
+ * @param now_ms Monotonic time of the sample in ms.
+ * @return true if the sample was accepted, false if it was rejected as an outlier.
+ */
+bool sensor_filter_update(sensor_filter_t *f, int16_t raw, uint32_t now_ms);
+
+#endif // SENSOR_FILTER_H
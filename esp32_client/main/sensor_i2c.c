@@ -0,0 +1,215 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "sensor_i2c.h"
+
+#define SENSOR_I2C_XFER_TIMEOUT_MS 50
+
+// SHT3x single shot, high repeatability, no clock stretching; max 15.5 ms
+#define SHT3X_CMD_MEASURE_HI    0x2400
+#define SHT3X_CONVERSION_MS     16
+// Si7021 measure RH, no hold master mode; RH plus the implied temperature
+// conversion take at most 12 + 10.8 ms
+#define SI7021_CMD_MEASURE_RH   0xF5
+#define SI7021_CMD_READ_PREV_T  0xE0
+#define SI7021_CONVERSION_MS    23
+
+typedef struct {
+    i2c_master_dev_handle_t dev;
+    int64_t started_us;     // esp_timer time of the pending start(), 0 if none
+} sensor_i2c_ctx_t;
+
+static const char *TAG = "SENSOR_I2C";
+
+static i2c_master_bus_handle_t buses[I2C_NUM_MAX];
+
+// CRC-8, polynomial x^8 + x^5 + x^4 + 1, as used by both chips
+static uint8_t sensor_i2c_crc8(const uint8_t *data, size_t len, uint8_t init) {
+    uint8_t crc = init;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint32_t sensor_i2c_conversion_ms(sensor_i2c_chip_t chip) {
+    return chip == SENSOR_I2C_SI7021 ? SI7021_CONVERSION_MS : SHT3X_CONVERSION_MS;
+}
+
+static esp_err_t sensor_i2c_get_bus(const sensor_i2c_config_t *cfg, i2c_master_bus_handle_t *bus) {
+    if (cfg->port < 0 || cfg->port >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (buses[cfg->port] == NULL) {
+        i2c_master_bus_config_t bus_conf = {
+            .i2c_port = cfg->port,
+            .sda_io_num = cfg->sda,
+            .scl_io_num = cfg->scl,
+            .clk_source = I2C_CLK_SRC_DEFAULT,
+            .glitch_ignore_cnt = 7,
+            .flags.enable_internal_pullup = true,
+        };
+        esp_err_t ret = i2c_new_master_bus(&bus_conf, &buses[cfg->port]);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "i2c_new_master_bus failed on port %d: %s", (int)cfg->port, esp_err_to_name(ret));
+            buses[cfg->port] = NULL;
+            return ret;
+        }
+    }
+    *bus = buses[cfg->port];
+    return ESP_OK;
+}
+
+static esp_err_t sensor_i2c_init(sensor_t *sensor) {
+    const sensor_i2c_config_t *cfg = sensor->config;
+    i2c_master_bus_handle_t bus;
+
+    esp_err_t ret = sensor_i2c_get_bus(cfg, &bus);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    sensor_i2c_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_device_config_t dev_conf = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = cfg->address,
+        .scl_speed_hz = cfg->scl_speed_hz,
+    };
+    ret = i2c_master_bus_add_device(bus, &dev_conf, &ctx->dev);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add I2C device 0x%02x: %s", cfg->address, esp_err_to_name(ret));
+        free(ctx);
+        return ret;
+    }
+    sensor->ctx = ctx;
+    ESP_LOGI(TAG, "%s at 0x%02x on I2C port %d ready.",
+             cfg->chip == SENSOR_I2C_SI7021 ? "Si7021" : "SHT3x", cfg->address, (int)cfg->port);
+    return ESP_OK;
+}
+
+static esp_err_t sensor_i2c_start(sensor_t *sensor) {
+    const sensor_i2c_config_t *cfg = sensor->config;
+    sensor_i2c_ctx_t *ctx = sensor->ctx;
+    uint8_t cmd[2];
+    size_t len;
+
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (cfg->chip == SENSOR_I2C_SI7021) {
+        cmd[0] = SI7021_CMD_MEASURE_RH;
+        len = 1;
+    } else {
+        cmd[0] = SHT3X_CMD_MEASURE_HI >> 8;
+        cmd[1] = SHT3X_CMD_MEASURE_HI & 0xFF;
+        len = 2;
+    }
+
+    esp_err_t ret = i2c_master_transmit(ctx->dev, cmd, len, SENSOR_I2C_XFER_TIMEOUT_MS);
+    ctx->started_us = ret == ESP_OK ? esp_timer_get_time() : 0;
+    return ret;
+}
+
+static esp_err_t sensor_i2c_fetch_sht3x(sensor_i2c_ctx_t *ctx, sensor_reading_t *reading) {
+    uint8_t buf[6];
+    esp_err_t ret = i2c_master_receive(ctx->dev, buf, sizeof(buf), SENSOR_I2C_XFER_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (sensor_i2c_crc8(&buf[0], 2, 0xFF) != buf[2] || sensor_i2c_crc8(&buf[3], 2, 0xFF) != buf[5]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    int32_t raw_t = (buf[0] << 8) | buf[1];
+    int32_t raw_rh = (buf[3] << 8) | buf[4];
+    // T = -45 + 175 * raw / 65535, RH = 100 * raw / 65535, in tenths
+    reading->temperature = (int16_t)(-450 + (1750 * raw_t) / 65535);
+    reading->humidity = (int16_t)((1000 * raw_rh) / 65535);
+    return ESP_OK;
+}
+
+static esp_err_t sensor_i2c_fetch_si7021(sensor_i2c_ctx_t *ctx, sensor_reading_t *reading) {
+    uint8_t buf[3];
+    esp_err_t ret = i2c_master_receive(ctx->dev, buf, sizeof(buf), SENSOR_I2C_XFER_TIMEOUT_MS);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (sensor_i2c_crc8(buf, 2, 0x00) != buf[2]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    int32_t raw_rh = (buf[0] << 8) | buf[1];
+
+    // temperature measured as part of the RH conversion, no checksum for this command
+    const uint8_t cmd = SI7021_CMD_READ_PREV_T;
+    ret = i2c_master_transmit(ctx->dev, &cmd, 1, SENSOR_I2C_XFER_TIMEOUT_MS);
+    if (ret == ESP_OK) {
+        ret = i2c_master_receive(ctx->dev, buf, 2, SENSOR_I2C_XFER_TIMEOUT_MS);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    int32_t raw_t = (buf[0] << 8) | buf[1];
+
+    // RH = 125 * raw / 65536 - 6, T = 175.72 * raw / 65536 - 46.85, in tenths
+    int32_t rh = (1250 * raw_rh) / 65536 - 60;
+    reading->humidity = (int16_t)(rh < 0 ? 0 : rh > 1000 ? 1000 : rh);
+    reading->temperature = (int16_t)(((17572 * raw_t) / 65536 - 4685) / 10);
+    return ESP_OK;
+}
+
+static esp_err_t sensor_i2c_read(sensor_t *sensor, sensor_reading_t *reading) {
+    const sensor_i2c_config_t *cfg = sensor->config;
+    sensor_i2c_ctx_t *ctx = sensor->ctx;
+
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ctx->started_us == 0) {
+        esp_err_t ret = sensor_i2c_start(sensor);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    int64_t ready_us = ctx->started_us + (int64_t)sensor_i2c_conversion_ms(cfg->chip) * 1000;
+    int64_t wait_us = ready_us - esp_timer_get_time();
+    if (wait_us > 0) {
+        // round up, the conversion time is a maximum and the current tick is partial
+        uint32_t wait_ms = (uint32_t)((wait_us + 999) / 1000);
+        vTaskDelay((wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS + 1);
+    }
+    ctx->started_us = 0;
+
+    esp_err_t ret = cfg->chip == SENSOR_I2C_SI7021 ? sensor_i2c_fetch_si7021(ctx, reading)
+                                                    : sensor_i2c_fetch_sht3x(ctx, reading);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Read from 0x%02x failed: %s", cfg->address, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+static void sensor_i2c_caps(const sensor_t *sensor, sensor_caps_t *caps) {
+    const sensor_i2c_config_t *cfg = sensor->config;
+
+    caps->flags = SENSOR_CAP_TEMPERATURE | SENSOR_CAP_HUMIDITY | SENSOR_CAP_ASYNC;
+    caps->min_interval_ms = 0;
+    caps->conversion_ms = sensor_i2c_conversion_ms(cfg->chip);
+}
+
+const sensor_driver_t sensor_i2c_driver = {
+    .name = "i2c",
+    .init = sensor_i2c_init,
+    .start = sensor_i2c_start,
+    .read = sensor_i2c_read,
+    .caps = sensor_i2c_caps,
+};
@@ -0,0 +1,38 @@
+#ifndef SENSOR_I2C_H
+#define SENSOR_I2C_H
+
+#include "driver/i2c_master.h"
+#include "sensor.h"
+
+#define SENSOR_I2C_ADDR_SHT3X   0x44    // 0x45 with ADDR pulled high
+#define SENSOR_I2C_ADDR_SI7021  0x40
+
+/**
+ * @brief Supported I2C humidity sensors.
+ */
+typedef enum {
+    SENSOR_I2C_SHT3X = 0,   // Sensirion SHT30/31/35
+    SENSOR_I2C_SI7021,      // Silicon Labs Si7021, HTU21D
+} sensor_i2c_chip_t;
+
+/**
+ * @brief Config of an I2C sensor. Sensors on the same port share the bus,
+ * which is created with the pins of the first one initialized.
+ */
+typedef struct {
+    sensor_i2c_chip_t chip;
+    i2c_port_num_t port;
+    gpio_num_t sda;
+    gpio_num_t scl;
+    uint16_t address;
+    uint32_t scl_speed_hz;
+} sensor_i2c_config_t;
+
+/**
+ * @brief I2C backend. start() sends the measurement command and returns,
+ * read() waits out the remaining conversion time and fetches the result.
+ * No clock stretching is used, so the bus is free during the conversion.
+ */
+extern const sensor_driver_t sensor_i2c_driver;
+
+#endif // SENSOR_I2C_H
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+
+#include "sensor_sim.h"
+
+// Largest distance the walk drifts from the configured centre
+#define SENSOR_SIM_MAX_DRIFT 50
+#define SENSOR_SIM_SPIKE 100
+
+typedef struct {
+    uint32_t state;
+    int16_t temp_drift;
+    int16_t humidity_drift;
+    uint32_t samples;
+} sensor_sim_ctx_t;
+
+// xorshift32
+static uint32_t sensor_sim_next(sensor_sim_ctx_t *ctx) {
+    uint32_t x = ctx->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ctx->state = x;
+    return x;
+}
+
+// Uniform in [-range, range]
+static int16_t sensor_sim_uniform(sensor_sim_ctx_t *ctx, int16_t range) {
+    if (range <= 0) {
+        return 0;
+    }
+    return (int16_t)((int32_t)(sensor_sim_next(ctx) % (2u * range + 1)) - range);
+}
+
+static int16_t sensor_sim_walk(sensor_sim_ctx_t *ctx, int16_t drift) {
+    drift += sensor_sim_uniform(ctx, 1);
+    if (drift > SENSOR_SIM_MAX_DRIFT) {
+        drift = SENSOR_SIM_MAX_DRIFT;
+    } else if (drift < -SENSOR_SIM_MAX_DRIFT) {
+        drift = -SENSOR_SIM_MAX_DRIFT;
+    }
+    return drift;
+}
+
+static esp_err_t sensor_sim_init(sensor_t *sensor) {
+    const sensor_sim_config_t *cfg = sensor->config;
+
+    sensor_sim_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->state = cfg->seed ? cfg->seed : 1;
+    sensor->ctx = ctx;
+    return ESP_OK;
+}
+
+static esp_err_t sensor_sim_read(sensor_t *sensor, sensor_reading_t *reading) {
+    const sensor_sim_config_t *cfg = sensor->config;
+    sensor_sim_ctx_t *ctx = sensor->ctx;
+
+    if (ctx == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ctx->temp_drift = sensor_sim_walk(ctx, ctx->temp_drift);
+    ctx->humidity_drift = sensor_sim_walk(ctx, ctx->humidity_drift);
+    ctx->samples++;
+
+    int32_t humidity = cfg->humidity + ctx->humidity_drift + sensor_sim_uniform(ctx, cfg->noise);
+    reading->temperature = (int16_t)(cfg->temperature + ctx->temp_drift + sensor_sim_uniform(ctx, cfg->noise));
+    reading->humidity = (int16_t)(humidity < 0 ? 0 : humidity > 1000 ? 1000 : humidity);
+    if (cfg->spike_every && ctx->samples % cfg->spike_every == 0) {
+        reading->temperature += SENSOR_SIM_SPIKE;
+    }
+    return ESP_OK;
+}
+
+static void sensor_sim_caps(const sensor_t *sensor, sensor_caps_t *caps) {
+    caps->flags = SENSOR_CAP_TEMPERATURE | SENSOR_CAP_HUMIDITY;
+    caps->min_interval_ms = 0;
+    caps->conversion_ms = 0;
+}
+
+const sensor_driver_t sensor_sim_driver = {
+    .name = "sim",
+    .init = sensor_sim_init,
+    .read = sensor_sim_read,
+    .caps = sensor_sim_caps,
+};
@@ -0,0 +1,24 @@
+#ifndef SENSOR_SIM_H
+#define SENSOR_SIM_H
+
+#include "sensor.h"
+
+/**
+ * @brief Config of a simulated sensor. Values are in tenths.
+ */
+typedef struct {
+    int16_t temperature;    // centre of the temperature walk
+    int16_t humidity;       // centre of the humidity walk
+    int16_t noise;          // peak sample noise, 0 for none
+    uint16_t spike_every;   // every n-th sample is a +10.0 spike, 0 for none
+    uint32_t seed;          // nonzero, makes runs reproducible
+} sensor_sim_config_t;
+
+/**
+ * @brief Simulated backend: a bounded random walk plus noise and optional
+ * spikes. Depends on nothing but esp_err.h, so the publisher and the
+ * control logic can run against it without hardware or on a host build.
+ */
+extern const sensor_driver_t sensor_sim_driver;
+
+#endif // SENSOR_SIM_H
@@ -0,0 +1,191 @@
+#include <string.h>
+
+#include "telemetry.h"
+
+int telemetry_format_tenths(char *buf, size_t size, int32_t tenths) {
+    char tmp[12]; // "-214748364.8"
+    uint32_t mag = tenths < 0 ? (uint32_t)0 - (uint32_t)tenths : (uint32_t)tenths;
+    size_t n = 0;
+
+    // digits are produced least significant first
+    tmp[n++] = '0' + mag % 10;
+    tmp[n++] = '.';
+    mag /= 10;
+    do {
+        tmp[n++] = '0' + mag % 10;
+        mag /= 10;
+    } while (mag);
+    if (tenths < 0) {
+        tmp[n++] = '-';
+    }
+
+    if (buf == NULL || n + 1 > size) {
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    buf[n] = '\0';
+    return (int)n;
+}
+
+// Appends a string; *len becomes size once something didn't fit
+static void telemetry_append(char *buf, size_t size, size_t *len, const char *s) {
+    size_t n = strlen(s);
+    if (*len + n >= size) {
+        *len = size;
+        return;
+    }
+    memcpy(buf + *len, s, n + 1);
+    *len += n;
+}
+
+static void telemetry_append_uint(char *buf, size_t size, size_t *len, uint32_t v) {
+    char tmp[11];
+    size_t n = sizeof(tmp) - 1;
+
+    tmp[n] = '\0';
+    do {
+        tmp[--n] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    telemetry_append(buf, size, len, tmp + n);
+}
+
+static void telemetry_append_tenths(char *buf, size_t size, size_t *len, const char *key, int16_t tenths) {
+    char tmp[16];
+
+    telemetry_append(buf, size, len, key);
+    if (telemetry_format_tenths(tmp, sizeof(tmp), tenths) > 0) {
+        telemetry_append(buf, size, len, tmp);
+    }
+}
+
+int telemetry_format_record(char *buf, size_t size, const telemetry_record_t *rec) {
+    size_t len = 0;
+
+    if (buf == NULL || size == 0 || rec == NULL) {
+        return -1;
+    }
+    buf[0] = '\0';
+    telemetry_append(buf, size, &len, "{\"v\":");
+    telemetry_append_uint(buf, size, &len, TELEMETRY_SCHEMA_VERSION);
+    telemetry_append(buf, size, &len, ",\"seq\":");
+    telemetry_append_uint(buf, size, &len, rec->seq);
+    telemetry_append(buf, size, &len, ",\"ts_ms\":");
+    telemetry_append_uint(buf, size, &len, rec->timestamp_ms);
+    telemetry_append(buf, size, &len, rec->fan_on ? ",\"fan\":{\"on\":1,\"duty\":" : ",\"fan\":{\"on\":0,\"duty\":");
+    telemetry_append_uint(buf, size, &len, rec->fan_duty);
+    telemetry_append(buf, size, &len, "},\"sensors\":[");
+    for (uint8_t i = 0; i < rec->sensor_count && i < TELEMETRY_MAX_SENSORS; i++) {
+        const telemetry_sensor_t *s = &rec->sensors[i];
+        if (i > 0) {
+            telemetry_append(buf, size, &len, ",");
+        }
+        if (!s->valid) {
+            telemetry_append(buf, size, &len, "null");
+            continue;
+        }
+        telemetry_append_tenths(buf, size, &len, "{\"temp\":", s->temperature);
+        telemetry_append_tenths(buf, size, &len, ",\"humidity\":", s->humidity);
+        telemetry_append_tenths(buf, size, &len, ",\"temp_raw\":", s->temperature_raw);
+        telemetry_append_tenths(buf, size, &len, ",\"humidity_raw\":", s->humidity_raw);
+        telemetry_append(buf, size, &len, "}");
+    }
+    telemetry_append(buf, size, &len, "]}");
+    return len < size ? (int)len : -1;
+}
+
+_Static_assert(TELEMETRY_MAX_SENSORS <= 8, "valid bitmap is one byte");
+
+static uint8_t *telemetry_put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+static uint8_t *telemetry_put_i16(uint8_t *p, int16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)((uint16_t)v >> 8);
+    return p + 2;
+}
+
+static uint32_t telemetry_get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int16_t telemetry_get_i16(const uint8_t *p) {
+    return (int16_t)(uint16_t)(p[0] | p[1] << 8);
+}
+
+int telemetry_encode_record(uint8_t *buf, size_t size, const telemetry_record_t *rec) {
+    uint8_t count = rec->sensor_count < TELEMETRY_MAX_SENSORS ? rec->sensor_count : TELEMETRY_MAX_SENSORS;
+    uint8_t valid = 0;
+    size_t len = TELEMETRY_BIN_HEADER_LEN;
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (rec->sensors[i].valid) {
+            valid |= 1u << i;
+            len += TELEMETRY_BIN_SENSOR_LEN;
+        }
+    }
+    if (buf == NULL || len > size) {
+        return -1;
+    }
+
+    uint8_t *p = buf;
+    *p++ = TELEMETRY_BIN_VERSION;
+    p = telemetry_put_u32(p, rec->seq);
+    p = telemetry_put_u32(p, rec->timestamp_ms);
+    *p++ = rec->fan_on ? 1 : 0;
+    *p++ = rec->fan_duty;
+    *p++ = count;
+    *p++ = valid;
+    for (uint8_t i = 0; i < count; i++) {
+        const telemetry_sensor_t *s = &rec->sensors[i];
+        if (s->valid) {
+            p = telemetry_put_i16(p, s->temperature);
+            p = telemetry_put_i16(p, s->humidity);
+            p = telemetry_put_i16(p, s->temperature_raw);
+            p = telemetry_put_i16(p, s->humidity_raw);
+        }
+    }
+    return (int)len;
+}
+
+int telemetry_decode_record(const uint8_t *buf, size_t len, telemetry_record_t *rec) {
+    if (buf == NULL || len < TELEMETRY_BIN_HEADER_LEN || buf[0] != TELEMETRY_BIN_VERSION) {
+        return -1;
+    }
+
+    memset(rec, 0, sizeof(*rec));
+    rec->seq = telemetry_get_u32(buf + 1);
+    rec->timestamp_ms = telemetry_get_u32(buf + 5);
+    rec->fan_on = buf[9] & 1;
+    rec->fan_duty = buf[10];
+    rec->sensor_count = buf[11];
+    if (rec->sensor_count > TELEMETRY_MAX_SENSORS) {
+        return -1;
+    }
+
+    const uint8_t *p = buf + TELEMETRY_BIN_HEADER_LEN;
+    const uint8_t *end = buf + len;
+    for (uint8_t i = 0; i < rec->sensor_count; i++) {
+        telemetry_sensor_t *s = &rec->sensors[i];
+        if (!(buf[12] & (1u << i))) {
+            continue;
+        }
+        if (end - p < TELEMETRY_BIN_SENSOR_LEN) {
+            return -1;
+        }
+        s->valid = true;
+        s->temperature = telemetry_get_i16(p);
+        s->humidity = telemetry_get_i16(p + 2);
+        s->temperature_raw = telemetry_get_i16(p + 4);
+        s->humidity_raw = telemetry_get_i16(p + 6);
+        p += TELEMETRY_BIN_SENSOR_LEN;
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped whenever a field of the record changes meaning or is removed
+#define TELEMETRY_SCHEMA_VERSION 1
+#ifndef TELEMETRY_MAX_SENSORS
+#define TELEMETRY_MAX_SENSORS 4
+#endif
+
+// Binary record, see telemetry_encode_record()
+#define TELEMETRY_BIN_VERSION       1
+#define TELEMETRY_BIN_HEADER_LEN    13
+#define TELEMETRY_BIN_SENSOR_LEN    8
+#define TELEMETRY_BIN_MAX_LEN       (TELEMETRY_BIN_HEADER_LEN + TELEMETRY_MAX_SENSORS * TELEMETRY_BIN_SENSOR_LEN)
+
+/**
+ * @brief Wire encoding of the telemetry record, chosen per device.
+ */
+typedef enum {
+    TELEMETRY_ENCODING_TEXT = 0,    // JSON, telemetry_format_record()
+    TELEMETRY_ENCODING_BINARY,      // packed, telemetry_encode_record()
+} telemetry_encoding_t;
+
+/**
+ * @brief One sensor's values in a telemetry record, tenths.
+ */
+typedef struct {
+    bool valid;             // false if the sensor failed this sample
+    int16_t temperature;    // filtered
+    int16_t humidity;
+    int16_t temperature_raw;
+    int16_t humidity_raw;
+} telemetry_sensor_t;
+
+/**
+ * @brief Everything sampled in one cycle, published as a single message.
+ */
+typedef struct {
+    uint32_t seq;           // incremented per record, restarts at 0 on boot
+    uint32_t timestamp_ms;  // monotonic time since boot, wraps after ~49 days
+    bool fan_on;
+    uint8_t fan_duty;       // achieved duty, percent
+    uint8_t sensor_count;
+    telemetry_sensor_t sensors[TELEMETRY_MAX_SENSORS];
+} telemetry_record_t;
+
+/**
+ * @brief Formats a fixed-point value in tenths as a decimal string.
+ * For example 244 becomes "24.4" and -5 becomes "-0.5". Uses integer
+ * arithmetic only, so no float printf support is pulled in.
+ *
+ * @param buf Output buffer, NUL-terminated on success.
+ * @param size Size of buf in bytes.
+ * @param tenths Value * 10.
+ * @return Number of characters written (without the NUL), or -1 if buf is too small.
+ */
+int telemetry_format_tenths(char *buf, size_t size, int32_t tenths);
+
+/**
+ * @brief Formats a record as JSON, schema TELEMETRY_SCHEMA_VERSION:
+ * {"v":1,"seq":7,"ts_ms":35012,"fan":{"on":1,"duty":80},
+ *  "sensors":[{"temp":24.4,"humidity":45.0,"temp_raw":24.5,"humidity_raw":44.0}]}
+ * A failed sensor is null, so array positions stay the sensor index.
+ *
+ * @param buf Output buffer, NUL-terminated on success.
+ * @param size Size of buf in bytes.
+ * @param rec Record.
+ * @return Number of characters written (without the NUL), or -1 if buf is too small.
+ */
+int telemetry_format_record(char *buf, size_t size, const telemetry_record_t *rec);
+
+/**
+ * @brief Encodes a record in the packed binary format, little-endian:
+ *
+ *   0  u8   TELEMETRY_BIN_VERSION
+ *   1  u32  seq
+ *   5  u32  timestamp_ms
+ *   9  u8   flags, bit 0 fan on
+ *   10 u8   fan duty
+ *   11 u8   sensor count
+ *   12 u8   valid bitmap, bit n set if sensor n is present
+ *   13      per present sensor: i16 temperature, humidity, temperature_raw,
+ *           humidity_raw (tenths)
+ *
+ * 21 bytes for one sensor. source/app.py has the matching decoder.
+ *
+ * @return Number of bytes written, or -1 if buf is too small.
+ */
+int telemetry_encode_record(uint8_t *buf, size_t size, const telemetry_record_t *rec);
+
+/**
+ * @brief Decodes a record written by telemetry_encode_record().
+ * @return 0 on success, -1 on an unknown version or a truncated buffer.
+ */
+int telemetry_decode_record(const uint8_t *buf, size_t len, telemetry_record_t *rec);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,257 @@
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include "telemetry_store.h"
+
+// Flash slot layout
+#define SLOT_MAGIC          0xA5
+#define SLOT_UNSENT         0xFF    // erased state
+#define SLOT_SENT           0x00
+#define SLOT_OFF_MAGIC      0
+#define SLOT_OFF_SENT       1
+#define SLOT_OFF_LEN        2
+#define SLOT_OFF_CRC        3       // CRC-8 over lsn and record
+#define SLOT_OFF_LSN        4       // log sequence number, orders the slots
+#define SLOT_OFF_DATA       8
+#define FLASH_SECTOR_SIZE   4096
+#define SLOTS_PER_SECTOR    (FLASH_SECTOR_SIZE / TELEMETRY_STORE_SLOT_SIZE)
+
+_Static_assert(SLOT_OFF_DATA + TELEMETRY_BIN_MAX_LEN <= TELEMETRY_STORE_SLOT_SIZE, "record doesn't fit a slot");
+
+static const char *TAG = "TELEMETRY_STORE";
+
+// Only used by the publish task, nothing is locked
+static telemetry_store_stats_t stats;
+
+// RAM backend
+static telemetry_record_t ram[TELEMETRY_STORE_RECORDS];
+
+// Flash backend
+static const esp_partition_t *partition = NULL;
+static uint32_t slot_count = 0;
+static uint32_t next_lsn = 0;
+
+// Both backends: ring of slots, stats.pending slots from tail are pending.
+// head == tail is ambiguous (empty or full), so the count is kept.
+static uint32_t head = 0;
+static uint32_t tail = 0;
+static uint32_t peek_slots = 0;     // slots telemetry_store_pop() removes
+static uint32_t peek_count = 0;
+static bool peek_valid = false;     // nothing pushed or popped since the last peek
+
+static uint8_t crc8(const uint8_t *data, size_t len) {
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint32_t ring_size(void) {
+    return partition ? slot_count : TELEMETRY_STORE_RECORDS;
+}
+
+static uint32_t ring_next(uint32_t i) {
+    return i + 1 == ring_size() ? 0 : i + 1;
+}
+
+static uint32_t ring_advance(uint32_t i, uint32_t n) {
+    return (i + n) % ring_size();
+}
+
+/**
+ * Reads a slot; true if it holds a valid record, replayed or not.
+ */
+static bool flash_read_slot(uint32_t slot, uint8_t buf[TELEMETRY_STORE_SLOT_SIZE], uint32_t *lsn) {
+    if (esp_partition_read(partition, slot * TELEMETRY_STORE_SLOT_SIZE, buf, TELEMETRY_STORE_SLOT_SIZE) != ESP_OK) {
+        stats.flash_errors++;
+        return false;
+    }
+    if (buf[SLOT_OFF_MAGIC] != SLOT_MAGIC || buf[SLOT_OFF_LEN] > TELEMETRY_BIN_MAX_LEN
+            || crc8(buf + SLOT_OFF_LSN, 4 + buf[SLOT_OFF_LEN]) != buf[SLOT_OFF_CRC]) {
+        return false;
+    }
+    *lsn = (uint32_t)buf[4] | (uint32_t)buf[5] << 8 | (uint32_t)buf[6] << 16 | (uint32_t)buf[7] << 24;
+    return true;
+}
+
+/**
+ * Finds the write position and the oldest unsent record after a reboot.
+ */
+static void flash_scan(void) {
+    uint8_t buf[TELEMETRY_STORE_SLOT_SIZE];
+    bool any = false;
+    bool any_unsent = false;
+    uint32_t max_lsn = 0, min_unsent_lsn = 0;
+
+    for (uint32_t slot = 0; slot < slot_count; slot++) {
+        uint32_t lsn;
+        if (!flash_read_slot(slot, buf, &lsn)) {
+            continue;
+        }
+        if (!any || lsn > max_lsn) {
+            max_lsn = lsn;
+            head = ring_next(slot);
+        }
+        any = true;
+        if (buf[SLOT_OFF_SENT] == SLOT_UNSENT && (!any_unsent || lsn < min_unsent_lsn)) {
+            min_unsent_lsn = lsn;
+            tail = slot;
+            any_unsent = true;
+        }
+    }
+    next_lsn = any ? max_lsn + 1 : 0;
+    if (!any_unsent) {
+        tail = head;
+    }
+    // slots after the newest one may hold anything, they're erased before use
+    if (head % SLOTS_PER_SECTOR != 0 && any) {
+        uint32_t lsn;
+        if (flash_read_slot(head, buf, &lsn) || buf[SLOT_OFF_MAGIC] != 0xFF) {
+            head = ring_next(head + SLOTS_PER_SECTOR - 1 - head % SLOTS_PER_SECTOR);
+        }
+    }
+    stats.pending = head >= tail ? head - tail : slot_count - tail + head;
+    if (any_unsent && stats.pending == 0) {
+        stats.pending = slot_count;
+    }
+}
+
+esp_err_t telemetry_store_init(const char *partition_label) {
+    // starts over like after a reboot, the host test calls it again to simulate one
+    memset(&stats, 0, sizeof(stats));
+    partition = NULL;
+    head = tail = 0;
+    peek_valid = false;
+
+    if (partition_label != NULL) {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+        if (partition == NULL || partition->size < 2 * FLASH_SECTOR_SIZE) {
+            ESP_LOGW(TAG, "No usable partition \"%s\", keeping telemetry in RAM", partition_label);
+            partition = NULL;
+        }
+    }
+    if (partition == NULL) {
+        ESP_LOGI(TAG, "RAM store, %d records", TELEMETRY_STORE_RECORDS);
+        return ESP_OK;
+    }
+
+    slot_count = partition->size / FLASH_SECTOR_SIZE * SLOTS_PER_SECTOR;
+    flash_scan();
+    ESP_LOGI(TAG, "Flash store on \"%s\", %" PRIu32 " slots, %" PRIu32 " records pending",
+             partition_label, slot_count, stats.pending);
+    return ESP_OK;
+}
+
+static void flash_push(const telemetry_record_t *rec) {
+    uint8_t buf[TELEMETRY_STORE_SLOT_SIZE];
+
+    // entering a sector: erase it, dropping what wasn't replayed from it
+    if (head % SLOTS_PER_SECTOR == 0) {
+        uint32_t sector_end = head + SLOTS_PER_SECTOR;
+        if (stats.pending > 0 && tail >= head && tail < sector_end) {
+            uint32_t lost = sector_end - tail;
+            stats.dropped += lost;
+            stats.pending -= lost;
+            tail = ring_advance(tail, lost);
+        }
+        if (esp_partition_erase_range(partition, head * TELEMETRY_STORE_SLOT_SIZE, FLASH_SECTOR_SIZE) != ESP_OK) {
+            stats.flash_errors++;
+            return;
+        }
+    }
+
+    memset(buf, 0xFF, sizeof(buf));
+    int len = telemetry_encode_record(buf + SLOT_OFF_DATA, TELEMETRY_BIN_MAX_LEN, rec);
+    if (len < 0) {
+        return;
+    }
+    stats.pending++;
+    buf[SLOT_OFF_MAGIC] = SLOT_MAGIC;
+    buf[SLOT_OFF_SENT] = SLOT_UNSENT;
+    buf[SLOT_OFF_LEN] = (uint8_t)len;
+    buf[SLOT_OFF_LSN] = (uint8_t)next_lsn;
+    buf[SLOT_OFF_LSN + 1] = (uint8_t)(next_lsn >> 8);
+    buf[SLOT_OFF_LSN + 2] = (uint8_t)(next_lsn >> 16);
+    buf[SLOT_OFF_LSN + 3] = (uint8_t)(next_lsn >> 24);
+    buf[SLOT_OFF_CRC] = crc8(buf + SLOT_OFF_LSN, 4 + len);
+    if (esp_partition_write(partition, head * TELEMETRY_STORE_SLOT_SIZE, buf, SLOT_OFF_DATA + len) != ESP_OK) {
+        stats.flash_errors++;
+    }
+    next_lsn++;
+    head = ring_next(head);
+}
+
+void telemetry_store_push(const telemetry_record_t *rec) {
+    if (partition) {
+        flash_push(rec);
+    } else {
+        if (stats.pending == TELEMETRY_STORE_RECORDS) {
+            tail = ring_next(tail);     // full, the oldest record goes
+            stats.dropped++;
+        } else {
+            stats.pending++;
+        }
+        ram[head] = *rec;
+        head = ring_next(head);
+    }
+    stats.stored++;
+    peek_valid = false;
+}
+
+size_t telemetry_store_peek(telemetry_record_t *recs, size_t max) {
+    uint8_t buf[TELEMETRY_STORE_SLOT_SIZE];
+    uint32_t slot = tail;
+    uint32_t slots = 0;
+    size_t n = 0;
+
+    for (; slots < stats.pending && n < max; slots++) {
+        if (!partition) {
+            recs[n++] = ram[slot];
+        } else {
+            uint32_t lsn;
+            // unreadable or already replayed slots are skipped, and popped with the rest
+            if (flash_read_slot(slot, buf, &lsn) && buf[SLOT_OFF_SENT] == SLOT_UNSENT
+                    && telemetry_decode_record(buf + SLOT_OFF_DATA, buf[SLOT_OFF_LEN], &recs[n]) == 0) {
+                n++;
+            }
+        }
+        slot = ring_next(slot);
+    }
+    peek_slots = slots;
+    peek_count = n;
+    peek_valid = true;
+    return n;
+}
+
+void telemetry_store_pop(void) {
+    static const uint8_t sent = SLOT_SENT;
+
+    if (!peek_valid) {
+        return;
+    }
+    for (uint32_t i = 0, slot = tail; partition && i < peek_slots; i++, slot = ring_next(slot)) {
+        // clearing bits needs no erase
+        if (esp_partition_write(partition, slot * TELEMETRY_STORE_SLOT_SIZE + SLOT_OFF_SENT, &sent, 1) != ESP_OK) {
+            stats.flash_errors++;
+        }
+    }
+    stats.replayed += peek_count;
+    tail = ring_advance(tail, peek_slots);
+    stats.pending -= peek_slots;
+    peek_valid = false;
+}
+
+size_t telemetry_store_pending(void) {
+    return stats.pending;
+}
+
+void telemetry_store_get_stats(telemetry_store_stats_t *out) {
+    *out = stats;
+}
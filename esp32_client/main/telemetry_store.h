@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "telemetry.h"
+
+// Records kept in RAM while the broker is unreachable
+#ifndef TELEMETRY_STORE_RECORDS
+#define TELEMETRY_STORE_RECORDS 128
+#endif
+// One record per flash slot, binary encoded (telemetry_encode_record())
+#define TELEMETRY_STORE_SLOT_SIZE 64
+
+/**
+ * @brief Store counters.
+ */
+typedef struct {
+    uint32_t pending;       // records waiting for replay
+    uint32_t stored;        // records pushed
+    uint32_t replayed;      // records popped after a successful publish
+    uint32_t dropped;       // oldest records overwritten while full
+    uint32_t flash_errors;  // failed flash reads/writes/erases, flash backend only
+} telemetry_store_stats_t;
+
+/**
+ * @brief Sets up the store. With a partition label, records go to that data
+ * partition instead of RAM and survive a reboot; the partition is written as
+ * a log, one sector erase per pass over the whole partition, and replayed
+ * slots are marked by clearing a byte, so no erase per record. Falls back to
+ * RAM if the partition doesn't exist. Calling it again starts over as after
+ * a reboot: RAM records and counters are lost. The store is not locked, all
+ * calls come from the publish task.
+ *
+ * @param partition_label Data partition label, NULL for RAM only.
+ * @return ESP_OK (also when falling back to RAM).
+ */
+esp_err_t telemetry_store_init(const char *partition_label);
+
+/**
+ * @brief Appends a record, dropping the oldest one when full.
+ */
+void telemetry_store_push(const telemetry_record_t *rec);
+
+/**
+ * @brief Copies the oldest records without removing them.
+ * @param[out] recs Records, oldest first.
+ * @param max Size of recs.
+ * @return Number of records copied.
+ */
+size_t telemetry_store_peek(telemetry_record_t *recs, size_t max);
+
+/**
+ * @brief Removes the records returned by the last telemetry_store_peek().
+ * Call once they have been published.
+ */
+void telemetry_store_pop(void);
+
+/**
+ * @brief Number of records waiting for replay.
+ */
+size_t telemetry_store_pending(void);
+
+/**
+ * @brief Gets the store counters.
+ */
+void telemetry_store_get_stats(telemetry_store_stats_t *stats);
+
+#endif // TELEMETRY_STORE_H
@@ -9,6 +9,7 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -18,10 +19,17 @@ static const char *TAG = "WIFI_MANAGER";
 
 static EventGroupHandle_t s_wifi_event_group;
 static int s_retry_num = 0;
+static esp_timer_handle_t s_reconnect_timer;
 
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT      BIT1
 
+static void reconnect_timer_cb(void* arg)
+{
+    ESP_LOGI(TAG, "retry to connect to the AP");
+    esp_wifi_connect();
+}
+
 static void event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
 {
@@ -34,6 +42,8 @@ static void event_handler(void* arg, esp_event_base_t event_base,
             ESP_LOGI(TAG, "retry to connect to the AP");
         } else {
             xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+            // the application runs on without the network, keep trying in the background
+            esp_timer_start_once(s_reconnect_timer, (uint64_t)WIFI_RECONNECT_INTERVAL_MS * 1000);
         }
         ESP_LOGI(TAG,"connect to the AP failed");
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
@@ -47,6 +57,11 @@ static void event_handler(void* arg, esp_event_base_t event_base,
 esp_err_t wifi_manager_init_sta(void)
 {
     s_wifi_event_group = xEventGroupCreate();
+    const esp_timer_create_args_t reconnect_args = {
+        .callback = reconnect_timer_cb,
+        .name = "wifi_reconnect",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&reconnect_args, &s_reconnect_timer));
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
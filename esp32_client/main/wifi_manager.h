@@ -5,7 +5,9 @@
 
 /**
  * @brief Initializes Wi-Fi and connects to the configured AP.
- * @return ESP_OK on successful connection, ESP_FAIL otherwise.
+ * On failure it keeps reconnecting in the background, every
+ * WIFI_RECONNECT_INTERVAL_MS after the first WIFI_MAX_RETRY attempts.
+ * @return ESP_OK on successful connection, ESP_FAIL if not connected yet.
  */
 esp_err_t wifi_manager_init_sta(void);
 
@@ -1,53 +1,375 @@
 from flask import Flask, jsonify, request, render_template, url_for
 import paho.mqtt.client as paho
 from paho import mqtt
+from paho.mqtt.packettypes import PacketTypes
+from paho.mqtt.properties import Properties
+import json
+import os
 import random
+import struct
+import threading
+import time
+import uuid
+from collections import deque
 
 #MQTT broker
-broker = "localhost"
-port = 1883
+broker = os.environ.get("MQTT_BROKER", "localhost")
+port = int(os.environ.get("MQTT_PORT", "1883"))
 client_id = f'Raspi 4 MQTT Broker - {random.randint(0,1000)}'
 
-# Topics
-status_t = "fan/status"
-output_t = "fan/output"
+# Topics, see esp32_client/main/app_config.h. Each ESP32 publishes under
+# devices/<id>/ and takes commands on devices/<id>/cmd/, groups/<group>/cmd/
+# and broadcast/cmd/.
+device_root_t = "devices"
+group_root_t = "groups"
+broadcast_root_t = "broadcast"
+telemetry_t = "telemetry"
+telemetry_bin_t = "telemetry/bin"
+# Records replayed from the device's store after an outage
+telemetry_batch_t = "telemetry/batch"
+telemetry_bin_batch_t = "telemetry/bin/batch"
+encoding_t = "cmd/telemetry/encoding"
+policy_t = "cmd/telemetry/policy"
+status_t = "cmd/fan/status"
+output_t = "cmd/fan/output"
 read_t = "fan/read"
-temp_t = "sensors/dht11/temp"
-humidity_t = "sensors/dht11/humidity"
+# Command traces, see fan_actuator.h
+fan_ack_t = "fan/ack"
+# Retained "ON,<duty>"/"OFF,<duty>" per device, applied by the device on every connect
+desired_t = "cmd/fan/desired"
+# Retained "online"/"offline": birth message and Last Will of each device
+presence_t = "presence"
+# Retained group name of each device, sent with its birth message
+group_t = "group"
+# Per-metric topics, only sent by devices built with TELEMETRY_LEGACY_TOPICS
+temp_t = "sensors/temp"
+humidity_t = "sensors/humidity"
+
+# Telemetry record schema versions this bridge understands
+TELEMETRY_SCHEMA_VERSIONS = (1,)
+# Encoding asked of every device that sends text telemetry: "binary" or "text".
+# Use /set_encoding to switch a single device back to text for debugging.
+PREFERRED_TELEMETRY_ENCODING = "binary"
+
+# Binary record, see telemetry_encode_record() in esp32_client/main/telemetry.h
+TELEMETRY_BIN_VERSION = 1
+TELEMETRY_BIN_HEADER = struct.Struct("<BIIBBBB")
+TELEMETRY_BIN_SENSOR = struct.Struct("<hhhh")
+
+# Records remembered per device to drop duplicates. A record may arrive twice
+# when a replay is retried; (seq, ts_ms) also tells records of different
+# boots apart, since seq restarts at 0.
+SEEN_RECORDS = 4096
+
+# Fan commands carry a correlation id ("<value>;cid=<id>"), the device
+# echoes it on fan_ack_t once the fade is done. A command to one device is
+# done with its first ack; group and broadcast commands are acked by every
+# device and stay until COMMAND_TRACE_TIMEOUT_S. Commands without an ack by
+# then are counted as expired and forgotten. The latest LATENCY_SAMPLES
+# samples of each leg are kept for the percentiles.
+COMMAND_TRACE_TIMEOUT_S = 30
+LATENCY_SAMPLES = 1000
+# total: publish -> ack received, device: receipt -> fade end,
+# queue: receipt -> fade start, fade: fade start -> end,
+# network: total - device (broker both ways and client queues)
+LATENCY_LEGS = ("total", "network", "device", "queue", "fade")
+
+# Commands a device doesn't get within this many seconds are dropped by the
+# broker instead of being delivered late, e.g. after a device built with
+# MQTT_PROTOCOL_V5 reconnects to its session. Only MQTT 5 sessions queue.
+COMMAND_EXPIRY_S = 30
 
 # Web UI
 app = Flask(__name__, static_folder="static", template_folder="templates")
 
-# Sensor data
-fan_status = "OFF"
-current_fan_output = 50
-current_temp = 35.5
-current_humidity = 45.0
+# Sensor data per device id
+devices = {}
+
+# Command traces, written by the MQTT thread and the web handlers
+latency_lock = threading.Lock()
+pending_commands = {}   # cid -> {"sent": time.monotonic() of the publish, "fanout": bool, "acked": bool}
+latency = {leg: deque(maxlen=LATENCY_SAMPLES) for leg in LATENCY_LEGS}
+latency_counts = {"sent": 0, "acked": 0, "superseded": 0, "expired": 0, "unmatched": 0}
+
+def get_device(device_id):
+    if device_id not in devices:
+        print(f"New device: {device_id}")
+        devices[device_id] = {
+            "fan_status": "OFF",
+            "desired_on": False,
+            "desired_duty": 80,     # the device's default ON duty
+            "online": None,         # unknown until the retained presence arrives
+            "group": None,          # unknown until the retained group arrives
+            "presence_changed": 0.0,
+            "current_fan_output": 0,
+            "current_temp": 0.0,
+            "current_humidity": 0.0,
+            "last_seen": 0.0,
+            "seq": None,
+            "timestamp_ms": None,
+            "encoding": None,
+            "encoding_requested": None,
+            "records": 0,
+            "replayed": 0,
+            "duplicates": 0,
+            "seen": set(),
+            "seen_order": deque(),
+        }
+    return devices[device_id]
+
+def decode_telemetry_bin(payload, offset=0):
+    """Turns a binary record into the same dict as the JSON one.
+    Returns the record and the offset after it."""
+    version, seq, ts_ms, flags, duty, count, valid = TELEMETRY_BIN_HEADER.unpack_from(payload, offset)
+    if version != TELEMETRY_BIN_VERSION:
+        raise ValueError(f"unknown binary telemetry version {version}")
+    sensors = []
+    offset += TELEMETRY_BIN_HEADER.size
+    for i in range(count):
+        if not valid & (1 << i):
+            sensors.append(None)
+            continue
+        temp, humidity, temp_raw, humidity_raw = TELEMETRY_BIN_SENSOR.unpack_from(payload, offset)
+        offset += TELEMETRY_BIN_SENSOR.size
+        sensors.append({
+            "temp": temp / 10,
+            "humidity": humidity / 10,
+            "temp_raw": temp_raw / 10,
+            "humidity_raw": humidity_raw / 10,
+        })
+    return {"v": 1, "seq": seq, "ts_ms": ts_ms, "fan": {"on": flags & 1, "duty": duty}, "sensors": sensors}, offset
+
+def decode_telemetry_bin_batch(payload):
+    """Binary records packed back to back."""
+    records = []
+    offset = 0
+    while offset < len(payload):
+        record, offset = decode_telemetry_bin(payload, offset)
+        records.append(record)
+    return records
+
+def seen_before(device, record):
+    key = (record["seq"], record["ts_ms"])
+    if key in device["seen"]:
+        return True
+    device["seen"].add(key)
+    device["seen_order"].append(key)
+    if len(device["seen_order"]) > SEEN_RECORDS:
+        device["seen"].discard(device["seen_order"].popleft())
+    return False
+
+def request_encoding(device_id, device, encoding):
+    topic = f"{device_root_t}/{device_id}/{encoding_t}"
+    result = publish_command(topic, encoding)
+    if result[0] == paho.MQTT_ERR_SUCCESS:
+        device["encoding_requested"] = encoding
+        print(f"Asked {device_id} for {encoding} telemetry")
+    else:
+        print(f"Failed to send encoding request to topic {topic}")
+
+def handle_telemetry(device_id, device, record, encoding, replayed=False):
+    device["encoding"] = encoding
+    # negotiate once per device, a later /set_encoding wins
+    if device["encoding_requested"] is None and encoding != PREFERRED_TELEMETRY_ENCODING:
+        request_encoding(device_id, device, PREFERRED_TELEMETRY_ENCODING)
+    if record.get("v") not in TELEMETRY_SCHEMA_VERSIONS:
+        print(f"[{device_id}] Unsupported telemetry schema {record.get('v')}")
+        return
+    if seen_before(device, record):
+        device["duplicates"] += 1
+        print(f"[{device_id}] Duplicate telemetry seq {record['seq']}")
+        return
+    device["records"] += 1
+    if replayed:
+        # backlog is recorded but never shown as the current state: ts_ms is
+        # time since boot, so it can't be compared with records of another boot,
+        # and live records go out ahead of the backlog anyway
+        device["replayed"] += 1
+        print(f"[{device_id}] Replayed telemetry seq {record['seq']}: {record}")
+        return
+    device["seq"] = record["seq"]
+    device["timestamp_ms"] = record["ts_ms"]
+    fan = record.get("fan", {})
+    device["fan_status"] = "ON" if fan.get("on") else "OFF"
+    device["current_fan_output"] = int(fan.get("duty", 0))
+    sensors = record.get("sensors") or []
+    # the first working sensor stands for the device on the dashboard
+    sensor = next((s for s in sensors if s), None)
+    if sensor is not None:
+        device["current_temp"] = float(sensor["temp"])
+        device["current_humidity"] = float(sensor["humidity"])
+    print(f"[{device_id}] Telemetry seq {record['seq']}: {record}")
+
+def publish_command(topic, payload):
+    """Publishes a command with a message expiry of COMMAND_EXPIRY_S."""
+    properties = Properties(PacketTypes.PUBLISH)
+    properties.MessageExpiryInterval = COMMAND_EXPIRY_S
+    return client.publish(topic, payload, qos=1, properties=properties)
+
+def traced_command(payload, target):
+    """Appends a new correlation id to a command payload sent to `target`."""
+    cid = uuid.uuid4().hex[:12]
+    now = time.monotonic()
+    with latency_lock:
+        for old, command in list(pending_commands.items()):
+            if now - command["sent"] > COMMAND_TRACE_TIMEOUT_S:
+                del pending_commands[old]
+                if not command["acked"]:
+                    latency_counts["expired"] += 1
+        fanout = target == "all" or target.startswith("group:")
+        pending_commands[cid] = {"sent": now, "fanout": fanout, "acked": False}
+        latency_counts["sent"] += 1
+    return f"{payload};cid={cid}"
+
+def handle_ack(device_id, ack):
+    received = time.monotonic()
+    with latency_lock:
+        # a group or broadcast command is acked by every device, each is a sample
+        command = pending_commands.get(ack["cid"])
+        if command is None:
+            latency_counts["unmatched"] += 1
+            return
+        if command["fanout"]:
+            command["acked"] = True
+        else:
+            del pending_commands[ack["cid"]]
+        sent = command["sent"]
+        if ack.get("superseded"):
+            latency_counts["superseded"] += 1
+            return
+        total_ms = (received - sent) * 1000
+        device_ms = (ack["queue_us"] + ack["fade_us"]) / 1000
+        latency["total"].append(total_ms)
+        latency["device"].append(device_ms)
+        latency["queue"].append(ack["queue_us"] / 1000)
+        latency["fade"].append(ack["fade_us"] / 1000)
+        latency["network"].append(total_ms - device_ms)
+        latency_counts["acked"] += 1
+    print(f"[{device_id}] Command {ack['cid']} acked after {total_ms:.1f} ms "
+          f"(queue {ack['queue_us'] / 1000:.1f} ms, fade {ack['fade_us'] / 1000:.1f} ms)")
+
+def percentile(ordered, p):
+    """Nearest-rank percentile of a sorted list."""
+    return ordered[max(0, min(len(ordered) - 1, int(round(p / 100 * len(ordered))) - 1))]
+
+def latency_summary():
+    with latency_lock:
+        legs = {leg: sorted(samples) for leg, samples in latency.items()}
+        summary = {"counts": dict(latency_counts), "pending": sum(1 for command in pending_commands.values() if not command["acked"])}
+    for leg, ordered in legs.items():
+        summary[leg] = {"samples": len(ordered)}
+        if ordered:
+            summary[leg].update({f"p{p}_ms": round(percentile(ordered, p), 2) for p in (50, 95, 99)})
+    return summary
+
+def command_topic(target, suffix):
+    """Topic for a command: "all" for the fleet, "group:<name>" or a device id."""
+    if target == "all":
+        return f"{broadcast_root_t}/{suffix}"
+    if target.startswith("group:"):
+        return f"{group_root_t}/{target[len('group:'):]}/{suffix}"
+    return f"{device_root_t}/{target}/{suffix}"
+
+def command_targets(target):
+    """(id, device) of the devices a command sent to `target` reaches, as far as we know.
+    A group command only counts the devices that reported that group."""
+    if target == "all":
+        return list(devices.items())
+    if target.startswith("group:"):
+        group = target[len("group:"):]
+        return [(device_id, device) for device_id, device in devices.items() if device["group"] == group]
+    return [(target, get_device(target))]
+
+def publish_desired(device_id, device):
+    """Retains the desired fan state of one device. Group and broadcast
+    commands update the devices known to be in scope so far. A device seen
+    later, or one in the group that hasn't reported it yet, doesn't get the
+    command's state restored on reconnect: it keeps its own retained state."""
+    topic = f"{device_root_t}/{device_id}/{desired_t}"
+    payload = f"{'ON' if device['desired_on'] else 'OFF'},{device['desired_duty']}"
+    # no message expiry: the retained state must outlive any outage
+    result = client.publish(topic, payload, qos=1, retain=True)
+    if result[0] != paho.MQTT_ERR_SUCCESS:
+        print(f"Failed to retain desired state on {topic}")
+
+def handle_desired(device_id, device, payload):
+    """Our own retained state, also delivered after a bridge restart."""
+    on, _, duty = payload.partition(",")
+    device["desired_on"] = on == "ON"
+    device["desired_duty"] = int(duty)
+
+def handle_group(device_id, device, payload):
+    if device["group"] != payload:
+        print(f"[{device_id}] In group {payload}")
+    device["group"] = payload
+
+def handle_presence(device_id, device, payload):
+    online = payload == "online"
+    if device["online"] != online:
+        device["presence_changed"] = time.time()
+        print(f"[{device_id}] {'online' if online else 'offline'}")
+    device["online"] = online
+
+def request_target():
+    data = request.get_json(silent=True) or {}
+    target = data.get("device") or request.args.get("device")
+    if target:
+        return str(target)
+    # with a single device the old single-fan UI keeps working
+    return next(iter(devices), "all")
 
 def on_connect(client, userdata, flags, rc, properties=None):
     print("CONNACK received with code %s." % rc)
-    client.subscribe(temp_t, qos=1)
-    client.subscribe(humidity_t, qos=1)
-    client.subscribe(read_t, qos=1)
+    for suffix in (telemetry_t, telemetry_bin_t, telemetry_batch_t, telemetry_bin_batch_t,
+                   temp_t, humidity_t, read_t, fan_ack_t, desired_t, presence_t, group_t):
+        client.subscribe(f"{device_root_t}/+/{suffix}", qos=1)
 
 def on_publish(client, userdata, mid, properties=None):
     print("Published: MID " + str(mid))
     
 def on_message(client, userdata, msg):
-    global current_temp, current_humidity, current_fan_output
     try:
         if not msg.payload:
             print(f"Warning: Received empty message on topic {msg.topic}")
             return
-        if msg.topic == temp_t:
-            current_temp = float(msg.payload.decode())
-            print(f"Updated current_temp: {current_temp}°C")
-        elif msg.topic == humidity_t:
-            current_humidity = float(msg.payload.decode())
-            print(f"Updated current_humidity: {current_humidity}%")
-        elif msg.topic == read_t:
-            current_fan_output = int(msg.payload.decode())
-            print(f"Updated current_fan_output: {current_fan_output}")
+        parts = msg.topic.split("/", 2)
+        if len(parts) != 3 or parts[0] != device_root_t:
+            print(f"Received message on unhandled topic: {msg.topic}")
+            return
+        device_id, suffix = parts[1], parts[2]
+        device = get_device(device_id)
+        # presence, group and desired state are retained, they may be old
+        if suffix == desired_t:
+            handle_desired(device_id, device, msg.payload.decode())
+            return
+        if suffix == presence_t:
+            handle_presence(device_id, device, msg.payload.decode())
+            return
+        if suffix == group_t:
+            handle_group(device_id, device, msg.payload.decode())
+            return
+        device["last_seen"] = time.time()
+        if suffix == telemetry_t:
+            handle_telemetry(device_id, device, json.loads(msg.payload.decode()), "text")
+        elif suffix == telemetry_bin_t:
+            handle_telemetry(device_id, device, decode_telemetry_bin(msg.payload)[0], "binary")
+        elif suffix == telemetry_batch_t:
+            for record in json.loads(msg.payload.decode()):
+                handle_telemetry(device_id, device, record, "text", replayed=True)
+        elif suffix == telemetry_bin_batch_t:
+            for record in decode_telemetry_bin_batch(msg.payload):
+                handle_telemetry(device_id, device, record, "binary", replayed=True)
+        elif suffix == temp_t:
+            device["current_temp"] = float(msg.payload.decode())
+            print(f"[{device_id}] Updated current_temp: {device['current_temp']}°C")
+        elif suffix == humidity_t:
+            device["current_humidity"] = float(msg.payload.decode())
+            print(f"[{device_id}] Updated current_humidity: {device['current_humidity']}%")
+        elif suffix == fan_ack_t:
+            handle_ack(device_id, json.loads(msg.payload.decode()))
+        elif suffix == read_t:
+            device["current_fan_output"] = int(msg.payload.decode())
+            print(f"[{device_id}] Updated current_fan_output: {device['current_fan_output']}")
         else:
             print(f"Received message on unhandled topic: {msg.topic}")
     except Exception as err: 
@@ -65,56 +387,120 @@ client.loop_start()
 def home():
     return render_template("dashboard.html")
 
+@app.route("/devices")
+def get_devices():
+    return jsonify([
+        {"device": device_id, "last_seen": device["last_seen"], "online": device["online"],
+         "group": device["group"],
+         "presence_changed": device["presence_changed"]}
+        for device_id, device in sorted(devices.items())
+    ])
+
 @app.route("/data")
 def get_data():
+    device_id = request_target()
+    if device_id not in devices:
+        return jsonify({"message": f"Unknown device {device_id}"}), 404
+    device = devices[device_id]
     # Debug: Print data before returning JSON
-    print(f"Sending Data: Fan Status: {fan_status}, Current Fan Output: {current_fan_output}, Temp: {current_temp}, Humidity: {current_humidity}")
+    print(f"Sending Data [{device_id}]: Fan Status: {device['fan_status']}, Current Fan Output: {device['current_fan_output']}, Temp: {device['current_temp']}, Humidity: {device['current_humidity']}")
     
     return jsonify({
-        "fan_status": str(fan_status),  
-        "current_fan_output": int(current_fan_output) if isinstance(current_fan_output, (int, float)) else 0,
-        "current_temp": float(current_temp),
-        "current_humidity": float(current_humidity)
+        "device": device_id,
+        "fan_status": str(device["fan_status"]),
+        "online": device["online"],
+        "desired": {"on": device["desired_on"], "duty": device["desired_duty"]},
+        "current_fan_output": int(device["current_fan_output"]) if isinstance(device["current_fan_output"], (int, float)) else 0,
+        "current_temp": float(device["current_temp"]),
+        "current_humidity": float(device["current_humidity"]),
+        "records": device["records"],
+        "replayed": device["replayed"],
+        "duplicates": device["duplicates"]
     })
 
 @app.route("/fan_toggle", methods=["POST"])
 def toggle_fan():
-    global fan_status
     try:
-        fan_status = "OFF" if fan_status == "ON" else "ON"
-        print(f"Fan toggled! Current status: {fan_status}")
+        target = request_target()
+        targets = command_targets(target)
+        current = targets[0][1]["fan_status"] if targets else "OFF"
+        fan_status = "OFF" if current == "ON" else "ON"
+        for device_id, device in targets:
+            device["fan_status"] = fan_status
+            device["desired_on"] = fan_status == "ON"
+            publish_desired(device_id, device)
+        print(f"Fan toggled on {target}! Current status: {fan_status}")
         
-        result = client.publish(status_t, fan_status, qos=1)
+        topic = command_topic(target, status_t)
+        result = publish_command(topic, traced_command(fan_status, target))
         if result[0] == paho.MQTT_ERR_SUCCESS:
-            print(f"Sent `{fan_status}` to topic `{status_t}`")
+            print(f"Sent `{fan_status}` to topic `{topic}`")
         else:
-            print(f"Failed to send toggle msg to topic {status_t}")
+            print(f"Failed to send toggle msg to topic {topic}")
         
-        return jsonify({"message": "Fan status updated!", "fan_status": fan_status})
+        return jsonify({"message": "Fan status updated!", "device": target, "fan_status": fan_status})
     except Exception as err:
         print(f"Error: {err}")
         return jsonify({"message": "Error toggling fan"}), 500
 
 @app.route("/set_fan_output", methods=["POST"])
 def set_fan_output():
-    global current_fan_output
     data = request.json  
 
     if "duty_c" in data and isinstance(data["duty_c"], int):
+        target = request_target()
         current_fan_output = max(0, min(data["duty_c"], 100))  
+        for device_id, device in command_targets(target):
+            device["desired_duty"] = current_fan_output
+            publish_desired(device_id, device)
 
-        result = client.publish(output_t, str(current_fan_output), qos=1)
+        topic = command_topic(target, output_t)
+        result = publish_command(topic, traced_command(str(current_fan_output), target))
         if result[0] == paho.MQTT_ERR_SUCCESS:
-            print(f"Sent `{current_fan_output}` to topic `{output_t}`")
+            print(f"Sent `{current_fan_output}` to topic `{topic}`")
         else:
-            print(f"Failed to send fan output msg to topic {output_t}")
+            print(f"Failed to send fan output msg to topic {topic}")
         
-        print(f"Fan Output Updated: {current_fan_output}")
+        print(f"Fan Output Updated on {target}: {current_fan_output}")
         
-        return jsonify({"message": "Fan output updated!", "current_fan_output": current_fan_output})
+        return jsonify({"message": "Fan output updated!", "device": target, "current_fan_output": current_fan_output})
     else:
         return jsonify({"message": "Invalid input"}), 400
 
+@app.route("/latency")
+def get_latency():
+    """Fan command latency per leg, see LATENCY_LEGS."""
+    return jsonify(latency_summary())
+
+@app.route("/set_encoding", methods=["POST"])
+def set_encoding():
+    data = request.get_json(silent=True) or {}
+    encoding = data.get("encoding")
+    device_id = request_target()
+    if encoding not in ("text", "binary") or device_id not in devices:
+        return jsonify({"message": "Invalid input"}), 400
+    request_encoding(device_id, devices[device_id], encoding)
+    return jsonify({"message": "Encoding requested", "device": device_id, "encoding": encoding})
+
+@app.route("/set_policy", methods=["POST"])
+def set_policy():
+    """Publish policy for a device, group or the fleet, e.g.
+    {"device": "all", "policy": {"heartbeat_ms": 600000, "temp_abs": 3}}"""
+    data = request.get_json(silent=True) or {}
+    policy = data.get("policy")
+    if not isinstance(policy, dict) or not policy or not all(
+            isinstance(k, str) and isinstance(v, int) and v >= 0 for k, v in policy.items()):
+        return jsonify({"message": "Invalid input"}), 400
+    target = request_target()
+    topic = command_topic(target, policy_t)
+    payload = ",".join(f"{k}={v}" for k, v in policy.items())
+    result = publish_command(topic, payload)
+    if result[0] != paho.MQTT_ERR_SUCCESS:
+        print(f"Failed to send policy to topic {topic}")
+        return jsonify({"message": "Publish failed"}), 500
+    print(f"Sent `{payload}` to topic `{topic}`")
+    return jsonify({"message": "Policy sent", "device": target, "policy": payload})
+
 if __name__ == "__main__":
     try:
         
@@ -0,0 +1,135 @@
+"""Measures fan command latency end to end without hardware.
+
+Starts a local mosquitto, a simulated device that answers fan commands like
+esp32_client/main/fan_actuator.c (fan/read right away, fan/ack once the fade
+is over) and the bridge from app.py, then sends fan commands through the
+bridge's /set_fan_output route and prints its /latency summary.
+
+    python3 latency_harness.py --commands 50 --fade-ms 1000
+
+Needs mosquitto in PATH, or --no-broker to use one already running on --port.
+"""
+import argparse
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import threading
+import time
+
+import paho.mqtt.client as paho
+
+DEVICE_ID = "sim-latency"
+
+
+class SimulatedDevice:
+    """Fan actuator stand-in: one fade at a time, a new target supersedes it."""
+
+    def __init__(self, broker, port, fade_ms, queue_ms):
+        self.fade_ms = fade_ms
+        self.queue_ms = queue_ms
+        self.duty = 0
+        self.fade = None    # (timer, ack) of the running traced fade
+        self.lock = threading.Lock()
+        self.client = paho.Client(client_id=DEVICE_ID)
+        self.client.on_connect = self.on_connect
+        self.client.on_message = self.on_message
+        self.client.connect(broker, port)
+        self.client.loop_start()
+
+    def on_connect(self, client, userdata, flags, rc):
+        client.subscribe(f"devices/{DEVICE_ID}/cmd/#", qos=0)
+        # announce the device to the bridge
+        client.publish(f"devices/{DEVICE_ID}/fan/read", "0")
+
+    def on_message(self, client, userdata, msg):
+        rx = time.monotonic()
+        value, _, cid = msg.payload.decode().partition(";cid=")
+        if msg.topic.endswith("/fan/output"):
+            duty = int(value)
+        elif msg.topic.endswith("/fan/status"):
+            duty = 80 if value == "ON" else 0
+        else:
+            return
+        client.publish(f"devices/{DEVICE_ID}/fan/read", str(duty))
+        # the actuator task picks the target up a little later
+        delay = random.uniform(0, self.queue_ms) / 1000
+        threading.Timer(delay, self.start_fade, (duty, cid, rx)).start()
+
+    def start_fade(self, duty, cid, rx):
+        start = time.monotonic()
+        ack = {"cid": cid, "duty": duty, "queue_us": int((start - rx) * 1e6)}
+        with self.lock:
+            if self.fade is not None:
+                timer, old = self.fade
+                timer.cancel()
+                self.publish_ack(dict(old, superseded=True))
+            fade_s = 0 if duty == self.duty else self.fade_ms / 1000
+            self.duty = duty
+            timer = threading.Timer(fade_s, self.end_fade, (ack, start))
+            self.fade = (timer, ack) if cid else None
+            timer.start()
+
+    def end_fade(self, ack, start):
+        with self.lock:
+            if self.fade is None or self.fade[1] is not ack:
+                return
+            self.fade = None
+        ack["fade_us"] = int((time.monotonic() - start) * 1e6)
+        self.publish_ack(ack)
+
+    def publish_ack(self, ack):
+        self.client.publish(f"devices/{DEVICE_ID}/fan/ack", json.dumps(ack))
+
+    def stop(self):
+        self.client.loop_stop()
+        self.client.disconnect()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=18830)
+    parser.add_argument("--no-broker", action="store_true", help="use a broker already listening on --port")
+    parser.add_argument("--commands", type=int, default=50)
+    parser.add_argument("--interval-ms", type=int, default=1500, help="time between commands")
+    parser.add_argument("--fade-ms", type=int, default=1000, help="FAN_FADE_TIME_DEFAULT_MS of the device")
+    parser.add_argument("--queue-ms", type=float, default=2, help="largest delay before a fade starts")
+    args = parser.parse_args()
+
+    broker = None
+    if not args.no_broker:
+        if shutil.which("mosquitto") is None:
+            sys.exit("mosquitto not found, install it or pass --no-broker")
+        broker = subprocess.Popen(["mosquitto", "-p", str(args.port)],
+                                  stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        time.sleep(0.5)
+
+    # app.py connects when imported
+    os.environ["MQTT_BROKER"] = "localhost"
+    os.environ["MQTT_PORT"] = str(args.port)
+    sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+    import app
+
+    device = SimulatedDevice("localhost", args.port, args.fade_ms, args.queue_ms)
+    try:
+        deadline = time.monotonic() + 5
+        while DEVICE_ID not in app.devices and time.monotonic() < deadline:
+            time.sleep(0.05)
+        web = app.app.test_client()
+        for i in range(args.commands):
+            web.post("/set_fan_output", json={"device": DEVICE_ID, "duty_c": random.randint(0, 100)})
+            time.sleep(args.interval_ms / 1000)
+        time.sleep(args.fade_ms / 1000 + 1)
+        print(json.dumps(web.get("/latency").get_json(), indent=2))
+    finally:
+        device.stop()
+        app.client.loop_stop()
+        app.client.disconnect()
+        if broker is not None:
+            broker.terminate()
+
+
+if __name__ == "__main__":
+    main()
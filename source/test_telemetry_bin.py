@@ -0,0 +1,82 @@
+"""Decodes records written by the firmware's C encoder with the bridge's decoder.
+
+The fixture is written by esp32_client/host_test/test_telemetry.c, which
+also checks that the encoder still produces it:
+
+    python3 -m unittest test_telemetry_bin
+"""
+import os
+import sys
+import unittest
+
+import paho.mqtt.client as paho
+
+FIXTURE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                       "..", "esp32_client", "host_test", "telemetry_bin_fixture.hex")
+
+# Keep in sync with fixture_records in esp32_client/host_test/test_telemetry.c
+FIXTURE_RECORDS = [
+    {"v": 1, "seq": 7, "ts_ms": 35012, "fan": {"on": 1, "duty": 80}, "sensors": [
+        {"temp": -5.5, "humidity": 45.3, "temp_raw": -5.7, "humidity_raw": 45.0},
+    ]},
+    {"v": 1, "seq": 4294967295, "ts_ms": 123, "fan": {"on": 0, "duty": 0}, "sensors": [
+        {"temp": 24.4, "humidity": 45.0, "temp_raw": 24.5, "humidity_raw": 44.0},
+        None,
+        {"temp": -40.0, "humidity": 100.0, "temp_raw": -3276.8, "humidity_raw": 0.0},
+    ]},
+]
+
+
+class OfflineClient:
+    """Stands in for the MQTT client app.py connects when imported."""
+
+    def __init__(self, *args, **kwargs):
+        pass
+
+    def connect(self, *args, **kwargs):
+        pass
+
+    def loop_start(self):
+        pass
+
+
+def import_app():
+    client = paho.Client
+    paho.Client = OfflineClient
+    try:
+        sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+        import app
+    finally:
+        paho.Client = client
+    return app
+
+
+app = import_app()
+
+
+class TelemetryBinTest(unittest.TestCase):
+    def setUp(self):
+        with open(FIXTURE) as f:
+            self.payloads = [bytes.fromhex(line) for line in f.read().split()]
+
+    def test_records(self):
+        self.assertEqual(len(self.payloads), len(FIXTURE_RECORDS))
+        for payload, expected in zip(self.payloads, FIXTURE_RECORDS):
+            record, offset = app.decode_telemetry_bin(payload)
+            self.assertEqual(record, expected)
+            self.assertEqual(offset, len(payload))
+
+    def test_batch(self):
+        self.assertEqual(app.decode_telemetry_bin_batch(b"".join(self.payloads)), FIXTURE_RECORDS)
+
+    def test_truncated(self):
+        with self.assertRaises(Exception):
+            app.decode_telemetry_bin(self.payloads[1][:-1])
+
+    def test_unknown_version(self):
+        with self.assertRaises(ValueError):
+            app.decode_telemetry_bin(b"\x02" + self.payloads[0][1:])
+
+
+if __name__ == "__main__":
+    unittest.main()